@@ -0,0 +1,21 @@
+#!/bin/sh
+# Compare two result files written by the benchmarks (name, value, unit, which way is better) and exit 1
+# if a metric got worse than the baseline by more than the tolerance, in percent
+if [ $# -lt 2 ]; then
+    echo "Usage: $0 <baseline.tsv> <results.tsv> [tolerance %, default 10]" >&2
+    exit 2
+fi
+
+awk -F '\t' -v tolerance="${3:-10}" '
+    NR == FNR { baseline[$1] = $2; next }
+    {
+        if (!($1 in baseline)) { printf "%-28s %14.6g %-10s new\n", $1, $2, $3; next }
+        base = baseline[$1]
+        change = base != 0 ? ($2 - base) * 100 / base : 0
+        worse = ($4 == "higher") ? -change : change
+        status = worse > tolerance ? "REGRESSION" : (worse < -tolerance ? "improved" : "ok")
+        if (status == "REGRESSION") failed++
+        printf "%-28s %14.6g %-10s %+7.1f%% %s\n", $1, $2, $3, change, status
+    }
+    END { exit failed > 0 }
+' "$1" "$2"
@@ -0,0 +1,23 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench_report.h"
+
+// Function to append one result as a tab separated line: name, value, unit, and which way is better,
+// the format bench_compare.sh reads
+void bench_report(const char* name, double value, const char* unit, BenchDirection direction)
+{
+    const char* path = getenv(BENCH_RESULTS_ENV);
+    if (!path || !*path)
+    {
+        return;
+    }
+    FILE* file = fopen(path, "a");
+    if (!file)
+    {
+        perror(path);
+        return;
+    }
+    fprintf(file, "%s\t%.6g\t%s\t%s\n", name, value, unit,
+            direction == BENCH_HIGHER_IS_BETTER ? "higher" : "lower");
+    fclose(file);
+}
@@ -0,0 +1,14 @@
+#ifndef BENCH_REPORT_H
+#define BENCH_REPORT_H
+
+#define BENCH_RESULTS_ENV "BENCH_RESULTS" // File the results are appended to, unset prints only
+
+typedef enum
+{
+    BENCH_LOWER_IS_BETTER,
+    BENCH_HIGHER_IS_BETTER
+} BenchDirection;
+
+void bench_report(const char* name, double value, const char* unit, BenchDirection direction);
+
+#endif // BENCH_REPORT_H
@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sqlite3.h>
+#include "dedup_cache.h"
+
+#define BENCH_DB "/tmp/dedup_bench.db"
+#define BENCH_SENSORS 1000 // Sensor ids the readings are spread over
+#define BENCH_READINGS 100000 // Readings inserted through each path at most
+#define BENCH_SECONDS 3.0 // Time budget per path, the SELECT path rarely gets through all readings
+#define BENCH_BATCH 256 // Readings per transaction, as the storage writer does
+
+// Function to return a monotonic timestamp in seconds
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Function to run a statement and stop the benchmark on failure
+static void exec_or_die(sqlite3* db, const char* sql)
+{
+    char* err = NULL;
+    if (sqlite3_exec(db, sql, NULL, NULL, &err) != SQLITE_OK)
+    {
+        fprintf(stderr, "%s: %s\n", sql, err);
+        exit(1);
+    }
+}
+
+// Function to fill the table with old rows that are outside the duplicate window
+static void load_rows(sqlite3* db, long rows)
+{
+    sqlite3_stmt* stmt;
+    exec_or_die(db, "BEGIN;");
+    sqlite3_prepare_v2(db, "INSERT INTO sensor_data (sensor_id, temperature, humidity, timestamp) "
+                           "VALUES (?, ?, ?, datetime('now', '-1 day', 'localtime'));", -1, &stmt, NULL);
+    for (long i = 0; i < rows; i++)
+    {
+        sqlite3_bind_int(stmt, 1, (int)(i % BENCH_SENSORS));
+        sqlite3_bind_double(stmt, 2, 15.0 + (i % 2000) / 100.0);
+        sqlite3_bind_double(stmt, 3, 30.0 + (i % 7000) / 100.0);
+        sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+    exec_or_die(db, "COMMIT;");
+}
+
+// Function to insert readings with either the SELECT COUNT(*) check or the in-memory cache, returns inserts/s
+static double bench_inserts(sqlite3* db, int use_cache)
+{
+    sqlite3_stmt *check, *insert;
+    sqlite3_prepare_v2(db, "SELECT COUNT(*) FROM sensor_data WHERE sensor_id = ? AND temperature = ? AND humidity = ? "
+                           "AND timestamp >= datetime('now', '-10 seconds', 'localtime');", -1, &check, NULL);
+    sqlite3_prepare_v2(db, "INSERT INTO sensor_data (sensor_id, temperature, humidity, timestamp) "
+                           "VALUES (?, ?, ?, datetime('now', 'localtime'));", -1, &insert, NULL);
+    DedupCache cache;
+    dedup_cache_init(&cache);
+
+    int done = 0;
+    double start = now_seconds();
+    while (done < BENCH_READINGS && now_seconds() - start < BENCH_SECONDS)
+    {
+        exec_or_die(db, "BEGIN;");
+        for (int i = 0; i < BENCH_BATCH && now_seconds() - start < BENCH_SECONDS; i++, done++)
+        {
+            SensorReading reading = {.sensor_id = done % BENCH_SENSORS, .temperature = 20.0 + (done % 1000) / 100.0,
+                                     .humidity = 50.0 + (done % 3000) / 100.0};
+            long now = (long)time(NULL);
+            int duplicate;
+            if (use_cache)
+            {
+                duplicate = dedup_cache_is_duplicate(&cache, &reading, now);
+            }
+            else
+            {
+                sqlite3_bind_int(check, 1, reading.sensor_id);
+                sqlite3_bind_double(check, 2, reading.temperature);
+                sqlite3_bind_double(check, 3, reading.humidity);
+                duplicate = sqlite3_step(check) == SQLITE_ROW && sqlite3_column_int(check, 0) > 0;
+                sqlite3_reset(check);
+            }
+            if (duplicate)
+            {
+                continue;
+            }
+
+            sqlite3_bind_int(insert, 1, reading.sensor_id);
+            sqlite3_bind_double(insert, 2, reading.temperature);
+            sqlite3_bind_double(insert, 3, reading.humidity);
+            if (sqlite3_step(insert) == SQLITE_DONE && use_cache)
+            {
+                dedup_cache_remember(&cache, &reading, now);
+            }
+            sqlite3_reset(insert);
+        }
+        exec_or_die(db, "COMMIT;");
+    }
+    double elapsed = now_seconds() - start;
+
+    dedup_cache_destroy(&cache);
+    sqlite3_finalize(check);
+    sqlite3_finalize(insert);
+    return done / elapsed;
+}
+
+// Usage: dedup_bench [rows...], defaults to 1M and 50M existing rows
+int main(int argc, char* argv[])
+{
+    const char* defaults[] = {"dedup_bench", "1000000", "50000000"};
+    if (argc < 2)
+    {
+        argc = 3;
+        argv = (char**)defaults;
+    }
+
+    printf("%12s %16s %16s\n", "rows", "SELECT inserts/s", "cache inserts/s");
+    for (int i = 1; i < argc; i++)
+    {
+        long rows = atol(argv[i]);
+        sqlite3* db;
+        unlink(BENCH_DB);
+        if (sqlite3_open(BENCH_DB, &db) != SQLITE_OK)
+        {
+            fprintf(stderr, "Can't open %s\n", BENCH_DB);
+            return 1;
+        }
+        exec_or_die(db, "PRAGMA journal_mode=WAL; PRAGMA synchronous=NORMAL;");
+        exec_or_die(db, "CREATE TABLE sensor_data (id INTEGER PRIMARY KEY AUTOINCREMENT, sensor_id INTEGER, "
+                        "temperature REAL, humidity REAL, timestamp DATETIME DEFAULT CURRENT_TIMESTAMP);");
+        load_rows(db, rows);
+
+        double select_rate = bench_inserts(db, 0);
+        double cache_rate = bench_inserts(db, 1);
+        printf("%12ld %16.1f %16.0f\n", rows, select_rate, cache_rate);
+        fflush(stdout);
+
+        sqlite3_close(db);
+    }
+    unlink(BENCH_DB);
+    unlink(BENCH_DB "-wal");
+    unlink(BENCH_DB "-shm");
+    return 0;
+}
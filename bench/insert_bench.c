@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "storage_backend.h"
+#include "storage_schema.h"
+#include "bench_report.h"
+
+#define BENCH_DIR_TEMPLATE "/tmp/insert_bench.XXXXXX"
+#define BENCH_SENSORS 1000 // Sensors reporting once a second each, a million rows is about 17 minutes
+#define BENCH_BATCH 256 // Readings per append, the storage writer's default batch size
+#define BENCH_MEASURED 100000 // Readings timed at each table size
+
+static const long table_sizes[] = {0, 250000, 1000000}; // Rows already stored when the timing starts
+
+// Function to return a monotonic timestamp in seconds
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Function to append readings first to last, continuing the simulated clock where the previous call stopped
+static void append_readings(StorageBackend* backend, long first, long last, long start_ts)
+{
+    SensorReading batch[BENCH_BATCH];
+    for (long i = first; i < last; i += BENCH_BATCH)
+    {
+        int n = last - i < BENCH_BATCH ? (int)(last - i) : BENCH_BATCH;
+        for (int r = 0; r < n; r++)
+        {
+            long k = i + r;
+            batch[r] = (SensorReading){.sensor_id = (int)(k % BENCH_SENSORS) + 1,
+                                       .temperature = 20.0 + (k % 1000) / 100.0,
+                                       .humidity = 40.0 + (k % 500) / 10.0,
+                                       .timestamp = start_ts + k / BENCH_SENSORS};
+        }
+        StorageBatch stored = {.readings = batch, .count = n};
+        if (storage_append(backend, &stored) == -1)
+        {
+            fprintf(stderr, "Append failed\n");
+            exit(1);
+        }
+    }
+}
+
+int main(void)
+{
+    char dir[] = BENCH_DIR_TEMPLATE;
+    if (!mkdtemp(dir) || chdir(dir) == -1)
+    {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    GatewayConfig config = {.sync_level = DEFAULT_SYNC_LEVEL, .backend = "sqlite"};
+    StorageBackend backend;
+    if (storage_backend_init(&backend, &config) == -1 || storage_open(&backend) == -1)
+    {
+        fprintf(stderr, "Failed to open the sqlite backend\n");
+        return 1;
+    }
+
+    // Start at midnight so every row lands in one daily partition and its index grows to the measured size
+    long start_ts = (long)time(NULL) / PARTITION_SECONDS * PARTITION_SECONDS;
+
+    printf("%d sensors, batches of %d, synchronous %s\n", BENCH_SENSORS, BENCH_BATCH,
+           sync_level_name(config.sync_level));
+    printf("%12s %14s\n", "table rows", "inserts/s");
+    long rows = 0;
+    for (size_t s = 0; s < sizeof(table_sizes) / sizeof(table_sizes[0]); s++)
+    {
+        append_readings(&backend, rows, table_sizes[s], start_ts); // Grow the table, untimed
+        storage_flush(&backend);
+        rows = table_sizes[s];
+
+        double start = now_seconds();
+        append_readings(&backend, rows, rows + BENCH_MEASURED, start_ts);
+        storage_flush(&backend);
+        double rate = BENCH_MEASURED / (now_seconds() - start);
+        rows += BENCH_MEASURED;
+        printf("%12ld %14.0f\n", table_sizes[s], rate);
+
+        char name[64];
+        snprintf(name, sizeof(name), "storage.insert_%ldk_rows", table_sizes[s] / 1000);
+        bench_report(name, rate, "rows/s", BENCH_HIGHER_IS_BETTER);
+    }
+
+    storage_close(&backend);
+    storage_backend_destroy(&backend);
+    char command[128];
+    snprintf(command, sizeof(command), "rm -rf %s", dir);
+    if (chdir("/") == -1 || system(command) != 0)
+    {
+        fprintf(stderr, "Failed to remove %s\n", dir);
+    }
+    return 0;
+}
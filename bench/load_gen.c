@@ -0,0 +1,902 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <arpa/inet.h>
+#include <sqlite3.h>
+#include "sensor_parser.h"
+#include "storage_schema.h"
+#include "bench_report.h"
+
+#define DEFAULT_SENSORS 1000
+#define DEFAULT_RATE 1.0 // Readings per second and sensor
+#define DEFAULT_JITTER 20 // Percent of the interval a sample moves by at most
+#define DEFAULT_DURATION_S 30
+#define DEFAULT_RAMP_MS 1000 // Connects are spread over this long, 0 opens them all at once
+#define DEFAULT_SETTLE_S 5 // Time left for the last readings to reach storage
+#define DEFAULT_FIRST_ID 100000 // Simulated sensor ids start here, clear of real nodes
+#define DEFAULT_DB "sensor_data.db"
+#define OUT_BUFFER 8192 // Bytes a simulated sensor may have queued before it drops samples
+#define BATCH_READINGS 8 // Readings per binary batch frame
+#define SLOW_WRITE_MS 20 // The second half of a split frame follows this much later
+#define RECONNECT_MS 1000 // Wait after a refused or lost connection
+#define STORM_FRACTION 10 // A connect storm drops and reconnects one sensor in this many
+#define POLL_MS 10 // Storage is checked this often for new rows, the latency resolution
+#define SEQ_LIMIT 1000000 // Readings one sensor may send, the sequence is encoded in its values
+#define SEND_UNITS 10.0 // Send times are kept in tenths of a millisecond
+#define MATCHED UINT32_MAX // Send time slot of a reading already found in storage
+#define HELD_PER_SENSOR 4 // Split frames pending per sensor at most, counting those of dropped connections
+#define MAX_EVENTS 256
+
+typedef enum
+{
+    KIND_TEXT,
+    KIND_BINARY,
+    KIND_CRC,
+    KIND_BATCH,
+    KIND_COUNT
+} PayloadKind;
+
+static const char* kind_names[KIND_COUNT] = {"text", "binary", "crc", "batch"};
+
+typedef enum
+{
+    SENSOR_IDLE, // Waiting to connect
+    SENSOR_CONNECTING,
+    SENSOR_RUNNING
+} SensorState;
+
+typedef struct
+{
+    int id;
+    int fd;
+    SensorState state;
+    PayloadKind kind;
+    unsigned int generation; // Bumped on every (re)connect, older timers are ignored
+    int want_write; // EPOLLOUT is armed
+    int seq; // Readings generated so far, the next one's sequence
+    int seq_capacity;
+    uint32_t* sent_at; // Sample time of every reading by sequence, 0 until generated
+    SensorReading pending[BATCH_READINGS]; // Batch being filled
+    int pending_count;
+    unsigned char out[OUT_BUFFER]; // Encoded frames not written yet
+    size_t out_sent;
+    size_t out_len;
+    size_t out_limit; // Bytes that may go out now, less than out_len while a split frame is held back
+} SimSensor;
+
+typedef struct
+{
+    double at; // Milliseconds since the start
+    int sensor;
+    unsigned int generation;
+} Timer;
+
+typedef struct
+{
+    Timer* items;
+    size_t count;
+    size_t size;
+} TimerHeap;
+
+typedef struct
+{
+    double at; // When the rest of a split frame may go out
+    int sensor;
+    unsigned int generation;
+} HeldWrite;
+
+typedef struct
+{
+    int sensors;
+    double rate;
+    int jitter;
+    int duration_s;
+    int ramp_ms;
+    int storm_s; // 0 disables connect storms
+    int slow_percent; // Frames written in two parts
+    int mix[KIND_COUNT]; // Weights of the payload kinds
+    int first_id;
+    int settle_s;
+    const char* address;
+    int port;
+    const char* db_path;
+} LoadConfig;
+
+typedef struct
+{
+    long connects;
+    long connect_failures;
+    long disconnects;
+    long storm_drops;
+    long readings; // Generated and queued on a socket
+    long backpressure_drops; // Samples skipped because the socket buffer was full
+    long bytes;
+    double all_connected_ms; // When every sensor was connected the first time, 0 before
+} SendStats;
+
+static SimSensor* sensors = NULL;
+static LoadConfig config;
+static SendStats stats;
+static struct timespec started;
+static volatile int collecting = 1;
+static HeldWrite* held = NULL; // FIFO of split frames, in release order since the delay is constant
+static size_t held_head = 0;
+static size_t held_count = 0;
+
+// Collector state, only touched by the collector thread until it is joined
+static float* latencies = NULL;
+static long latency_count = 0;
+static long duplicate_rows = 0;
+static const char* collect_error = NULL;
+
+// Function to return the milliseconds elapsed since the start
+static double elapsed_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - started.tv_sec) * 1000.0 + (now.tv_nsec - started.tv_nsec) / 1e6;
+}
+
+// Function to return a uniform random number in [0, 1)
+static double uniform(void)
+{
+    return rand() / (RAND_MAX + 1.0);
+}
+
+// Function to push a timer on the min-heap ordered by time
+static void heap_push(TimerHeap* heap, double at, int sensor)
+{
+    if (heap->count == heap->size)
+    {
+        heap->size = heap->size ? heap->size * 2 : 1024;
+        heap->items = realloc(heap->items, heap->size * sizeof(Timer));
+        if (!heap->items)
+        {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    size_t i = heap->count++;
+    Timer timer = {.at = at, .sensor = sensor, .generation = sensors[sensor].generation};
+    while (i > 0 && heap->items[(i - 1) / 2].at > at)
+    {
+        heap->items[i] = heap->items[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap->items[i] = timer;
+}
+
+// Function to remove the earliest timer from the heap
+static Timer heap_pop(TimerHeap* heap)
+{
+    Timer top = heap->items[0];
+    Timer last = heap->items[--heap->count];
+    size_t i = 0;
+    while (1)
+    {
+        size_t child = 2 * i + 1;
+        if (child >= heap->count)
+        {
+            break;
+        }
+        if (child + 1 < heap->count && heap->items[child + 1].at < heap->items[child].at)
+        {
+            child++;
+        }
+        if (heap->items[child].at >= last.at)
+        {
+            break;
+        }
+        heap->items[i] = heap->items[child];
+        i = child;
+    }
+    if (heap->count > 0)
+    {
+        heap->items[i] = last;
+    }
+    return top;
+}
+
+// Function to return the time until the next sample of a sensor, jittered around the mean interval
+static double next_interval_ms(void)
+{
+    double interval = 1000.0 / config.rate;
+    return interval * (1.0 + config.jitter / 100.0 * (2.0 * uniform() - 1.0));
+}
+
+// Function to arm or disarm EPOLLOUT on a sensor socket
+static void watch_writable(int epoll_fd, SimSensor* sensor, int sensor_index, int want_write)
+{
+    if (sensor->want_write == want_write)
+    {
+        return;
+    }
+    struct epoll_event ev = {.events = EPOLLIN | EPOLLRDHUP | (want_write ? EPOLLOUT : 0),
+                             .data.u64 = (uint64_t)sensor_index};
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, sensor->fd, &ev);
+    sensor->want_write = want_write;
+}
+
+// Function to drop a connection; the sensor reconnects after a pause, or at once during a storm
+static void drop_connection(TimerHeap* heap, int sensor_index, double delay_ms)
+{
+    SimSensor* sensor = &sensors[sensor_index];
+    close(sensor->fd);
+    sensor->fd = -1;
+    sensor->state = SENSOR_IDLE;
+    sensor->generation++;
+    sensor->want_write = 0;
+    sensor->out_sent = sensor->out_len = sensor->out_limit = 0; // Readings still queued are lost
+    sensor->pending_count = 0;
+    heap_push(heap, elapsed_ms() + delay_ms, sensor_index);
+}
+
+// Function to start a non-blocking connect, completion is reported by EPOLLOUT
+static void start_connect(int epoll_fd, TimerHeap* heap, int sensor_index, const struct sockaddr_in* addr)
+{
+    SimSensor* sensor = &sensors[sensor_index];
+    sensor->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sensor->fd == -1)
+    {
+        stats.connect_failures++;
+        sensor->generation++;
+        heap_push(heap, elapsed_ms() + RECONNECT_MS, sensor_index);
+        return;
+    }
+    stats.connects++;
+    sensor->generation++;
+    sensor->state = SENSOR_CONNECTING;
+    sensor->want_write = 1;
+    struct epoll_event ev = {.events = EPOLLOUT | EPOLLIN | EPOLLRDHUP, .data.u64 = (uint64_t)sensor_index};
+    if ((connect(sensor->fd, (const struct sockaddr*)addr, sizeof(*addr)) == -1 && errno != EINPROGRESS) ||
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sensor->fd, &ev) == -1)
+    {
+        stats.connect_failures++;
+        drop_connection(heap, sensor_index, RECONNECT_MS);
+    }
+}
+
+// Function to append an encoded frame, holding part of it back when this write should arrive split
+static int queue_frame(int sensor_index, const unsigned char* frame, size_t length)
+{
+    SimSensor* sensor = &sensors[sensor_index];
+    if (sensor->out_len + length > OUT_BUFFER && sensor->out_sent > 0)
+    {
+        // Compact, the written prefix is not needed anymore
+        memmove(sensor->out, sensor->out + sensor->out_sent, sensor->out_len - sensor->out_sent);
+        sensor->out_len -= sensor->out_sent;
+        sensor->out_limit -= sensor->out_sent;
+        sensor->out_sent = 0;
+    }
+    if (sensor->out_len + length > OUT_BUFFER)
+    {
+        return -1; // The gateway does not keep up with this sensor
+    }
+
+    int splitting = sensor->out_limit < sensor->out_len; // An earlier split frame is still held back
+    memcpy(sensor->out + sensor->out_len, frame, length);
+    size_t held_size = (size_t)config.sensors * HELD_PER_SENSOR;
+    if (!splitting && length > 1 && held_count < held_size && (int)(uniform() * 100) < config.slow_percent)
+    {
+        sensor->out_limit = sensor->out_len + 1 + (size_t)(uniform() * (length - 1)); // Split inside the frame
+        HeldWrite* write = &held[(held_head + held_count++) % held_size];
+        *write = (HeldWrite){.at = elapsed_ms() + SLOW_WRITE_MS, .sensor = sensor_index,
+                             .generation = sensor->generation};
+    }
+    else if (!splitting)
+    {
+        sensor->out_limit = sensor->out_len + length;
+    }
+    sensor->out_len += length;
+    stats.bytes += (long)length;
+    return 0;
+}
+
+// Function to write what may go out now, returns -1 if the connection is gone
+static int flush_output(int epoll_fd, int sensor_index)
+{
+    SimSensor* sensor = &sensors[sensor_index];
+    while (sensor->out_sent < sensor->out_limit)
+    {
+        ssize_t n = send(sensor->fd, sensor->out + sensor->out_sent, sensor->out_limit - sensor->out_sent,
+                         MSG_NOSIGNAL);
+        if (n > 0)
+        {
+            sensor->out_sent += (size_t)n;
+            continue;
+        }
+        if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            watch_writable(epoll_fd, sensor, sensor_index, 1);
+            return 0;
+        }
+        return -1;
+    }
+    if (sensor->out_sent == sensor->out_len)
+    {
+        sensor->out_sent = sensor->out_len = sensor->out_limit = 0;
+    }
+    watch_writable(epoll_fd, sensor, sensor_index, 0);
+    return 0;
+}
+
+// Function to encode a batch frame from the readings a batch sensor collected
+static int queue_batch(int sensor_index)
+{
+    SimSensor* sensor = &sensors[sensor_index];
+    unsigned char frame[BINARY_BATCH_FRAME_MAX];
+    size_t length = encode_binary_batch(frame, sensor->pending, sensor->pending_count, 0);
+    sensor->pending_count = 0;
+    return queue_frame(sensor_index, frame, length);
+}
+
+// Function to generate the next reading of a sensor; its sequence number is encoded in the values so the
+// collector can tell which reading a stored row is, and consecutive values never look like duplicates;
+// returns -1 if the connection is gone
+static int generate_reading(int epoll_fd, int sensor_index, double now)
+{
+    SimSensor* sensor = &sensors[sensor_index];
+    if (sensor->seq >= sensor->seq_capacity)
+    {
+        return 0;
+    }
+    int seq = sensor->seq;
+    SensorReading reading = {.sensor_id = sensor->id, .temperature = (seq % 1000) / 10.0,
+                             .humidity = (seq / 1000) / 10.0, .timestamp = (long)time(NULL)};
+    unsigned char frame[BINARY_FRAME_MAX > TEXT_FRAME_MAX ? BINARY_FRAME_MAX : TEXT_FRAME_MAX];
+    size_t length = 0;
+    int rc = 0;
+
+    switch (sensor->kind)
+    {
+    case KIND_TEXT:
+        length = (size_t)snprintf((char*)frame, sizeof(frame), "SENSOR:%d,TEMP:%.2f,HUM:%.2f\n", sensor->id,
+                                  reading.temperature, reading.humidity);
+        rc = queue_frame(sensor_index, frame, length);
+        break;
+    case KIND_BINARY:
+    case KIND_CRC:
+        length = encode_binary_frame(frame, &reading, sensor->kind == KIND_CRC);
+        rc = queue_frame(sensor_index, frame, length);
+        break;
+    case KIND_BATCH:
+        sensor->pending[sensor->pending_count++] = reading;
+        if (sensor->pending_count == BATCH_READINGS)
+        {
+            rc = queue_batch(sensor_index); // Latency of a batch includes the wait for its last reading
+        }
+        break;
+    default:
+        break;
+    }
+
+    if (rc == -1)
+    {
+        stats.backpressure_drops++;
+        return 0;
+    }
+    __atomic_store_n(&sensor->sent_at[seq], (uint32_t)(now * SEND_UNITS) + 1, __ATOMIC_RELEASE);
+    sensor->seq++;
+    stats.readings++;
+    return flush_output(epoll_fd, sensor_index);
+}
+
+// Function to finish a non-blocking connect and send the ID handshake
+static void connect_done(int epoll_fd, TimerHeap* heap, int sensor_index, double now)
+{
+    SimSensor* sensor = &sensors[sensor_index];
+    int error = 0;
+    socklen_t len = sizeof(error);
+    if (getsockopt(sensor->fd, SOL_SOCKET, SO_ERROR, &error, &len) == -1 || error != 0)
+    {
+        stats.connect_failures++;
+        drop_connection(heap, sensor_index, RECONNECT_MS);
+        return;
+    }
+
+    char id_msg[32];
+    int binary = sensor->kind != KIND_TEXT;
+    int length = binary ? sprintf(id_msg, "ID:%d,BIN:%d\n", sensor->id, BINARY_VERSION) :
+                          sprintf(id_msg, "ID:%d\n", sensor->id);
+    sensor->state = SENSOR_RUNNING;
+    sensor->out_sent = sensor->out_len = sensor->out_limit = 0;
+    memcpy(sensor->out, id_msg, (size_t)length);
+    sensor->out_len = sensor->out_limit = (size_t)length;
+    if (flush_output(epoll_fd, sensor_index) == -1)
+    {
+        stats.disconnects++;
+        drop_connection(heap, sensor_index, RECONNECT_MS);
+        return;
+    }
+    heap_push(heap, now + uniform() * 1000.0 / config.rate, sensor_index); // Spread the first samples
+}
+
+// Function to find readings in storage and record how long after their sample time they got there
+static void* collector_main(void* arg)
+{
+    (void)arg;
+    sqlite3* db = NULL;
+    if (sqlite3_open_v2(config.db_path, &db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK)
+    {
+        collect_error = "can't open the database";
+        sqlite3_close(db);
+        return NULL;
+    }
+    sqlite3_busy_timeout(db, 1000);
+
+    long first_day = partition_day((long)time(NULL)) - 1; // Timestamps come from the gateway or this clock
+    long last_id[3] = {0, 0, 0}; // Rows already seen per partition, by their INTEGER PRIMARY KEY
+    int done = 0;
+    while (!done)
+    {
+        done = !collecting; // One more pass after the sender stopped
+        for (int d = 0; d < 3; d++)
+        {
+            char name[PARTITION_NAME_SIZE];
+            char sql[160];
+            sqlite3_stmt* stmt = NULL;
+            partition_name(first_day + d, name, sizeof(name));
+            snprintf(sql, sizeof(sql), "SELECT id, sensor_id, temperature, humidity FROM %s WHERE id > ?1 "
+                     "AND sensor_id BETWEEN ?2 AND ?3;", name);
+            if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK)
+            {
+                continue; // The partition does not exist (yet)
+            }
+            sqlite3_bind_int64(stmt, 1, last_id[d]);
+            sqlite3_bind_int(stmt, 2, config.first_id);
+            sqlite3_bind_int(stmt, 3, config.first_id + config.sensors - 1);
+            while (sqlite3_step(stmt) == SQLITE_ROW)
+            {
+                double now = elapsed_ms();
+                long id = (long)sqlite3_column_int64(stmt, 0);
+                last_id[d] = id > last_id[d] ? id : last_id[d]; // Rows may come in index order
+                SimSensor* sensor = &sensors[sqlite3_column_int(stmt, 1) - config.first_id];
+                long seq = lround(sqlite3_column_double(stmt, 2) * 10) +
+                           1000 * lround(sqlite3_column_double(stmt, 3) * 10);
+                uint32_t sent = seq < sensor->seq_capacity ?
+                                __atomic_load_n(&sensor->sent_at[seq], __ATOMIC_ACQUIRE) : 0;
+                if (sent == 0 || sent == MATCHED)
+                {
+                    duplicate_rows++; // Stored twice, or not a reading of this run
+                    continue;
+                }
+                sensor->sent_at[seq] = MATCHED;
+                latencies[latency_count] = (float)(now - (sent - 1) / SEND_UNITS);
+                __atomic_store_n(&latency_count, latency_count + 1, __ATOMIC_RELAXED);
+            }
+            sqlite3_finalize(stmt);
+        }
+        struct timespec pause = {.tv_sec = 0, .tv_nsec = POLL_MS * 1000000L};
+        nanosleep(&pause, NULL);
+    }
+    sqlite3_close(db);
+    return NULL;
+}
+
+// Function to compare two latencies for qsort
+static int compare_float(const void* a, const void* b)
+{
+    float x = *(const float*)a;
+    float y = *(const float*)b;
+    return (x > y) - (x < y);
+}
+
+// Function to return a percentile of sorted latencies
+static double percentile(double p)
+{
+    long index = (long)ceil(p / 100.0 * latency_count) - 1;
+    return latencies[index < 0 ? 0 : index];
+}
+
+// Function to parse a payload mix such as text=70,binary=20,batch=10
+static int parse_mix(char* value, int* mix)
+{
+    memset(mix, 0, sizeof(int) * KIND_COUNT);
+    int total = 0;
+    for (char* item = strtok(value, ","); item; item = strtok(NULL, ","))
+    {
+        char* equals = strchr(item, '=');
+        int kind = 0;
+        while (equals && kind < KIND_COUNT &&
+               (strncmp(item, kind_names[kind], (size_t)(equals - item)) != 0 ||
+                strlen(kind_names[kind]) != (size_t)(equals - item)))
+        {
+            kind++;
+        }
+        if (!equals || kind == KIND_COUNT || (mix[kind] = atoi(equals + 1)) < 0)
+        {
+            return -1;
+        }
+        total += mix[kind];
+    }
+    return total > 0 ? 0 : -1;
+}
+
+// Function to pick a payload kind by the configured weights
+static PayloadKind pick_kind(void)
+{
+    int total = 0;
+    for (int k = 0; k < KIND_COUNT; k++)
+    {
+        total += config.mix[k];
+    }
+    int pick = (int)(uniform() * total);
+    for (int k = 0; k < KIND_COUNT; k++)
+    {
+        if (pick < config.mix[k])
+        {
+            return (PayloadKind)k;
+        }
+        pick -= config.mix[k];
+    }
+    return KIND_TEXT;
+}
+
+// Function to print the command line usage
+static void print_load_usage(const char* prog)
+{
+    printf("Usage: %s [options] <server_port>\n", prog);
+    printf("  -a addr   gateway address (default 127.0.0.1)\n");
+    printf("  -n count  simulated sensors (default %d)\n", DEFAULT_SENSORS);
+    printf("  -r rate   readings per second and sensor (default %.1f)\n", DEFAULT_RATE);
+    printf("  -j pct    jitter of the sample interval in percent (default %d)\n", DEFAULT_JITTER);
+    printf("  -d s      time spent sending (default %d)\n", DEFAULT_DURATION_S);
+    printf("  -u ms     connects are spread over this long, 0 opens all at once (default %d)\n", DEFAULT_RAMP_MS);
+    printf("  -x s      every s seconds drop and reconnect one sensor in %d at once (default off)\n",
+           STORM_FRACTION);
+    printf("  -w pct    frames written in two parts %d ms apart (default 0)\n", SLOW_WRITE_MS);
+    printf("  -m mix    payload weights, e.g. text=70,binary=20,crc=0,batch=10 (default text=100)\n");
+    printf("  -f id     first sensor id (default %d)\n", DEFAULT_FIRST_ID);
+    printf("  -D path   database the gateway stores into, matched for latency (default %s)\n", DEFAULT_DB);
+    printf("  -S s      time allowed for the last readings to reach storage (default %d)\n", DEFAULT_SETTLE_S);
+    printf("Run it next to a gateway started with the sqlite backend, in the gateway's directory\n");
+}
+
+// Function to fill the load configuration from the command line
+static int parse_args(int argc, char* argv[])
+{
+    config = (LoadConfig){.sensors = DEFAULT_SENSORS, .rate = DEFAULT_RATE, .jitter = DEFAULT_JITTER,
+                          .duration_s = DEFAULT_DURATION_S, .ramp_ms = DEFAULT_RAMP_MS,
+                          .first_id = DEFAULT_FIRST_ID, .settle_s = DEFAULT_SETTLE_S, .address = "127.0.0.1",
+                          .db_path = DEFAULT_DB};
+    config.mix[KIND_TEXT] = 100;
+    int opt;
+    while ((opt = getopt(argc, argv, "a:n:r:j:d:u:x:w:m:f:D:S:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'a':
+            config.address = optarg;
+            break;
+        case 'n':
+            config.sensors = atoi(optarg);
+            break;
+        case 'r':
+            config.rate = atof(optarg);
+            break;
+        case 'j':
+            config.jitter = atoi(optarg);
+            break;
+        case 'd':
+            config.duration_s = atoi(optarg);
+            break;
+        case 'u':
+            config.ramp_ms = atoi(optarg);
+            break;
+        case 'x':
+            config.storm_s = atoi(optarg);
+            break;
+        case 'w':
+            config.slow_percent = atoi(optarg);
+            break;
+        case 'm':
+            if (parse_mix(optarg, config.mix) == -1)
+            {
+                return -1;
+            }
+            break;
+        case 'f':
+            config.first_id = atoi(optarg);
+            break;
+        case 'D':
+            config.db_path = optarg;
+            break;
+        case 'S':
+            config.settle_s = atoi(optarg);
+            break;
+        default:
+            return -1;
+        }
+    }
+    if (argc - optind != 1 || config.sensors < 1 || config.rate <= 0 || config.jitter < 0 || config.jitter > 100 ||
+        config.duration_s < 1 || config.ramp_ms < 0 || config.storm_s < 0 || config.slow_percent < 0 ||
+        config.slow_percent > 100 || config.first_id < 0 || config.settle_s < 0)
+    {
+        return -1;
+    }
+    config.port = atoi(argv[optind]);
+    return config.port > 0 && config.port <= 65535 ? 0 : -1;
+}
+
+// Function to allow one descriptor per simulated sensor
+static void raise_fd_limit(void)
+{
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < (rlim_t)config.sensors + 64)
+    {
+        limit.rlim_cur = limit.rlim_max < (rlim_t)config.sensors + 64 ? limit.rlim_max : (rlim_t)config.sensors + 64;
+        setrlimit(RLIMIT_NOFILE, &limit);
+        if (limit.rlim_cur < (rlim_t)config.sensors + 64)
+        {
+            fprintf(stderr, "Only %ld descriptors allowed, some sensors will fail to connect\n",
+                    (long)limit.rlim_cur);
+        }
+    }
+}
+
+// Function to print what was sent and how fast it reached storage
+static void print_report(double send_ms)
+{
+    printf("%d sensors (", config.sensors);
+    const char* separator = "";
+    for (int k = 0; k < KIND_COUNT; k++)
+    {
+        if (config.mix[k] > 0)
+        {
+            printf("%s%s %d", separator, kind_names[k], config.mix[k]);
+            separator = ", ";
+        }
+    }
+    printf("), %.2f readings/s each +-%d%%, %d s, %d%% split writes\n", config.rate, config.jitter,
+           config.duration_s, config.slow_percent);
+    if (stats.all_connected_ms > 0)
+    {
+        printf("connected       all in %.0f ms\n", stats.all_connected_ms);
+    }
+    else
+    {
+        printf("connected       not all sensors connected\n");
+    }
+    printf("connects        %ld, %ld failed, %ld lost, %ld dropped by storms\n", stats.connects,
+           stats.connect_failures, stats.disconnects, stats.storm_drops);
+    printf("sent            %ld readings, %.0f readings/s, %.2f MB, %ld samples skipped on full sockets\n",
+           stats.readings, stats.readings / (send_ms / 1000.0), stats.bytes / 1048576.0, stats.backpressure_drops);
+    bench_report("pipeline.sent", stats.readings / (send_ms / 1000.0), "readings/s", BENCH_HIGHER_IS_BETTER);
+
+    if (collect_error)
+    {
+        printf("stored          unknown, %s %s\n", collect_error, config.db_path);
+        return;
+    }
+    printf("stored          %ld of %ld, %ld missing, %ld unexpected rows\n", latency_count, stats.readings,
+           stats.readings - latency_count, duplicate_rows);
+    bench_report("pipeline.stored", stats.readings ? 100.0 * latency_count / stats.readings : 0, "%",
+                 BENCH_HIGHER_IS_BETTER);
+    if (latency_count > 0)
+    {
+        qsort(latencies, (size_t)latency_count, sizeof(float), compare_float);
+        printf("latency ms      p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f (resolution %d ms)\n",
+               percentile(50), percentile(90), percentile(99), percentile(99.9), latencies[latency_count - 1],
+               POLL_MS);
+        bench_report("pipeline.latency_p50", percentile(50), "ms", BENCH_LOWER_IS_BETTER);
+        bench_report("pipeline.latency_p99", percentile(99), "ms", BENCH_LOWER_IS_BETTER);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if (parse_args(argc, argv) == -1)
+    {
+        print_load_usage(argv[0]);
+        exit(1);
+    }
+    raise_fd_limit();
+    srand(1);
+
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons(config.port)};
+    if (inet_pton(AF_INET, config.address, &addr.sin_addr) <= 0)
+    {
+        fprintf(stderr, "Invalid address %s\n", config.address);
+        exit(1);
+    }
+
+    // Room for every reading of the run with some margin for a fast jitter, the collector indexes it
+    double per_sensor = config.rate * config.duration_s * (1.0 + config.jitter / 100.0) + BATCH_READINGS + 2;
+    int seq_capacity = per_sensor < SEQ_LIMIT ? (int)per_sensor : SEQ_LIMIT;
+    sensors = calloc((size_t)config.sensors, sizeof(SimSensor));
+    held = calloc((size_t)config.sensors * HELD_PER_SENSOR, sizeof(HeldWrite));
+    latencies = malloc((size_t)config.sensors * seq_capacity * sizeof(float));
+    if (!sensors || !held || !latencies)
+    {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    for (int i = 0; i < config.sensors; i++)
+    {
+        sensors[i].id = config.first_id + i;
+        sensors[i].fd = -1;
+        sensors[i].kind = pick_kind();
+        sensors[i].seq_capacity = seq_capacity;
+        sensors[i].sent_at = calloc((size_t)seq_capacity, sizeof(uint32_t));
+        if (!sensors[i].sent_at)
+        {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+    }
+
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    TimerHeap heap = {NULL, 0, 0};
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    for (int i = 0; i < config.sensors; i++)
+    {
+        heap_push(&heap, (double)config.ramp_ms * i / config.sensors, i); // Idle sensors connect when due
+    }
+
+    pthread_t collector;
+    pthread_create(&collector, NULL, collector_main, NULL);
+
+    double stop_at = config.duration_s * 1000.0;
+    double next_storm = config.storm_s ? config.storm_s * 1000.0 : stop_at;
+    int storm_offset = 0;
+    int running = 0;
+    struct epoll_event events[MAX_EVENTS];
+    double now = 0;
+
+    while ((now = elapsed_ms()) < stop_at)
+    {
+        while (heap.count > 0 && heap.items[0].at <= now)
+        {
+            Timer timer = heap_pop(&heap);
+            SimSensor* sensor = &sensors[timer.sensor];
+            if (timer.generation != sensor->generation)
+            {
+                continue; // Set before the sensor reconnected
+            }
+            if (sensor->state == SENSOR_IDLE)
+            {
+                start_connect(epoll_fd, &heap, timer.sensor, &addr);
+            }
+            else if (sensor->state == SENSOR_RUNNING && generate_reading(epoll_fd, timer.sensor, now) == -1)
+            {
+                stats.disconnects++;
+                running--;
+                drop_connection(&heap, timer.sensor, RECONNECT_MS);
+            }
+            else if (sensor->state == SENSOR_RUNNING)
+            {
+                heap_push(&heap, timer.at + next_interval_ms(), timer.sensor);
+            }
+        }
+
+        // Split frames: the held back part goes out once the write is old enough
+        while (held_count > 0 && held[held_head].at <= now)
+        {
+            HeldWrite write = held[held_head];
+            SimSensor* sensor = &sensors[write.sensor];
+            held_head = (held_head + 1) % ((size_t)config.sensors * HELD_PER_SENSOR);
+            held_count--;
+            if (write.generation != sensor->generation || sensor->state != SENSOR_RUNNING)
+            {
+                continue;
+            }
+            sensor->out_limit = sensor->out_len;
+            if (flush_output(epoll_fd, write.sensor) == -1)
+            {
+                stats.disconnects++;
+                running--;
+                drop_connection(&heap, write.sensor, RECONNECT_MS);
+            }
+        }
+
+        if (now >= next_storm)
+        {
+            // Drop a slice of the sensors at the same instant, they all reconnect together
+            for (int i = storm_offset; i < config.sensors; i += STORM_FRACTION)
+            {
+                if (sensors[i].state == SENSOR_RUNNING)
+                {
+                    stats.storm_drops++;
+                    running--;
+                    drop_connection(&heap, i, 0);
+                }
+            }
+            storm_offset = (storm_offset + 1) % STORM_FRACTION;
+            next_storm += config.storm_s * 1000.0;
+        }
+
+        double wait = (heap.count > 0 && heap.items[0].at < stop_at ? heap.items[0].at : stop_at) - elapsed_ms();
+        if (held_count > 0 && held[held_head].at - now < wait)
+        {
+            wait = held[held_head].at - now;
+        }
+        int n = epoll_wait(epoll_fd, events, MAX_EVENTS, wait > 0 ? (int)ceil(wait) : 0);
+        for (int e = 0; e < n; e++)
+        {
+            int i = (int)events[e].data.u64;
+            SimSensor* sensor = &sensors[i];
+            if (sensor->state == SENSOR_CONNECTING && (events[e].events & (EPOLLOUT | EPOLLERR | EPOLLHUP)))
+            {
+                connect_done(epoll_fd, &heap, i, elapsed_ms());
+                if (sensor->state == SENSOR_RUNNING && ++running == config.sensors && stats.all_connected_ms == 0)
+                {
+                    stats.all_connected_ms = elapsed_ms();
+                }
+            }
+            else if (sensor->state == SENSOR_RUNNING && (events[e].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP |
+                                                                               EPOLLERR)))
+            {
+                stats.disconnects++; // The gateway never writes, readable means closed
+                running--;
+                drop_connection(&heap, i, RECONNECT_MS);
+            }
+            else if (sensor->state == SENSOR_RUNNING && (events[e].events & EPOLLOUT) &&
+                     flush_output(epoll_fd, i) == -1)
+            {
+                stats.disconnects++;
+                running--;
+                drop_connection(&heap, i, RECONNECT_MS);
+            }
+        }
+    }
+    double send_ms = elapsed_ms();
+
+    // Send what the sensors still hold, then give storage time to catch up before counting
+    for (int i = 0; i < config.sensors; i++)
+    {
+        SimSensor* sensor = &sensors[i];
+        if (sensor->state != SENSOR_RUNNING)
+        {
+            continue;
+        }
+        int pending = sensor->pending_count;
+        if (pending > 0 && queue_batch(i) == -1)
+        {
+            stats.backpressure_drops += pending;
+        }
+        sensor->out_limit = sensor->out_len;
+        int flags = fcntl(sensor->fd, F_GETFL, 0);
+        struct timeval timeout = {.tv_sec = 1, .tv_usec = 0};
+        fcntl(sensor->fd, F_SETFL, flags & ~O_NONBLOCK); // Block for the rest, sending is over, but not forever
+        setsockopt(sensor->fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        if (flush_output(epoll_fd, i) == -1)
+        {
+            stats.disconnects++;
+        }
+    }
+    double settle_until = elapsed_ms() + config.settle_s * 1000.0;
+    while (elapsed_ms() < settle_until && !collect_error &&
+           __atomic_load_n(&latency_count, __ATOMIC_RELAXED) < stats.readings)
+    {
+        struct timespec pause = {.tv_sec = 0, .tv_nsec = 100 * 1000000L};
+        nanosleep(&pause, NULL);
+    }
+    collecting = 0;
+    pthread_join(collector, NULL);
+
+    for (int i = 0; i < config.sensors; i++)
+    {
+        if (sensors[i].fd != -1)
+        {
+            close(sensors[i].fd);
+        }
+        free(sensors[i].sent_at);
+    }
+    close(epoll_fd);
+    print_report(send_ms);
+    free(heap.items);
+    free(held);
+    free(sensors);
+    free(latencies);
+    return 0;
+}
@@ -0,0 +1,202 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include "log.h"
+#include "log_writer.h"
+#include "bench_report.h"
+
+#define BENCH_ENTRIES 1000000 // Log entries written by each path
+#define RING_THREADS 4 // Threads emitting events at once, like event loops and workers
+#define RING_SECONDS 2.0 // Time they keep the ring full, the log process writes flat out meanwhile
+
+// Function to return a monotonic timestamp in seconds
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Previous path: localtime, strftime, fprintf and fflush for every entry
+static double bench_stdio(const char* path)
+{
+    FILE* log_file = fopen(path, "a");
+    if (!log_file)
+    {
+        perror("fopen");
+        exit(1);
+    }
+
+    char timestamp[32];
+    double start = now_seconds();
+    for (int i = 0; i < BENCH_ENTRIES; i++)
+    {
+        time_t now = time(NULL);
+        struct tm *tm_info = localtime(&now);
+        strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", tm_info);
+        fprintf(log_file, "%d %s Sensor node %d reports temperature: %.1f, humidity: %.1f\n",
+                i + 1, timestamp, i % 1000, 20.0 + (i % 100) / 10.0, 50.0 + (i % 300) / 10.0);
+        fflush(log_file);
+    }
+    double elapsed = now_seconds() - start;
+    fclose(log_file);
+    return elapsed;
+}
+
+// Current path: buffered writer with cached timestamps and size rotation
+static double bench_writer(const char* path, const GatewayConfig* config)
+{
+    static LogWriter writer;
+    if (log_writer_open(&writer, path, config) == -1)
+    {
+        exit(1);
+    }
+
+    double start = now_seconds();
+    for (int i = 0; i < BENCH_ENTRIES; i++)
+    {
+        char* out = log_writer_reserve(&writer);
+        int n = snprintf(out, LOG_ENTRY_MAX, "%d %s Sensor node %d reports temperature: %.1f, humidity: %.1f\n",
+                         i + 1, log_writer_timestamp(&writer, time(NULL)), i % 1000,
+                         20.0 + (i % 100) / 10.0, 50.0 + (i % 300) / 10.0);
+        log_writer_commit(&writer, (size_t)n);
+        if ((i & 1023) == 0)
+        {
+            log_writer_poll(&writer, 0); // The log process checks its thresholds once per drained run
+        }
+    }
+    log_writer_close(&writer);
+    double elapsed = now_seconds() - start;
+    printf("%-14s %lu rotations\n", "", writer.rotations);
+    return elapsed;
+}
+
+// Function run by each emitting thread, returns its time per event in nanoseconds through arg
+static void* emit_events(void* arg)
+{
+    double start = now_seconds();
+    long emitted = 0;
+    while (now_seconds() - start < RING_SECONDS)
+    {
+        for (int i = 0; i < 1000; i++, emitted++)
+        {
+            log_event(LOG_READING, i, 20.0 + (i % 100) / 10.0, 50.0 + (i % 300) / 10.0);
+        }
+    }
+    *(double*)arg = (now_seconds() - start) * 1e9 / emitted;
+    return NULL;
+}
+
+// Function to count the readings the log process wrote to gateway.log
+static long count_lines(const char* path)
+{
+    FILE* file = fopen(path, "r");
+    char line[LOG_ENTRY_MAX];
+    long lines = 0;
+    while (file && fgets(line, sizeof(line), file))
+    {
+        lines += strstr(line, "reports temperature") != NULL;
+    }
+    if (file)
+    {
+        fclose(file);
+    }
+    return lines;
+}
+
+// Whole path: log_event() into the shared ring from several threads, formatted and written by the forked
+// log process; returns the lines it wrote per second and the emit cost per event
+static double bench_ring(const char* dir, const GatewayConfig* config, double* emit_ns)
+{
+    if (chdir(dir) == -1 || log_init() == -1)
+    {
+        perror("log ring");
+        exit(1);
+    }
+    fflush(stdout); // Or the child prints it again
+    double start = now_seconds();
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        log_process(config);
+        exit(0);
+    }
+
+    pthread_t threads[RING_THREADS];
+    double thread_ns[RING_THREADS];
+    for (int t = 0; t < RING_THREADS; t++)
+    {
+        pthread_create(&threads[t], NULL, emit_events, &thread_ns[t]);
+    }
+    *emit_ns = 0;
+    for (int t = 0; t < RING_THREADS; t++)
+    {
+        pthread_join(threads[t], NULL);
+        *emit_ns += thread_ns[t] / RING_THREADS;
+    }
+    log_shutdown(pid, 60000); // Returns once the log process wrote what is queued and exited
+    double elapsed = now_seconds() - start;
+
+    long lines = count_lines("gateway.log");
+    printf("%-14s %ld lines written by the log process in %.1f s, the rest dropped by the full ring\n", "", lines,
+           elapsed);
+    return lines / elapsed;
+}
+
+// Function to delete the files the benchmark created
+static void remove_dir(const char* dir)
+{
+    DIR* d = opendir(dir);
+    struct dirent* entry;
+    char path[512];
+    while (d && (entry = readdir(d)) != NULL)
+    {
+        if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0)
+        {
+            snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+            unlink(path);
+        }
+    }
+    if (d)
+    {
+        closedir(d);
+    }
+    rmdir(dir);
+}
+
+int main(void)
+{
+    char dir[] = "/tmp/log_bench.XXXXXX";
+    if (!mkdtemp(dir))
+    {
+        perror("mkdtemp");
+        return 1;
+    }
+    char stdio_path[64], writer_path[64];
+    snprintf(stdio_path, sizeof(stdio_path), "%s/stdio.log", dir);
+    snprintf(writer_path, sizeof(writer_path), "%s/gateway.log", dir);
+
+    GatewayConfig config = {.log_max_mb = 16, .log_rotate_s = 0, .log_flush_ms = DEFAULT_LOG_FLUSH_MS};
+    double stdio_time = bench_stdio(stdio_path);
+    double writer_time = bench_writer(writer_path, &config);
+
+    printf("%-14s %12.0f lines/s\n", "fprintf+fflush", BENCH_ENTRIES / stdio_time);
+    printf("%-14s %12.0f lines/s\n", "log writer", BENCH_ENTRIES / writer_time);
+    printf("speedup        %12.2fx\n", stdio_time / writer_time);
+
+    config.log_max_mb = 1024; // One file, so every written line is counted
+    double emit_ns = 0;
+    double ring_rate = bench_ring(dir, &config, &emit_ns);
+    printf("%-14s %12.0f lines/s %6.1f ns per log_event\n", "ring + process", ring_rate, emit_ns);
+
+    bench_report("log.writer", BENCH_ENTRIES / writer_time, "lines/s", BENCH_HIGHER_IS_BETTER);
+    bench_report("log.path", ring_rate, "lines/s", BENCH_HIGHER_IS_BETTER);
+    bench_report("log.emit", emit_ns, "ns", BENCH_LOWER_IS_BETTER);
+
+    remove_dir(dir);
+    return 0;
+}
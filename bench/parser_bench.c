@@ -0,0 +1,157 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "sensor_parser.h"
+#include "bench_report.h"
+
+#define BENCH_MESSAGES 2000000 // Frames parsed by each path
+#define CHUNK_SIZE 4096 // Bytes per simulated read, as in handle_sensor_messages
+#define LEGACY_BUFF_SIZE 1024 // Buffer the sscanf path cleared for every message
+
+// Function to return a monotonic timestamp in seconds
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Function to fill a stream with newline terminated frames, returns its length
+static size_t build_stream(char* stream, size_t capacity, int count)
+{
+    size_t length = 0;
+    for (int i = 0; i < count; i++)
+    {
+        int n = snprintf(stream + length, capacity - length, "SENSOR:%d,TEMP:%.2f,HUM:%.2f\n",
+                         i % 1000, 15.0 + (i % 2000) / 100.0, 30.0 + (i % 7000) / 100.0);
+        length += (size_t)n;
+    }
+    return length;
+}
+
+// Function to fill a stream with the same readings as CRC protected batch frames of one sensor each
+static size_t build_batch_stream(char* stream, int count)
+{
+    SensorReading batch[BINARY_BATCH_MAX];
+    size_t length = 0;
+    for (int i = 0; i < count; i += BINARY_BATCH_MAX)
+    {
+        int n = count - i < BINARY_BATCH_MAX ? count - i : BINARY_BATCH_MAX;
+        for (int j = 0; j < n; j++)
+        {
+            batch[j] = (SensorReading){.sensor_id = 1, .temperature = 15.0 + ((i + j) % 2000) / 100.0,
+                                       .humidity = 30.0 + ((i + j) % 7000) / 100.0, .timestamp = i + j};
+        }
+        length += encode_binary_batch((unsigned char*)stream + length, batch, n, 1);
+    }
+    return length;
+}
+
+// Function to fill a stream with the same readings as CRC protected binary frames
+static size_t build_binary_stream(char* stream, int count)
+{
+    size_t length = 0;
+    for (int i = 0; i < count; i++)
+    {
+        SensorReading reading = {.sensor_id = i % 1000, .temperature = 15.0 + (i % 2000) / 100.0,
+                                 .humidity = 30.0 + (i % 7000) / 100.0, .timestamp = i};
+        length += encode_binary_frame((unsigned char*)stream + length, &reading, 1);
+    }
+    return length;
+}
+
+// Previous path: one read per message, memset and sscanf
+static double bench_sscanf(const char* stream, size_t length, double* checksum)
+{
+    char buffer[LEGACY_BUFF_SIZE];
+    SensorReading reading;
+    const char* p = stream;
+    const char* end = stream + length;
+
+    double start = now_seconds();
+    while (p < end)
+    {
+        const char* nl = memchr(p, '\n', (size_t)(end - p));
+        memset(buffer, 0, sizeof(buffer));
+        memcpy(buffer, p, (size_t)(nl - p));
+        if (sscanf(buffer, "SENSOR:%d,TEMP:%lf,HUM:%lf", &reading.sensor_id, &reading.temperature, &reading.humidity) == 3)
+        {
+            *checksum += reading.temperature + reading.humidity;
+        }
+        p = nl + 1;
+    }
+    return now_seconds() - start;
+}
+
+// Current path: the stream arrives in fixed chunks that split frames anywhere
+static double bench_frame_parser(const char* stream, size_t length, int binary_version, double* checksum)
+{
+    FrameParser parser;
+    SensorReading readings[BINARY_BATCH_MAX];
+    frame_parser_reset(&parser, binary_version);
+
+    double start = now_seconds();
+    for (size_t offset = 0; offset < length; offset += CHUNK_SIZE)
+    {
+        const char* data = stream + offset;
+        size_t remaining = length - offset < CHUNK_SIZE ? length - offset : CHUNK_SIZE;
+        while (remaining > 0)
+        {
+            int count = frame_parser_next(&parser, &data, &remaining, readings);
+            for (int i = 0; i < count; i++)
+            {
+                *checksum += readings[i].temperature + readings[i].humidity;
+            }
+        }
+    }
+    return now_seconds() - start;
+}
+
+int main(void)
+{
+    size_t capacity = (size_t)BENCH_MESSAGES * TEXT_FRAME_MAX;
+    char* stream = malloc(capacity);
+    if (!stream)
+    {
+        perror("malloc");
+        return 1;
+    }
+    size_t length = build_stream(stream, capacity, BENCH_MESSAGES);
+
+    double sscanf_sum = 0, parser_sum = 0, binary_sum = 0;
+    double sscanf_time = bench_sscanf(stream, length, &sscanf_sum);
+    double parser_time = bench_frame_parser(stream, length, 0, &parser_sum);
+
+    size_t text_length = length;
+    length = build_binary_stream(stream, BENCH_MESSAGES);
+    double binary_time = bench_frame_parser(stream, length, BINARY_VERSION, &binary_sum);
+
+    size_t binary_length = length;
+    double batch_sum = 0;
+    length = build_batch_stream(stream, BENCH_MESSAGES);
+    double batch_time = bench_frame_parser(stream, length, BINARY_VERSION, &batch_sum);
+
+    printf("%-14s %12.0f msg/s %6.1f bytes/msg\n", "sscanf", BENCH_MESSAGES / sscanf_time,
+           (double)text_length / BENCH_MESSAGES);
+    printf("%-14s %12.0f msg/s %6.1f bytes/msg\n", "frame parser", BENCH_MESSAGES / parser_time,
+           (double)text_length / BENCH_MESSAGES);
+    printf("%-14s %12.0f msg/s %6.1f bytes/msg\n", "binary + crc", BENCH_MESSAGES / binary_time,
+           (double)binary_length / BENCH_MESSAGES);
+    printf("%-14s %12.0f msg/s %6.1f bytes/msg\n", "batch + crc", BENCH_MESSAGES / batch_time,
+           (double)length / BENCH_MESSAGES);
+    printf("speedup        %12.2fx text, %.2fx binary, %.2fx batch\n", sscanf_time / parser_time,
+           sscanf_time / binary_time, sscanf_time / batch_time);
+    bench_report("parser.text", BENCH_MESSAGES / parser_time, "msg/s", BENCH_HIGHER_IS_BETTER);
+    bench_report("parser.binary_crc", BENCH_MESSAGES / binary_time, "msg/s", BENCH_HIGHER_IS_BETTER);
+    bench_report("parser.batch_crc", BENCH_MESSAGES / batch_time, "msg/s", BENCH_HIGHER_IS_BETTER);
+    if (sscanf_sum != parser_sum)
+    {
+        fprintf(stderr, "Checksum mismatch: %f != %f\n", sscanf_sum, parser_sum);
+        free(stream);
+        return 1;
+    }
+
+    free(stream);
+    return 0;
+}
@@ -0,0 +1,21 @@
+#!/bin/sh
+# Full pipeline: a gateway in a scratch directory driven by load_gen, which reports the send rate and the
+# time from sampling a reading to finding it committed in sensor_data.db
+set -e
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+PORT=${PIPELINE_PORT:-18000}
+ARGS=${PIPELINE_ARGS:--n 1000 -r 10 -d 10 -u 1000}
+DIR=$(mktemp -d /tmp/pipeline_bench.XXXXXX)
+export LD_LIBRARY_PATH="$ROOT/lib${LD_LIBRARY_PATH:+:$LD_LIBRARY_PATH}"
+
+cd "$DIR"
+"$ROOT/bin/server" -l 2 "$PORT" >server.out 2>&1 &
+SERVER=$!
+trap 'kill -9 $SERVER 2>/dev/null || true; cd /; rm -rf "$DIR"' EXIT
+sleep 1
+kill -0 $SERVER # Fails the suite if the gateway did not start, e.g. the port is taken
+
+# shellcheck disable=SC2086 # ARGS holds several options
+"$ROOT/bin/load_gen" $ARGS "$PORT"
+kill -INT $SERVER
+wait $SERVER
@@ -0,0 +1,187 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "query_server.h"
+
+#define BENCH_CLIENTS 4 // Concurrent query clients
+#define BENCH_SECONDS 5.0
+#define BENCH_SAMPLES 1000000 // Latencies kept per client and request kind at most
+#define BENCH_KINDS 3
+
+static const char* kind_names[BENCH_KINDS] = {"LATEST", "RANGE 60s", "ROLLUP 1h"};
+
+typedef struct
+{
+    pthread_t thread;
+    int sensor_id;
+    double* latencies[BENCH_KINDS]; // Microseconds
+    long counts[BENCH_KINDS];
+    long errors;
+} BenchClient;
+
+// Function to return a monotonic timestamp in seconds
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Function to connect to the gateway query socket
+static int connect_query_socket(void)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, QUERY_SOCKET_PATH);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1)
+    {
+        perror("connect " QUERY_SOCKET_PATH);
+        exit(1);
+    }
+    return fd;
+}
+
+// Function to send one request and read its reply up to END or ERR, returns 0 on END
+static int round_trip(int fd, const char* request)
+{
+    static __thread char buffer[65536];
+    if (send(fd, request, strlen(request), 0) <= 0)
+    {
+        return -1;
+    }
+    size_t used = 0;
+    while (1)
+    {
+        ssize_t n = recv(fd, buffer + used, sizeof(buffer) - used - 1, 0);
+        if (n <= 0)
+        {
+            return -1;
+        }
+        used += (size_t)n;
+        buffer[used] = '\0';
+        if (used >= 4 && strcmp(buffer + used - 4, "END\n") == 0)
+        {
+            return 0;
+        }
+        if (strncmp(buffer, "ERR", 3) == 0 && buffer[used - 1] == '\n')
+        {
+            return -1; // Errors are a single line
+        }
+        if (used > sizeof(buffer) / 2)
+        {
+            // Only the tail matters, keep the last bytes so END is still found
+            memmove(buffer, buffer + used - 8, 8);
+            used = 8;
+        }
+    }
+}
+
+// Function run by each client: cycle through the request kinds until the time is up
+static void* client_main(void* arg)
+{
+    BenchClient* client = (BenchClient*)arg;
+    int fd = connect_query_socket();
+    double end = now_seconds() + BENCH_SECONDS;
+
+    for (long i = 0; now_seconds() < end; i++)
+    {
+        int kind = (int)(i % BENCH_KINDS);
+        long now = (long)time(NULL);
+        char request[128];
+        if (kind == 0)
+        {
+            snprintf(request, sizeof(request), "LATEST\n");
+        }
+        else if (kind == 1)
+        {
+            snprintf(request, sizeof(request), "RANGE %d %ld %ld\n", client->sensor_id, now - 60, now);
+        }
+        else
+        {
+            snprintf(request, sizeof(request), "ROLLUP %d 60 %ld %ld\n", client->sensor_id, now - 3600, now);
+        }
+
+        double start = now_seconds();
+        if (round_trip(fd, request) == -1)
+        {
+            client->errors++;
+            continue;
+        }
+        if (client->counts[kind] < BENCH_SAMPLES)
+        {
+            client->latencies[kind][client->counts[kind]++] = (now_seconds() - start) * 1e6;
+        }
+    }
+    close(fd);
+    return NULL;
+}
+
+// Function to compare latencies for qsort
+static int compare_double(const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char* argv[])
+{
+    int clients = argc > 1 ? atoi(argv[1]) : BENCH_CLIENTS;
+    int sensor_id = argc > 2 ? atoi(argv[2]) : 1;
+    if (clients < 1)
+    {
+        printf("Usage: %s [clients] [sensor_id]  (run next to a gateway serving %s)\n", argv[0], QUERY_SOCKET_PATH);
+        return 1;
+    }
+
+    BenchClient* pool = calloc(clients, sizeof(BenchClient));
+    for (int c = 0; c < clients; c++)
+    {
+        pool[c].sensor_id = sensor_id;
+        for (int k = 0; k < BENCH_KINDS; k++)
+        {
+            pool[c].latencies[k] = malloc(BENCH_SAMPLES * sizeof(double));
+        }
+        pthread_create(&pool[c].thread, NULL, client_main, &pool[c]);
+    }
+
+    long errors = 0;
+    for (int c = 0; c < clients; c++)
+    {
+        pthread_join(pool[c].thread, NULL);
+        errors += pool[c].errors;
+    }
+
+    printf("%d clients, %.0f s, sensor %d, %ld errors\n", clients, BENCH_SECONDS, sensor_id, errors);
+    printf("%-10s %10s %10s %10s %10s %10s\n", "request", "req/s", "p50 us", "p99 us", "p99.9 us", "max us");
+    for (int k = 0; k < BENCH_KINDS; k++)
+    {
+        long total = 0;
+        for (int c = 0; c < clients; c++)
+        {
+            total += pool[c].counts[k];
+        }
+        double* all = malloc((total ? total : 1) * sizeof(double));
+        long n = 0;
+        for (int c = 0; c < clients; c++)
+        {
+            memcpy(all + n, pool[c].latencies[k], pool[c].counts[k] * sizeof(double));
+            n += pool[c].counts[k];
+        }
+        qsort(all, n, sizeof(double), compare_double);
+        if (n > 0)
+        {
+            printf("%-10s %10.0f %10.1f %10.1f %10.1f %10.1f\n", kind_names[k], n / BENCH_SECONDS,
+                   all[n / 2], all[n * 99 / 100], all[n * 999 / 1000], all[n - 1]);
+        }
+        free(all);
+    }
+    return 0;
+}
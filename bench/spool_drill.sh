@@ -0,0 +1,55 @@
+#!/bin/sh
+# Spool drill: readings are sent while another connection holds sensor_data.db locked, so the gateway spools
+# them; the gateway is then killed with SIGKILL and restarted while the lock is still held, so it must start
+# without its storage. Once the lock is released every uniquely valued reading load_gen sent must show up in
+# the database. Exits non-zero if any is missing
+set -e
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+PORT=${DRILL_PORT:-18001}
+SEND_S=${DRILL_SEND_S:-5}
+ARGS=${DRILL_ARGS:--n 200 -r 10 -u 500}
+DIR=$(mktemp -d /tmp/spool_drill.XXXXXX)
+export LD_LIBRARY_PATH="$ROOT/lib${LD_LIBRARY_PATH:+:$LD_LIBRARY_PATH}"
+command -v sqlite3 >/dev/null || { echo "spool drill needs the sqlite3 shell"; exit 1; }
+
+cd "$DIR"
+SERVER= LOCK= LOAD=
+trap 'kill -9 $SERVER $LOCK $LOAD 2>/dev/null || true; cd /; rm -rf "$DIR"' EXIT
+"$ROOT/bin/server" "$PORT" >server1.out 2>&1 &
+SERVER=$!
+sleep 1
+kill -0 $SERVER # The gateway did not start, e.g. the port is taken
+
+# Hold the write lock until lock.release appears, the gateway times out on it and spools instead
+{ echo "BEGIN EXCLUSIVE;"; while [ ! -e lock.release ]; do sleep 0.2; done; echo "COMMIT;"; } |
+    sqlite3 sensor_data.db &
+LOCK=$!
+sleep 1
+
+# load_gen keeps checking the database after sending, for as long as -S allows
+# shellcheck disable=SC2086 # ARGS holds several options
+"$ROOT/bin/load_gen" $ARGS -d "$SEND_S" -S 60 "$PORT" >load_gen.out 2>&1 &
+LOAD=$!
+
+# Kill the gateway once sending is over and the first write attempt has given up on the lock
+sleep $((SEND_S + 7))
+kill -9 $SERVER
+wait $SERVER 2>/dev/null || true
+ls spool/*.seg >/dev/null 2>&1 || { echo "spool drill FAILED: nothing was spooled"; exit 1; }
+
+"$ROOT/bin/server" "$PORT" >server2.out 2>&1 &
+SERVER=$!
+# Keep the lock past the 5 s busy timeout of the first open, the gateway must serve and reopen later
+sleep 8
+kill -0 $SERVER || { cat server2.out; echo "spool drill FAILED: the gateway did not start without storage"; exit 1; }
+touch lock.release
+wait $LOCK
+
+wait $LOAD || true
+LOAD=
+cat load_gen.out
+grep -q "^stored .*, 0 missing, 0 unexpected rows" load_gen.out || { echo "spool drill FAILED: readings lost"; exit 1; }
+kill -INT $SERVER
+wait $SERVER
+SERVER=
+echo "spool drill passed"
@@ -0,0 +1,157 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "storage_backend.h"
+
+#define BENCH_DIR_TEMPLATE "/tmp/storage_bench.XXXXXX"
+#define BENCH_SENSORS 100 // Sensors reporting once a second each
+#define BENCH_READINGS 2000000
+#define BENCH_BATCH 256 // Readings per append, as the storage writer does
+#define BENCH_QUERIES 200 // One-hour RANGE queries timed per backend
+
+static const char* backend_names[] = {"sqlite", "column"};
+
+// Function to return a monotonic timestamp in seconds
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Function to add up the size of the files in a directory and its subdirectories
+static long long disk_bytes(const char* path)
+{
+    long long total = 0;
+    DIR* dir = opendir(path);
+    struct dirent* entry;
+    while (dir && (entry = readdir(dir)) != NULL)
+    {
+        char child[512];
+        struct stat st;
+        if (entry->d_name[0] == '.')
+        {
+            continue;
+        }
+        snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+        if (stat(child, &st) == 0)
+        {
+            total += S_ISDIR(st.st_mode) ? disk_bytes(child) : st.st_size;
+        }
+    }
+    if (dir)
+    {
+        closedir(dir);
+    }
+    return total;
+}
+
+// Function to count the rows a query returns
+static int count_row(void* ctx, const SensorReading* reading)
+{
+    (void)reading;
+    (*(long*)ctx)++;
+    return 0;
+}
+
+// Function to append simulated readings through one backend and report rate and footprint
+static void bench_backend(const char* name, int sync_level)
+{
+    char dir[] = BENCH_DIR_TEMPLATE;
+    if (!mkdtemp(dir) || chdir(dir) == -1)
+    {
+        perror("mkdtemp");
+        exit(1);
+    }
+
+    GatewayConfig config = {.sync_level = sync_level, .backend = name};
+    StorageBackend backend;
+    if (storage_backend_init(&backend, &config) == -1 || storage_open(&backend) == -1)
+    {
+        fprintf(stderr, "Failed to open the %s backend\n", name);
+        exit(1);
+    }
+
+    SensorReading* batch = malloc(BENCH_BATCH * sizeof(SensorReading));
+    double* temperature = malloc(BENCH_SENSORS * sizeof(double));
+    for (int s = 0; s < BENCH_SENSORS; s++)
+    {
+        temperature[s] = 20.0 + s % 10;
+    }
+    long start_ts = (long)time(NULL) - BENCH_READINGS / BENCH_SENSORS; // Ends about now, usually two days
+    srand(1);
+
+    double start = now_seconds();
+    for (long i = 0; i < BENCH_READINGS; i += BENCH_BATCH)
+    {
+        int n = BENCH_READINGS - i < BENCH_BATCH ? (int)(BENCH_READINGS - i) : BENCH_BATCH;
+        for (int r = 0; r < n; r++)
+        {
+            long k = i + r;
+            int s = (int)(k % BENCH_SENSORS);
+            temperature[s] += (rand() % 21 - 10) / 100.0; // Random walk with two decimals, like a real probe
+            batch[r] = (SensorReading){.sensor_id = s + 1, .temperature = round(temperature[s] * 100) / 100,
+                                       .humidity = 40.0 + (k / BENCH_SENSORS / 600) % 20,
+                                       .timestamp = start_ts + k / BENCH_SENSORS};
+        }
+        StorageBatch stored = {.readings = batch, .count = n};
+        if (storage_append(&backend, &stored) == -1)
+        {
+            fprintf(stderr, "Append failed\n");
+            exit(1);
+        }
+    }
+    storage_flush(&backend);
+    double elapsed = now_seconds() - start;
+
+    void* reader = backend.ops->open_reader(&backend);
+    long rows = 0;
+    double query_start = now_seconds();
+    for (int q = 0; q < BENCH_QUERIES && reader; q++)
+    {
+        long from = start_ts + rand() % (BENCH_READINGS / BENCH_SENSORS - 3600);
+        backend.ops->query_range(reader, 1 + q % BENCH_SENSORS, from, from + 3599, 10000, count_row, &rows);
+    }
+    double query_elapsed = now_seconds() - query_start;
+    if (reader)
+    {
+        backend.ops->close_reader(reader);
+    }
+    storage_close(&backend);
+    storage_backend_destroy(&backend);
+
+    long long bytes = disk_bytes(".");
+    printf("%-8s %-6s %12.0f %12.1f %14.2f %12.0f %10ld\n", name, sync_level_name(sync_level),
+           BENCH_READINGS / elapsed, bytes / 1048576.0, (double)bytes / BENCH_READINGS,
+           query_elapsed / BENCH_QUERIES * 1e6, rows / BENCH_QUERIES);
+
+    char command[128];
+    snprintf(command, sizeof(command), "rm -rf %s", dir);
+    if (chdir("/") == -1 || system(command) != 0)
+    {
+        fprintf(stderr, "Failed to remove %s\n", dir);
+    }
+    free(batch);
+    free(temperature);
+}
+
+int main(void)
+{
+    printf("%d readings from %d sensors at 1 Hz, appended in batches of %d\n", BENCH_READINGS, BENCH_SENSORS,
+           BENCH_BATCH);
+    printf("%-8s %-6s %12s %12s %14s %12s %10s\n", "backend", "sync", "readings/s", "disk MB", "bytes/reading",
+           "1h RANGE us", "rows");
+    for (int sync_level = 1; sync_level <= 2; sync_level++)
+    {
+        for (size_t b = 0; b < sizeof(backend_names) / sizeof(backend_names[0]); b++)
+        {
+            bench_backend(backend_names[b], sync_level);
+        }
+    }
+    return 0;
+}
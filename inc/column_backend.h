@@ -0,0 +1,47 @@
+#ifndef COLUMN_BACKEND_H
+#define COLUMN_BACKEND_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define COLUMN_DIR "columns"
+#define COLUMN_BLOCK_READINGS 4096 // A sensor's open block is sealed once it holds this many readings
+#define COLUMN_SEAL_READINGS 65536 // All open blocks are sealed once this many readings are buffered
+#define COLUMN_ENCODED_MAX(n) ((size_t)(n) * 32 + 32) // Worst case bytes of n encoded readings
+
+// Day files (columns/YYYYMMDD.col) are a sequence of blocks, each a header followed by its encoded
+// columns: delta-of-delta timestamps, then XOR-compressed temperatures, then humidities
+typedef struct
+{
+    uint32_t magic;
+    uint32_t check; // FNV-1a of the header (with check 0) and the payload
+    uint64_t generation; // Tail generation the block was sealed from, used by crash recovery
+    int32_t sensor_id;
+    uint32_t count;
+    uint32_t payload_size;
+    uint32_t reserved;
+    int64_t ts_min; // Per-block bounds, queries skip blocks without decoding them
+    int64_t ts_max;
+    double temperature_min;
+    double temperature_max;
+    double humidity_min;
+    double humidity_max;
+} ColumnBlockHeader;
+
+// Readings of open blocks are also appended raw to columns/tail.log until their block is sealed
+typedef struct
+{
+    int32_t sensor_id;
+    uint32_t check; // Checksum of the other fields, a torn record at the end fails it
+    double temperature;
+    double humidity;
+    int64_t timestamp;
+    uint64_t generation; // Records of an older generation were sealed already
+} ColumnTailRecord;
+
+size_t column_encode(const int64_t* ts, const double* temperature, const double* humidity, uint32_t count,
+                     uint8_t* out);
+int column_decode(const uint8_t* data, size_t size, uint32_t count, int64_t* ts, double* temperature,
+                  double* humidity);
+
+#endif // COLUMN_BACKEND_H
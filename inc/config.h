@@ -0,0 +1,63 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#define DEFAULT_EVENT_LOOPS 1
+#define DEFAULT_WORKERS 2
+#define DEFAULT_BATCH_SIZE 256
+#define DEFAULT_FLUSH_MS 200
+#define DEFAULT_SYNC_LEVEL 1 // NORMAL, safe with WAL
+#define DEFAULT_QUEUE_SIZE 16384
+#define DEFAULT_LOG_MAX_MB 64
+#define DEFAULT_LOG_FLUSH_MS 200
+#define DEFAULT_QUERY_THREADS 2
+#define DEFAULT_SPOOL_MAX_MB 256
+#define DEFAULT_BACKEND "sqlite"
+#define DEFAULT_SHUTDOWN_S 10
+#define DEFAULT_METRICS_S 60
+#define DEFAULT_ACCEPTORS 1
+#define DEFAULT_BACKLOG 1024 // Capped by net.core.somaxconn
+#define DEFAULT_HANDSHAKE_MS 5000
+#define MAX_ACCEPTORS 64
+#define DEFAULT_MAX_SENSORS 65536 // About 80 MB of registry slots at most
+#define DEFAULT_CLOCK_SKEW_S 86400 // A node timestamp further than a day from gateway time is not trusted
+
+#define OVERLOAD_DROP 0 // Readings over the rate limits are discarded
+#define OVERLOAD_SAMPLE 1 // One in RATE_SAMPLE_EVERY of them is kept
+#define OVERLOAD_COALESCE 2 // Only the latest is kept, and stored once a token is free
+
+typedef struct
+{
+    int port;
+    int event_loops;
+    int workers;
+    int batch_size; // Readings committed per transaction at most
+    int flush_ms; // Longest time a reading waits before its batch is committed
+    int sync_level; // SQLite synchronous level: 0 OFF, 1 NORMAL, 2 FULL, 3 EXTRA
+    int queue_size; // Capacity of the ingest ring, rounded up to a power of two
+    int log_max_mb; // gateway.log is rotated at this size
+    int log_rotate_s; // gateway.log is rotated at this age, 0 disables
+    int log_flush_ms; // Longest time a log entry stays buffered
+    int log_compress; // gzip rotated log files in the background
+    int retention_days; // Daily partitions older than this are dropped, 0 keeps everything
+    int query_threads; // Query API threads, each with its own read-only connection
+    int spool_max_mb; // Disk used at most by readings waiting for the database
+    const char* backend; // Storage backend name: sqlite or column
+    int shutdown_s; // Longest time spent draining readings after SIGINT/SIGTERM
+    int takeover; // Start by adopting the listening and sensor sockets of the running gateway
+    int metrics_s; // Interval of the metrics summary written to gateway.log
+    int sensor_rate; // Readings per second accepted from one sensor, 0 for no limit
+    int global_rate; // Readings per second accepted from all sensors together, 0 for no limit
+    int overload_policy; // OVERLOAD_*, applied to readings over either limit
+    int acceptors; // Accepting threads, each with its own SO_REUSEPORT listening socket
+    int backlog; // Connections each listening socket queues before the kernel refuses more
+    int handshake_ms; // Longest wait for a new node's ID frame before it is closed
+    int max_sensors; // Distinct sensor IDs registered at most, slots are kept for the life of the process
+    int clock_skew_s; // Node timestamps further than this from gateway time are replaced by the arrival time
+} GatewayConfig;
+
+int parse_config(int argc, char *argv[], GatewayConfig* config);
+void print_usage(const char* prog);
+const char* sync_level_name(int level);
+const char* overload_policy_name(int policy);
+
+#endif // CONFIG_H
\ No newline at end of file
@@ -1,8 +1,11 @@
 #ifndef CONNECTION_MANAGER_H
 #define CONNECTION_MANAGER_H
 
+#include <time.h>
 #include "shared_data.h"
 
-void* connection_manager(void* arg);
+int connection_manager_start(SharedData* shared);
+void connection_manager_stop(void);
+int connection_manager_join(const struct timespec* deadline);
 
 #endif // CONNECTION_MANAGER_H
\ No newline at end of file
@@ -0,0 +1,32 @@
+#ifndef DEDUP_CACHE_H
+#define DEDUP_CACHE_H
+
+#include <stddef.h>
+#include "shared_data.h"
+
+#define DUPLICATE_TIME_LIMIT 10 // Prevent duplicate data within 10 seconds
+#define FLOAT_TOLERANCE 0.01  // Precision tolerance for temperature/humidity
+
+typedef struct
+{
+    int sensor_id;
+    int used;
+    double temperature; // Last value stored for the sensor
+    double humidity;
+    long stored_at; // Seconds since the epoch
+} DedupEntry;
+
+typedef struct
+{
+    DedupEntry* entries; // Open-addressing table keyed by sensor id
+    size_t size; // Always a power of two
+    size_t count;
+} DedupCache;
+
+int dedup_cache_init(DedupCache* cache);
+void dedup_cache_destroy(DedupCache* cache);
+void dedup_cache_clear(DedupCache* cache);
+int dedup_cache_is_duplicate(const DedupCache* cache, const SensorReading* reading, long now);
+int dedup_cache_remember(DedupCache* cache, const SensorReading* reading, long now);
+
+#endif // DEDUP_CACHE_H
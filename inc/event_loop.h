@@ -0,0 +1,10 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include "shared_data.h"
+
+int event_loops_start(SharedData* shared, int loop_count);
+int event_loop_add_connection(SensorSlot* slot);
+void event_loops_stop(void);
+
+#endif // EVENT_LOOP_H
\ No newline at end of file
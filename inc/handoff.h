@@ -0,0 +1,45 @@
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+#include <stdint.h>
+#include "shared_data.h"
+
+#define HANDOFF_SOCKET_PATH "gateway.handoff"
+#define HANDOFF_VERSION 1 // Bumped whenever HandoffSensor or FrameParser change layout
+#define HANDOFF_BATCH 32 // Sensor sockets passed per message, well below the kernel's SCM_MAX_FD
+
+typedef enum
+{
+    HANDOFF_HELLO, // New process asks to take over, carries its version and record size
+    HANDOFF_REFUSED, // Old process cannot hand over to that version and keeps running
+    HANDOFF_LISTENER, // One listening socket, sent once per acceptor
+    HANDOFF_SENSORS, // A batch of sensor sockets with their HandoffSensor records
+    HANDOFF_DONE // Everything read from the sockets is stored and the backend is closed
+} HandoffType;
+
+typedef struct
+{
+    uint32_t type;
+    uint32_t version;
+    uint32_t record_size; // sizeof(HandoffSensor), the two binaries must agree on it
+    uint32_t count; // Descriptors and records carried by the message
+} HandoffHeader;
+
+typedef struct
+{
+    int id;
+    int port;
+    char ip[INET_ADDRSTRLEN];
+    LiveValue live; // LATEST answers the same right after the takeover
+    FrameParser parser; // Frame split across the handoff, continued by the new process
+} HandoffSensor;
+
+int handoff_listen(void);
+int handoff_accept(int listen_fd);
+int handoff_send_listeners(int fd, SharedData* shared);
+int handoff_send_sensors(int fd, SharedData* shared);
+int handoff_send_done(int fd);
+int handoff_receive(SharedData* shared);
+void handoff_attach(SharedData* shared);
+
+#endif // HANDOFF_H
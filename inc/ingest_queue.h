@@ -0,0 +1,14 @@
+#ifndef INGEST_QUEUE_H
+#define INGEST_QUEUE_H
+
+#include "shared_data.h"
+
+int ingest_queue_init(IngestQueue* queue, int capacity);
+void ingest_queue_destroy(IngestQueue* queue);
+int ingest_queue_push(IngestQueue* queue, const SensorReading* readings, int count);
+int ingest_queue_pop(IngestQueue* queue, SensorReading* reading, int64_t* enqueued_ns);
+void ingest_queue_wait(IngestQueue* queue, size_t count, int timeout_ms);
+void ingest_queue_wake(IngestQueue* queue);
+size_t ingest_queue_length(IngestQueue* queue);
+
+#endif // INGEST_QUEUE_H
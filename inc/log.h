@@ -1,7 +1,34 @@
 #ifndef LOG_H
 #define LOG_H
 
+#include <sys/types.h>
+#include "config.h"
+
+typedef enum
+{
+    LOG_TEXT, // Preformatted message from write_log
+    LOG_READING, // sensor id, temperature, humidity
+    LOG_SENSOR_CLOSED, // sensor id
+    LOG_INVALID_FORMAT, // sensor id
+    LOG_INVALID_SENSOR_ID, // reported sensor id
+    LOG_DUPLICATE, // sensor id
+    LOG_SHUTDOWN, // readings drained, milliseconds taken, readings left in the spool
+    LOG_HANDOFF_SENT, // sensor connections passed to the new process
+    LOG_HANDOFF_RECEIVED, // sensor connections taken over from the old process
+    LOG_METRICS, // Preformatted summary from log_metrics
+    LOG_RATE_LIMITED, // sensor id, readings over the rate limits since the last report
+    LOG_QUEUE_FULL, // readings dropped since the last report, full events and readings queued in total
+    LOG_STORAGE_UNAVAILABLE, // Storage could not be opened at startup
+    LOG_SPOOL_LOST, // readings lost, lost to the disk bound in total, readings left in the spool
+    LOG_EVENT_COUNT
+} LogEvent;
+
+int log_init(void);
 void write_log(const char* format, ...);
-void log_process();
+void log_metrics(const char* format, ...);
+unsigned long log_dropped_count(void);
+void log_event(LogEvent event, int sensor_id, double value1, double value2);
+void log_process(const GatewayConfig* config);
+int log_shutdown(pid_t pid, int timeout_ms);
 
-#endif // LOG_H
\ No newline at end of file
+#endif // LOG_H
@@ -0,0 +1,38 @@
+#ifndef LOG_WRITER_H
+#define LOG_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include "config.h"
+
+#define LOG_WRITER_BUFFER 65536 // Bytes gathered before a write() to the log file
+#define LOG_ENTRY_MAX 512 // Longest single entry
+
+typedef struct
+{
+    int fd;
+    char path[256];
+    char buffer[LOG_WRITER_BUFFER];
+    size_t used;
+    int64_t first_pending_ms; // When the oldest buffered entry was added, 0 if none
+    size_t file_size;
+    time_t opened_at;
+    unsigned long rotations;
+    time_t cached_second; // Second whose text form is in cached_stamp
+    char cached_stamp[32];
+    size_t max_bytes; // Rotate when the file reaches this size
+    int rotate_seconds; // Rotate files older than this, 0 disables
+    int flush_ms; // Longest time an entry stays in the buffer
+    int compress; // gzip rolled files in the background
+} LogWriter;
+
+int log_writer_open(LogWriter* writer, const char* path, const GatewayConfig* config);
+const char* log_writer_timestamp(LogWriter* writer, time_t when);
+char* log_writer_reserve(LogWriter* writer);
+void log_writer_commit(LogWriter* writer, size_t length);
+int log_writer_poll(LogWriter* writer, int idle_ms);
+void log_writer_flush(LogWriter* writer);
+void log_writer_close(LogWriter* writer);
+
+#endif // LOG_WRITER_H
@@ -0,0 +1,66 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include "shared_data.h"
+
+#define METRICS_SHARDS 16 // Threads with a shard of their own, later threads share the last one
+#define METRICS_SUB_BUCKETS 16 // Linear buckets per power of two, about 6% relative error
+#define METRICS_MAX_BITS 40 // Durations up to 2^40 ns (18 minutes), longer ones land in the last bucket
+#define METRICS_BUCKETS ((METRICS_MAX_BITS - 3) * METRICS_SUB_BUCKETS)
+
+typedef enum
+{
+    METRIC_CONNECTIONS_ACCEPTED, // Sensor nodes handed to an event loop
+    METRIC_CONNECTIONS_REJECTED, // Nodes closed during the ID handshake
+    METRIC_READINGS_RECEIVED, // Readings parsed from sensor frames
+    METRIC_FRAMES_INVALID,
+    METRIC_READINGS_DUPLICATE, // Skipped by the storage writer
+    METRIC_READINGS_STORED, // Committed to the backend
+    METRIC_READINGS_SPOOLED, // Written to the spool while the backend was down or behind
+    METRIC_QUERIES, // Requests on the query socket
+    METRIC_READINGS_SHED, // Discarded for being over a rate limit
+    METRIC_READINGS_COALESCED, // Replaced by a newer reading of the same sensor while over a rate limit
+    METRIC_TIMESTAMPS_REPLACED, // Node timestamps outside --clock-skew-s of gateway time, stored with arrival time
+    METRIC_READINGS_LOST, // Evicted from the spool by its disk bound or not spooled at all
+    METRIC_COUNTER_COUNT
+} MetricCounter;
+
+typedef enum
+{
+    STAGE_ACCEPT, // accept() until an event loop owns the socket, the ID handshake included
+    STAGE_PARSE, // One chunk read from a sensor socket, parsed and handed to the workers
+    STAGE_QUEUE_WAIT, // A reading in the ingest queue, until the storage writer takes it
+    STAGE_DB_COMMIT, // One batch appended and committed by the backend
+    STAGE_LOG_ENQUEUE, // One record put into the log ring
+    STAGE_COUNT
+} MetricStage;
+
+typedef struct
+{
+    uint64_t counters[METRIC_COUNTER_COUNT];
+    uint64_t buckets[STAGE_COUNT][METRICS_BUCKETS];
+    uint64_t sum_ns[STAGE_COUNT];
+} MetricsSnapshot;
+
+typedef struct
+{
+    long connected_sensors;
+    long queue_depth; // Readings waiting in the ingest queue
+    long sql_retry_count; // Failed attempts to reopen the backend since it was lost, 0 while connected
+    unsigned long readings_dropped; // Lost to a full ingest queue
+    unsigned long queue_full_events; // Pushes that found the ingest queue full, each dropped its readings
+    unsigned long log_dropped; // Log records lost to a full log ring
+} MetricsGauges;
+
+typedef void (*MetricsPrinter)(void* ctx, const char* line);
+
+int64_t metrics_now_ns(void);
+void metrics_count(MetricCounter counter, uint64_t n);
+void metrics_observe(MetricStage stage, int64_t ns);
+void metrics_snapshot(MetricsSnapshot* snapshot);
+void metrics_read_gauges(SharedData* shared, MetricsGauges* gauges);
+void metrics_write_prometheus(SharedData* shared, MetricsPrinter print, void* ctx);
+void metrics_log_summary(SharedData* shared, int interval_s);
+
+#endif // METRICS_H
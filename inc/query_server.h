@@ -0,0 +1,11 @@
+#ifndef QUERY_SERVER_H
+#define QUERY_SERVER_H
+
+#include "shared_data.h"
+
+#define QUERY_SOCKET_PATH "gateway.sock"
+
+int query_server_start(SharedData* shared, int thread_count);
+void query_server_stop(void);
+
+#endif // QUERY_SERVER_H
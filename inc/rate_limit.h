@@ -0,0 +1,16 @@
+#ifndef RATE_LIMIT_H
+#define RATE_LIMIT_H
+
+#include <stdint.h>
+#include "shared_data.h"
+
+#define RATE_BURST_S 2 // Token buckets hold this many seconds of their rate
+#define RATE_SAMPLE_EVERY 10 // Readings over the limit kept by the sample policy: one in this many
+#define RATE_REPORT_S 60 // A sensor over the limit is reported in gateway.log at most this often
+
+void rate_limit_configure(const GatewayConfig* config);
+int rate_limit_release(RateLimit* limit, int64_t now_ns, SensorReading* reading);
+int rate_limit_admit(RateLimit* limit, SensorReading* readings, int count, int64_t now_ns);
+int rate_limit_flush(RateLimit* limit, SensorReading* reading);
+
+#endif // RATE_LIMIT_H
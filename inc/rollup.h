@@ -0,0 +1,70 @@
+#ifndef ROLLUP_H
+#define ROLLUP_H
+
+#include <stddef.h>
+#include "shared_data.h"
+
+#define ROLLUP_LEVELS 2 // Window resolutions kept per sensor
+#define ROLLUP_GRACE_S 5 // A window is finished this long after it ends, late readings are skipped
+#define ROLLUP_QUANTILE 0.95
+
+extern const int rollup_resolutions[ROLLUP_LEVELS]; // Window lengths in seconds: 1 min, 1 h
+
+typedef struct
+{
+    double q[5]; // Marker heights, the middle one estimates the quantile (P-square algorithm)
+    int n[5]; // Marker positions
+    double np[5]; // Desired marker positions
+} QuantileSketch;
+
+typedef struct
+{
+    double min;
+    double max;
+    double mean;
+    double m2; // Sum of squared differences from the mean (Welford)
+    QuantileSketch p95;
+} RollupMetric;
+
+typedef struct
+{
+    long start; // Epoch seconds, a multiple of the resolution
+    long count;
+    RollupMetric temperature;
+    RollupMetric humidity;
+} RollupWindow;
+
+typedef struct
+{
+    int sensor_id;
+    int used;
+    RollupWindow windows[ROLLUP_LEVELS]; // Open window of each resolution
+} RollupEntry;
+
+typedef struct
+{
+    int sensor_id;
+    int resolution;
+    RollupWindow window;
+} RollupResult;
+
+typedef struct
+{
+    RollupEntry* entries; // Open-addressing table keyed by sensor id
+    size_t size; // Always a power of two
+    size_t count;
+    RollupResult* finished; // Windows waiting to be persisted
+    size_t finished_count;
+    size_t finished_capacity;
+    long last_expire;
+    unsigned long late; // Readings older than their sensor's open window
+} RollupEngine;
+
+int rollup_init(RollupEngine* engine);
+void rollup_destroy(RollupEngine* engine);
+int rollup_add(RollupEngine* engine, const SensorReading* reading, long ts);
+int rollup_expire(RollupEngine* engine, long now);
+double rollup_variance(const RollupMetric* metric, long count);
+double rollup_quantile(const QuantileSketch* sketch, long count);
+
+#endif // ROLLUP_H
@@ -3,6 +3,9 @@
 
 #include "shared_data.h"
 
-void* handle_sensor_messages(void* arg);
+void handle_sensor_bytes(SensorSlot* slot, const char* data, size_t length);
+int handle_sensor_messages(SharedData* shared, SensorSlot* slot);
+void flush_held_readings(SharedData* shared);
+void process_sensor_readings(SharedData* shared, SensorSlot* slot, const SensorReading* readings, int count);
 
 #endif // SENSOR_HANDLER_H
\ No newline at end of file
@@ -0,0 +1,29 @@
+#ifndef SENSOR_PARSER_H
+#define SENSOR_PARSER_H
+
+#include <stdint.h>
+#include "shared_data.h"
+
+#define PARSE_NEED_MORE 0 // Input consumed, the rest of the frame has not arrived yet
+#define PARSE_INVALID -1 // A malformed frame was skipped
+
+#define TEXT_FRAME_MAX 64 // Longest SENSOR: text frame
+
+#define BINARY_VERSION 2 // Newest binary framing version spoken by this build, 2 adds batches
+#define BINARY_FLAG_CRC 0x01 // Payload is followed by a CRC-16
+#define BINARY_FLAG_BATCH 0x02 // Payload carries a count and several samples
+#define BINARY_SAMPLE_SIZE 12 // timestamp, temperature, humidity
+#define BINARY_PAYLOAD_SIZE 18 // version, flags, id and one sample
+#define BINARY_FRAME_MAX (2 + BINARY_PAYLOAD_SIZE + 2) // Length prefix, payload and CRC
+#define BINARY_BATCH_HEADER 8 // version, flags, id, count
+#define BINARY_BATCH_MAX READING_BATCH_MAX // Samples in one batch frame
+#define BINARY_BATCH_FRAME_MAX (2 + BINARY_BATCH_HEADER + BINARY_BATCH_MAX * BINARY_SAMPLE_SIZE + 2)
+
+void frame_parser_reset(FrameParser* parser, int binary_version);
+int frame_parser_next(FrameParser* parser, const char** data, size_t* length, SensorReading* readings);
+int parse_id_frame(const char* data, size_t length, int* sensor_id, int* binary_version, size_t* consumed);
+uint16_t frame_crc16(const unsigned char* data, size_t length);
+size_t encode_binary_frame(unsigned char* out, const SensorReading* reading, int with_crc);
+size_t encode_binary_batch(unsigned char* out, const SensorReading* readings, int count, int with_crc);
+
+#endif // SENSOR_PARSER_H
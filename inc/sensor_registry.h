@@ -0,0 +1,15 @@
+#ifndef SENSOR_REGISTRY_H
+#define SENSOR_REGISTRY_H
+
+#include "shared_data.h"
+
+int sensor_registry_init(SensorRegistry* registry, size_t max_slots);
+void sensor_registry_destroy(SensorRegistry* registry);
+SensorSlot* sensor_registry_find(const SensorRegistry* registry, int sensor_id);
+SensorSlot* sensor_registry_get_or_add(SensorRegistry* registry, int sensor_id);
+SensorSlot* sensor_registry_slot_at(const SensorRegistry* registry, size_t index);
+size_t sensor_registry_count(const SensorRegistry* registry);
+void sensor_slot_publish(SensorSlot* slot, double temperature, double humidity, long at);
+void sensor_slot_snapshot(const SensorSlot* slot, LiveValue* value);
+
+#endif // SENSOR_REGISTRY_H
\ No newline at end of file
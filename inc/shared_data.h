@@ -2,10 +2,11 @@
 #define SHARED_DATA_H
 
 #include <pthread.h>
-#include <sqlite3.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
 #include <netinet/in.h>
-
-#define MAX_SENSORS 10
+#include "config.h"
 
 typedef struct
 {
@@ -15,31 +16,125 @@ typedef struct
     int port;
 } SensorConnection;
 
+typedef struct
+{
+    int sensor_id;
+    double temperature;
+    double humidity;
+    long timestamp; // Node clock in seconds, 0 when the frame carries none
+} SensorReading;
+
+#define READING_BATCH_MAX 64 // Readings a node may send in one batch frame
+#define FRAME_MAX_SIZE 1024 // Longest frame accepted from a sensor node, a full binary batch fits
+
+typedef struct
+{
+    char partial[FRAME_MAX_SIZE]; // Start of a frame split across reads
+    size_t length;
+    int overflow; // Discarding an oversized frame up to its terminator
+    int binary_version; // Negotiated in the ID: handshake, 0 for text frames
+    size_t skip; // Bytes left of an unusable binary frame
+} FrameParser;
+
+typedef struct
+{
+    _Atomic size_t sequence; // Ring lap at which the cell may be written or read
+    SensorReading reading;
+    int64_t enqueued_ns; // CLOCK_MONOTONIC when the reading was queued, for the queue wait metric
+} IngestCell;
+
+typedef struct
+{
+    _Alignas(64) _Atomic size_t tail; // Next position claimed by producers
+    _Alignas(64) size_t head; // Next position read by the single consumer
+    _Alignas(64) _Atomic size_t wake_at; // Tail position a sleeping consumer waits for, 0 while awake
+    int wake_fd; // eventfd the consumer sleeps on
+    IngestCell* cells;
+    size_t mask; // Capacity - 1, capacity is a power of two
+    _Atomic unsigned long pushed;
+    _Atomic unsigned long full_events; // Pushes that found the ring full
+    _Atomic unsigned long dropped; // Readings discarded after backpressure gave up
+} IngestQueue;
+
+#define REGISTRY_CHUNK_SLOTS 1024 // Slots allocated together; chunks are never moved
+#define REGISTRY_MAX_CHUNKS 1024 // Fixed chunk directory, so readers can walk it without a lock
+
+typedef struct
+{
+    double temperature;
+    double humidity;
+    long at; // Seconds since the epoch, 0 until the first reading
+} LiveValue;
+
+typedef struct
+{
+    _Alignas(64) _Atomic unsigned sequence; // Seqlock: odd while a writer updates the values
+    _Atomic double temperature;
+    _Atomic double humidity;
+    _Atomic long at;
+} LiveReading; // Padded to its own cache line, workers on different sensors never share one
+
+typedef struct
+{
+    int64_t full_at_ns; // CLOCK_MONOTONIC time at which the token bucket is full again
+    unsigned misses; // Readings that found no token, every RATE_SAMPLE_EVERY-th is kept under the sample policy
+    int has_pending; // A reading held back by the coalesce policy
+    SensorReading pending; // Latest reading that found no token, replaced by newer ones
+    int64_t reported_ns; // When the sensor was last reported as over the limit
+    unsigned long unreported; // Readings without a token since that report
+} RateLimit;
+
+typedef struct
+{
+    SensorConnection conn;
+    _Atomic int connected;
+    FrameParser parser; // Only touched by the event loop that owns the connection
+    RateLimit limit; // Per-sensor token bucket, owned by the event loop like the parser
+    LiveReading live; // Latest reading, published by workers and read without any lock
+} SensorSlot;
+
+typedef struct
+{
+    SensorSlot** table; // Open-addressing index from sensor id to slot, guarded by the sensor mutex
+    size_t table_size; // Always a power of two
+    SensorSlot* chunks[REGISTRY_MAX_CHUNKS];
+    size_t chunk_count;
+    size_t max_slots; // Slots are never freed, so distinct IDs are capped to bound memory
+    _Atomic size_t slot_count; // Published after the slot is filled in
+} SensorRegistry;
+
 typedef struct
 {
     pthread_mutex_t mutex;
-    SensorConnection sensor_connections[MAX_SENSORS];
-    int connected_sensors[MAX_SENSORS];
-    double running_temps[MAX_SENSORS];
-    double running_humidity[MAX_SENSORS];
+    SensorRegistry registry;
     int connection_count;
 } SensorData;
 
+struct StorageBackendOps;
+
 typedef struct
 {
-    pthread_mutex_t mutex;
-    sqlite3 *db;
-    int sql_connected;
-    int sql_retry_count;
-} SQLData;
+    const struct StorageBackendOps* ops; // Implementation selected with --backend
+    void* state; // Owned by the implementation
+    const GatewayConfig* config;
+    pthread_mutex_t mutex; // The writer must not append while the storage manager reconnects or expires data
+    _Atomic int connected;
+    int retry_count;
+} StorageBackend;
 
 typedef struct
 {
     pthread_mutex_t mutex;
-    int should_exit;
+    _Atomic int should_exit; // Set on SIGINT/SIGTERM, the front end stops taking readings
+    _Atomic int storage_closing; // Set once no reading can be queued anymore, the storage threads drain and exit
     int port;
+    int listen_fds[MAX_ACCEPTORS]; // Sensor listening sockets, created by main or taken over from the previous gateway
+    int listen_count; // One acceptor thread per socket
+    GatewayConfig config;
     SensorData sensor_data;
-    SQLData sql_data;
+    StorageBackend storage;
+    int storage_wake_fd; // eventfd the storage manager sleeps on between its timed tasks
+    IngestQueue ingest_queue;
 } SharedData;
 
 #endif // SHARED_DATA_H
\ No newline at end of file
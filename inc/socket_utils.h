@@ -3,7 +3,9 @@
 
 #include <netinet/in.h>
 
-int create_server_socket(int port);
+int create_server_socket(int port, int backlog);
+int server_port_in_use(int port);
 int accept_client_connection(int server_fd, struct sockaddr_in *client_addr);
+int create_unix_server_socket(const char* path, int type, int backlog);
 
 #endif // SOCKET_UTILS_H
\ No newline at end of file
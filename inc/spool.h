@@ -0,0 +1,45 @@
+#ifndef SPOOL_H
+#define SPOOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "shared_data.h"
+
+#define SPOOL_DIR "spool"
+#define SPOOL_SEGMENT_RECORDS 131072 // 4 MB of readings per segment file
+#define SPOOL_MAX_SEGMENTS 4096
+
+typedef struct
+{
+    int32_t sensor_id;
+    uint32_t check; // Checksum of the other fields, never 0 so a zeroed record reads as the end
+    double temperature;
+    double humidity;
+    int64_t timestamp;
+} SpoolRecord;
+
+typedef struct
+{
+    uint64_t id; // Segment files are named and replayed in id order
+    void* map; // Header followed by SPOOL_SEGMENT_RECORDS records, MAP_SHARED
+    size_t count; // Records written
+} SpoolSegment;
+
+typedef struct
+{
+    SpoolSegment segments[SPOOL_MAX_SEGMENTS]; // Oldest first
+    int segment_count;
+    int max_segments; // Disk bound, the oldest segment is dropped beyond it
+    size_t read_index; // Next record to replay in segments[0], persisted by the checkpoint
+    size_t pending; // Records appended and not yet consumed
+    uint64_t next_id; // Id of the next segment file
+    unsigned long dropped; // Records lost to the disk bound
+} Spool;
+
+int spool_open(Spool* spool, int max_mb);
+void spool_close(Spool* spool);
+int spool_append(Spool* spool, const SensorReading* readings, int count);
+int spool_peek(const Spool* spool, SensorReading* readings, int max);
+int spool_consume(Spool* spool, int count);
+
+#endif // SPOOL_H
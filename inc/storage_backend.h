@@ -0,0 +1,65 @@
+#ifndef STORAGE_BACKEND_H
+#define STORAGE_BACKEND_H
+
+#include <stddef.h>
+#include "shared_data.h"
+#include "rollup.h"
+
+typedef struct
+{
+    const SensorReading* readings; // Deduplicated, every timestamp set
+    int count;
+    const RollupResult* rollups; // Finished windows, dropped by backends without rollup storage
+    size_t rollup_count;
+} StorageBatch;
+
+typedef struct
+{
+    double min;
+    double max;
+    double mean;
+    double var;
+    double p95;
+} StoredMetric;
+
+typedef struct
+{
+    long window_start;
+    long count;
+    StoredMetric temperature;
+    StoredMetric humidity;
+} StoredRollup;
+
+// Row callbacks of the query functions, returning -1 stops the query
+typedef int (*StorageRangeFn)(void* ctx, const SensorReading* reading);
+typedef int (*StorageRollupFn)(void* ctx, const StoredRollup* rollup);
+
+typedef struct StorageBackendOps
+{
+    const char* name;
+    int (*open)(StorageBackend* backend); // Also called to reconnect after a failure
+    int (*append)(StorageBackend* backend, const StorageBatch* batch); // -1 if nothing was stored
+    int (*flush)(StorageBackend* backend); // Writes out anything the backend buffers
+    int (*expire)(StorageBackend* backend, long oldest_day); // Drops data of days before oldest_day
+    void (*close)(StorageBackend* backend);
+
+    // Query side, one reader per query thread so readers never share a handle
+    void* (*open_reader)(StorageBackend* backend);
+    int (*query_range)(void* reader, int sensor_id, long from, long to, int limit, StorageRangeFn fn, void* ctx);
+    int (*query_rollup)(void* reader, int sensor_id, int resolution, long from, long to, int limit,
+                        StorageRollupFn fn, void* ctx); // NULL if the backend keeps no rollups
+    void (*close_reader)(void* reader);
+} StorageBackendOps;
+
+extern const StorageBackendOps sqlite_backend_ops;
+extern const StorageBackendOps column_backend_ops;
+
+int storage_backend_init(StorageBackend* backend, const GatewayConfig* config);
+void storage_backend_destroy(StorageBackend* backend);
+int storage_open(StorageBackend* backend);
+int storage_append(StorageBackend* backend, const StorageBatch* batch);
+int storage_flush(StorageBackend* backend);
+int storage_expire(StorageBackend* backend, long oldest_day);
+void storage_close(StorageBackend* backend);
+
+#endif // STORAGE_BACKEND_H
@@ -4,6 +4,9 @@
 #include "shared_data.h"
 
 void* storage_manager(void* arg);
-void insert_sensor_data(SharedData* shared, int sensor_id, double temperature, double humidity);
+void* storage_writer(void* arg);
+void storage_manager_wake(SharedData* shared);
+void storage_manager_stop(SharedData* shared);
+void insert_sensor_batch(SharedData* shared, const SensorReading* readings, int count);
 
 #endif // STORAGE_MANAGER_H
\ No newline at end of file
@@ -0,0 +1,18 @@
+#ifndef STORAGE_SCHEMA_H
+#define STORAGE_SCHEMA_H
+
+#include <stddef.h>
+#include <sqlite3.h>
+
+#define SCHEMA_VERSION 3 // 1: single sensor_data table, 2: daily partitions behind a view, 3: sensor_rollup
+#define PARTITION_SECONDS 86400 // One partition table per UTC day
+#define PARTITION_NAME_SIZE 32
+#define PARTITION_VIEW_MAX 500 // SQLite limit on the terms of a compound SELECT
+
+long partition_day(long ts);
+void partition_name(long day, char* name, size_t size);
+int schema_migrate(sqlite3* db);
+int schema_ensure_partition(sqlite3* db, long day);
+int schema_drop_expired(sqlite3* db, long oldest_day);
+
+#endif // STORAGE_SCHEMA_H
@@ -0,0 +1,10 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include "shared_data.h"
+
+int worker_pool_start(SharedData* shared, int worker_count);
+void worker_pool_submit(SensorSlot* slot, const SensorReading* readings, int count);
+void worker_pool_stop(void);
+
+#endif // WORKER_POOL_H
\ No newline at end of file
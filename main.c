@@ -1,97 +1,307 @@
+#define _GNU_SOURCE // pthread_timedjoin_np
 #include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
 #include <signal.h>
-#include <sqlite3.h>
-#include <errno.h>
 #include <unistd.h>
-#include <sys/stat.h>
 #include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
 #include "log.h"
 #include "connection_manager.h"
 #include "storage_manager.h"
+#include "config.h"
+#include "event_loop.h"
+#include "worker_pool.h"
+#include "sensor_registry.h"
+#include "ingest_queue.h"
+#include "storage_backend.h"
+#include "query_server.h"
+#include "socket_utils.h"
+#include "handoff.h"
+#include "metrics.h"
+#include "rate_limit.h"
 #include "sensor_handler.h"
 
-#define FIFO_NAME "logFifo" // Name of the FIFO (named pipe) for logging
-static volatile int keep_running = 1; // Flag to control the running state of the main process
+// Function to report a thread that did not exit before the shutdown deadline
+static int deadline_passed(const char* name)
+{
+    write_log("Shutdown deadline passed waiting for the %s", name);
+    fprintf(stderr, "Shutdown deadline passed waiting for the %s\n", name);
+    return -1;
+}
 
-// Signal handler to set the keep_running flag to 0
-void handle_signal(int signum)
+// Function to join a thread unless the shutdown deadline passes first, returns -1 on timeout
+static int join_before(pthread_t thread, const struct timespec* deadline, const char* name)
 {
-    write_log("Received signal %d, cleaning up...", signum);
-    keep_running = 0;
+    if (pthread_timedjoin_np(thread, NULL, deadline) != 0)
+    {
+        return deadline_passed(name);
+    }
+    return 0;
 }
 
-int main(int argc, char *argv[])
+// Function to close the sensor listening sockets, pending connections in their queues are reset
+static void close_listeners(SharedData* shared)
 {
-    if (argc != 2)
+    for (int i = 0; i < shared->listen_count; i++)
     {
-        fprintf(stderr, "Usage: %s <port>\n", argv[0]);
-        exit(EXIT_FAILURE);
+        close(shared->listen_fds[i]);
+    }
+    shared->listen_count = 0;
+}
+
+// Function to stop in dependency order: accept, sensor reads, workers, then storage once nothing can queue;
+// with a handoff_fd the sockets are passed to the new gateway instead of being closed
+static int shutdown_gateway(SharedData* shared, pthread_t storage_thread, pthread_t writer_thread, int handoff_fd)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline); // The clock pthread_timedjoin_np measures against
+    deadline.tv_sec += shared->config.shutdown_s;
+
+    shared->should_exit = 1;
+    connection_manager_stop();
+    if (connection_manager_join(&deadline) == -1)
+    {
+        return deadline_passed("acceptors"); // One may still hand a socket to the event loops, so leave them alone
     }
+    if (handoff_fd != -1 && handoff_send_listeners(handoff_fd, shared) == 0)
+    {
+        close_listeners(shared); // New nodes queue in the backlogs until the new gateway accepts them
+    }
+    query_server_stop();
 
-    // Create the FIFO for logging
-    if (mkfifo(FIFO_NAME, 0666) == -1)
+    // Bytes already received are read and every queued frame is processed before storage is told to close
+    event_loops_stop();
+    if (handoff_fd != -1)
+    {
+        handoff_send_sensors(handoff_fd, shared); // Unread bytes wait in the kernel for the new gateway
+    }
+    flush_held_readings(shared);
+    worker_pool_stop();
+
+    storage_manager_stop(shared);
+    if (join_before(writer_thread, &deadline, "storage writer") == -1)
+    {
+        write_log("%zu readings were still queued", ingest_queue_length(&shared->ingest_queue));
+        return -1; // The backend is in use, leave it to crash recovery rather than close it underneath
+    }
+    if (join_before(storage_thread, &deadline, "storage manager") == -1)
     {
-        if (errno != EEXIST)
+        return -1;
+    }
+    storage_close(&shared->storage);
+    if (handoff_fd != -1)
+    {
+        handoff_send_done(handoff_fd); // The new gateway opens storage only now
+    }
+    return 0;
+}
+
+// Function to wait for SIGINT/SIGTERM or a takeover request, logging the metrics summary meanwhile;
+// returns the handoff socket or -1 for a signal
+static int wait_for_stop(SharedData* shared, const sigset_t* signals)
+{
+    int signal_fd = signalfd(-1, signals, SFD_CLOEXEC);
+    int listen_fd = handoff_listen();
+    if (listen_fd == -1)
+    {
+        write_log("Takeover disabled, can't listen on %s", HANDOFF_SOCKET_PATH); // Log error, keep serving
+    }
+
+    int handoff_fd = -1;
+    struct pollfd pfds[2] = {{.fd = signal_fd, .events = POLLIN}, {.fd = listen_fd, .events = POLLIN}};
+    int interval_ms = shared->config.metrics_s * 1000;
+    int64_t summary_at = metrics_now_ns() / 1000000 + interval_ms;
+    while (1)
+    {
+        int64_t now_ms = metrics_now_ns() / 1000000;
+        if (now_ms >= summary_at)
+        {
+            metrics_log_summary(shared, shared->config.metrics_s);
+            summary_at = now_ms + interval_ms;
+        }
+        if (poll(pfds, listen_fd == -1 ? 1 : 2, (int)(summary_at - now_ms)) <= 0)
         {
-            perror("mkfifo");
-            exit(1);
+            continue; // Timed out for the next summary, or interrupted
         }
+        if (pfds[0].revents & POLLIN)
+        {
+            struct signalfd_siginfo info;
+            if (read(signal_fd, &info, sizeof(info)) == (ssize_t)sizeof(info))
+            {
+                write_log("Received signal %u, cleaning up...", info.ssi_signo);
+            }
+            break;
+        }
+        if ((pfds[1].revents & POLLIN) && (handoff_fd = handoff_accept(listen_fd)) != -1)
+        {
+            write_log("Handing over to a new gateway");
+            break;
+        }
+    }
+
+    close(signal_fd);
+    if (listen_fd != -1)
+    {
+        close(listen_fd);
+        unlink(HANDOFF_SOCKET_PATH); // One takeover at a time, the new gateway offers its own
+    }
+    return handoff_fd;
+}
+
+int main(int argc, char *argv[])
+{
+    SharedData shared; // Shared data between threads
+    if (parse_config(argc, argv, &shared.config) == -1 || storage_backend_init(&shared.storage, &shared.config) == -1)
+    {
+        print_usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    // Map the log ring before forking so both processes share it
+    if (log_init() == -1)
+    {
+        exit(1);
     }
 
     // Fork a new process to handle logging
     pid_t pid = fork();
     if (pid == 0)
     {
-        log_process(); // Child process runs the log process
+        log_process(&shared.config); // Child process runs the log process
         exit(0);
     }
 
-    SharedData shared; // Shared data between threads
+    // Signals are taken with a signalfd below; blocked before any thread starts,
+    // otherwise the kernel delivers them to a thread that does not block them and the default action kills us
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
     pthread_mutex_init(&shared.sensor_data.mutex, NULL); // Initialize sensor data mutex
-    pthread_mutex_init(&shared.sql_data.mutex, NULL); // Initialize SQL data mutex
-    memset(shared.sensor_data.connected_sensors, 0, sizeof(shared.sensor_data.connected_sensors)); // Initialize connected sensors array
-    memset(shared.sensor_data.running_temps, 0, sizeof(shared.sensor_data.running_temps)); // Initialize running temperatures array
-    memset(shared.sensor_data.running_humidity, 0, sizeof(shared.sensor_data.running_humidity)); // Initialize running humidity array
-    shared.sql_data.sql_connected = 0; // Initialize SQL connection status
+    // Initialize the sensor registry
+    if (sensor_registry_init(&shared.sensor_data.registry, (size_t)shared.config.max_sensors) == -1)
+    {
+        fprintf(stderr, "Failed to allocate sensor registry\n");
+        exit(EXIT_FAILURE);
+    }
+    if (ingest_queue_init(&shared.ingest_queue, shared.config.queue_size) == -1) // Initialize the ingest ring
+    {
+        fprintf(stderr, "Failed to allocate ingest queue\n");
+        exit(EXIT_FAILURE);
+    }
+    shared.storage_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC); // Wakes the storage manager
+    if (shared.storage_wake_fd == -1)
+    {
+        perror("eventfd failed");
+        exit(EXIT_FAILURE);
+    }
     shared.should_exit = 0; // Initialize should_exit flag
+    shared.storage_closing = 0;
     shared.sensor_data.connection_count = 0; // Initialize connection count
-    shared.port = atoi(argv[1]); // Set the server port
-    shared.sql_data.sql_retry_count = 0; // Initialize SQL retry count
+    shared.port = shared.config.port; // Set the server port
 
-    // Open the SQLite database
-    int rc = sqlite3_open("sensor_data.db", &shared.sql_data.db);
-    if (rc)
+    if (shared.config.takeover)
+    {
+        // Returns once the running gateway stored what it read and closed the backend
+        if (handoff_receive(&shared) == -1)
+        {
+            fprintf(stderr, "Takeover failed, no compatible gateway is running here\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    else
+    {
+        shared.listen_count = 0;
+        if (server_port_in_use(shared.port) == 1)
+        {
+            fprintf(stderr, "Port %d is in use, e.g. by another gateway; use --takeover to replace one started here\n",
+                    shared.port);
+            exit(EXIT_FAILURE);
+        }
+    }
+    // Sockets taken over keep their queues and only get the configured backlog; missing ones are added,
+    // which needs SO_REUSEPORT on the sockets already bound to the port
+    for (int i = 0; i < shared.listen_count; i++)
+    {
+        listen(shared.listen_fds[i], shared.config.backlog);
+    }
+    while (shared.listen_count < shared.config.acceptors)
+    {
+        int fd = create_server_socket(shared.port, shared.config.backlog);
+        if (fd == -1)
+        {
+            break;
+        }
+        shared.listen_fds[shared.listen_count++] = fd;
+    }
+    if (shared.listen_count == 0)
+    {
+        fprintf(stderr, "Can't listen on port %d\n", shared.port);
+        exit(EXIT_FAILURE);
+    }
+    // Acceptors drain their queue until accept() would block, a node gone before accept() must not block it
+    for (int i = 0; i < shared.listen_count; i++)
+    {
+        int listen_flags = fcntl(shared.listen_fds[i], F_GETFL, 0);
+        fcntl(shared.listen_fds[i], F_SETFL, listen_flags | O_NONBLOCK);
+    }
+
+    // Open the storage backend, e.g. migrating an older sensor_data table before serving; if it can't open yet,
+    // e.g. another connection holds the database locked, the storage manager keeps retrying and readings are
+    // spooled meanwhile
+    if (storage_open(&shared.storage) == -1)
+    {
+        fprintf(stderr, "Can't open %s storage yet, spooling readings until it opens\n", shared.storage.ops->name);
+        log_event(LOG_STORAGE_UNAVAILABLE, 0, 0, 0);
+    }
+    write_log("Server started on port %d", shared.port);
+
+    // Rate limits apply from the first reading, including those of sensors taken over
+    rate_limit_configure(&shared.config);
+    if (shared.config.sensor_rate || shared.config.global_rate)
+    {
+        write_log("Ingest limited to %d readings/s per sensor and %d in total (0 unlimited), %s the excess",
+                  shared.config.sensor_rate, shared.config.global_rate,
+                  overload_policy_name(shared.config.overload_policy));
+    }
+
+    // Start the worker pool that processes parsed readings
+    if (worker_pool_start(&shared, shared.config.workers) == -1)
     {
-        write_log("Can't open database: %s", sqlite3_errmsg(shared.sql_data.db));
         return 1;
     }
 
-    // Create the sensor_data table if it doesn't exist
-    const char *sql = "CREATE TABLE IF NOT EXISTS sensor_data ("
-                      "id INTEGER PRIMARY KEY AUTOINCREMENT,"
-                      "sensor_id INTEGER,"
-                      "temperature REAL,"
-                      "humidity REAL,"
-                      "timestamp DATETIME DEFAULT CURRENT_TIMESTAMP);";
+    // Start the event loops that own the sensor sockets
+    if (event_loops_start(&shared, shared.config.event_loops) == -1)
+    {
+        worker_pool_stop();
+        return 1;
+    }
+    handoff_attach(&shared); // Sensors taken over are read again from where the previous gateway stopped
 
-    char *err_msg = NULL;
-    rc = sqlite3_exec(shared.sql_data.db, sql, NULL, NULL, &err_msg);
-    if (rc != SQLITE_OK)
+    // Serve local queries from the in-memory snapshot and read-only database connections
+    if (query_server_start(&shared, shared.config.query_threads) == -1)
     {
-        write_log("SQL error: %s", err_msg);
-        sqlite3_free(err_msg);
+        event_loops_stop();
+        worker_pool_stop();
         return 1;
     }
-    write_log("Server started on port %d", shared.port);
 
-    pthread_t conn_thread, storage_thread;
+    pthread_t storage_thread, writer_thread;
 
-    // Create the connection manager thread
-    if (pthread_create(&conn_thread, NULL, connection_manager, &shared) != 0)
+    // Start the acceptor threads, one per listening socket
+    if (connection_manager_start(&shared) == -1)
     {
-        write_log("Failed to create connection manager thread");
+        query_server_stop();
+        event_loops_stop();
+        worker_pool_stop();
         return 1;
     }
 
@@ -102,19 +312,41 @@ int main(int argc, char *argv[])
         return 1;
     }
 
-    // Set up signal handlers for SIGINT and SIGTERM
-    signal(SIGINT, handle_signal);
-    signal(SIGTERM, handle_signal);
+    // Create the storage writer thread that commits queued readings
+    if (pthread_create(&writer_thread, NULL, storage_writer, &shared) != 0)
+    {
+        write_log("Failed to create storage writer thread");
+        return 1;
+    }
+
+    // Wait for SIGINT, SIGTERM or a gateway started with --takeover
+    int handoff_fd = wait_for_stop(&shared, &signals);
+
+    struct timespec started, stopped;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    int rc = shutdown_gateway(&shared, storage_thread, writer_thread, handoff_fd);
+    if (handoff_fd != -1)
+    {
+        close(handoff_fd);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stopped);
+    long spent_ms = (stopped.tv_sec - started.tv_sec) * 1000L + (stopped.tv_nsec - started.tv_nsec) / 1000000L;
+    long left_ms = shared.config.shutdown_s * 1000L - spent_ms;
 
-    // Wait for the threads to finish
-    pthread_join(conn_thread, NULL);
-    pthread_join(storage_thread, NULL);
+    // The log process goes last so that it writes the drain report; it gets at least a second of its own
+    log_shutdown(pid, left_ms > 1000 ? (int)left_ms : 1000);
+    if (rc == -1)
+    {
+        return 1; // Threads are still running, exiting ends them
+    }
 
     // Clean up resources
     pthread_mutex_destroy(&shared.sensor_data.mutex);
-    pthread_mutex_destroy(&shared.sql_data.mutex);
-    sqlite3_close(shared.sql_data.db);
-    unlink(FIFO_NAME);
+    storage_backend_destroy(&shared.storage);
+    sensor_registry_destroy(&shared.sensor_data.registry);
+    ingest_queue_destroy(&shared.ingest_queue);
+    close(shared.storage_wake_fd);
+    close_listeners(&shared);
 
     return 0;
 }
\ No newline at end of file
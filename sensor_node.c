@@ -5,37 +5,93 @@
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <time.h>
+#include <getopt.h>
+#include "sensor_parser.h"
 
 #define BUFF_SIZE 1024
-#define SERVER_IP "YOUR_SERVER_IP" // Replace with the actual server IP address
+#define DEFAULT_INTERVAL_MS 5000 // Time between two samples
+#define DEFAULT_BATCH_MS 1000 // Longest time a buffered sample waits before its batch is sent
+#define DEFAULT_SERVER_IP "127.0.0.1" // Gateway address unless -a gives another one
 
 typedef struct
 {
     float temperature;
     float humidity;
-} SensorData;
+} SensorSample;
 
 // Generate random sensor data
-SensorData generate_sensor_data(int sensor_id)
+SensorSample generate_sensor_data(int sensor_id)
 {
-    srand(time(NULL) + sensor_id); // Seed with current time and sensor ID
-    SensorData data;
+    (void)sensor_id; // The generator is seeded once per node in main
+    SensorSample data;
     data.temperature = 15.0 + ((float)rand() / RAND_MAX) * 20.0; // 15-35°C
     data.humidity = 30.0 + ((float)rand() / RAND_MAX) * 70.0;    // 30-100%
     return data;
 }
 
+// Function to return a monotonic timestamp in milliseconds
+static long now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+}
+
 int main(int argc, char *argv[])
 {
-    if (argc != 3)
+    int binary = 0; // Send length-prefixed binary frames instead of text
+    int with_crc = 0; // Append a CRC-16 to every binary frame
+    int batch_size = 1; // Samples buffered per batch frame, 1 sends every sample on its own
+    long interval_ms = DEFAULT_INTERVAL_MS;
+    long flush_ms = DEFAULT_BATCH_MS;
+    const char* server_ip = DEFAULT_SERVER_IP;
+    int opt;
+    while ((opt = getopt(argc, argv, "a:bcn:i:t:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'a':
+            server_ip = optarg;
+            break;
+        case 'c':
+            with_crc = 1;
+            binary = 1; // The CRC only exists in binary frames
+            break;
+        case 'b':
+            binary = 1;
+            break;
+        case 'n':
+            batch_size = atoi(optarg);
+            binary = 1; // Batches only exist in binary frames
+            break;
+        case 'i':
+            interval_ms = atol(optarg);
+            break;
+        case 't':
+            flush_ms = atol(optarg);
+            break;
+        default:
+            argc = 0; // Fall through to the usage message
+        }
+    }
+
+    if (argc - optind != 2 || batch_size < 1 || batch_size > BINARY_BATCH_MAX || interval_ms <= 0 || flush_ms < 0)
     {
-        printf("Usage: %s <sensor_id> <server_port>\n", argv[0]);
+        printf("Usage: %s [-a addr] [-b] [-c] [-n count] [-i ms] [-t ms] <sensor_id> <server_port>\n", argv[0]);
+        printf("  -a addr   gateway address (default %s)\n", DEFAULT_SERVER_IP);
+        printf("  -b        send binary frames\n");
+        printf("  -c        send binary frames with a CRC-16\n");
+        printf("  -n count  buffer up to count samples per binary batch frame (max %d)\n", BINARY_BATCH_MAX);
+        printf("  -i ms     time between samples (default %d)\n", DEFAULT_INTERVAL_MS);
+        printf("  -t ms     longest time a buffered sample waits before the batch is sent (default %d)\n",
+               DEFAULT_BATCH_MS);
         printf("Example: %s 0 6000\n", argv[0]);
         exit(1);
     }
 
-    int sensor_id = atoi(argv[1]); // Convert sensor ID from string to integer
-    int server_port = atoi(argv[2]); // Convert server port from string to integer
+    int sensor_id = atoi(argv[optind]); // Convert sensor ID from string to integer
+    int server_port = atoi(argv[optind + 1]); // Convert server port from string to integer
+    srand(time(NULL) + sensor_id); // Seed with current time and sensor ID
 
     // Create socket
     int sock = socket(AF_INET, SOCK_STREAM, 0);
@@ -51,7 +107,7 @@ int main(int argc, char *argv[])
     server_addr.sin_family = AF_INET;
     server_addr.sin_port = htons(server_port);
 
-    if (inet_pton(AF_INET, SERVER_IP, &server_addr.sin_addr) <= 0)
+    if (inet_pton(AF_INET, server_ip, &server_addr.sin_addr) <= 0)
     {
         perror("Invalid address");
         exit(1);
@@ -67,30 +123,84 @@ int main(int argc, char *argv[])
     printf("Sensor node %d connected to server on port %d\n", sensor_id, server_port);
 
     // Send sensor ID first
-    char id_msg[10];
-    sprintf(id_msg, "ID:%d", sensor_id);
+    char id_msg[32];
+    if (binary)
+    {
+        sprintf(id_msg, "ID:%d,BIN:%d\n", sensor_id, BINARY_VERSION); // Ask for binary framing
+    }
+    else
+    {
+        sprintf(id_msg, "ID:%d\n", sensor_id); // Every frame is terminated by a newline
+    }
     send(sock, id_msg, strlen(id_msg), 0);
     sleep(1);
 
+    SensorReading pending[BINARY_BATCH_MAX]; // Samples waiting for the next batch frame
+    int pending_count = 0;
+    long flush_at = 0; // Deadline of the oldest buffered sample
+    long next_sample = now_ms();
+
     // Main loop - send sensor data
     while (1)
     {
-        SensorData data = generate_sensor_data(sensor_id); // Generate random sensor data
+        char message[BUFF_SIZE]; // Holds a text line or a full binary batch frame
+        size_t length = 0;
 
-        char message[BUFF_SIZE];
-        sprintf(message, "SENSOR:%d,TEMP:%.2f,HUM:%.2f",
-                sensor_id, data.temperature, data.humidity);
+        if (now_ms() >= next_sample)
+        {
+            SensorSample data = generate_sensor_data(sensor_id); // Generate random sensor data
+            SensorReading reading = {.sensor_id = sensor_id, .temperature = data.temperature,
+                                     .humidity = data.humidity, .timestamp = (long)time(NULL)};
+            next_sample += interval_ms;
+
+            if (batch_size > 1)
+            {
+                if (pending_count == 0)
+                {
+                    flush_at = now_ms() + flush_ms;
+                }
+                pending[pending_count++] = reading;
+            }
+            else if (binary)
+            {
+                length = encode_binary_frame((unsigned char*)message, &reading, with_crc);
+            }
+            else
+            {
+                length = (size_t)sprintf(message, "SENSOR:%d,TEMP:%.2f,HUM:%.2f\n",
+                                         sensor_id, data.temperature, data.humidity);
+            }
+
+            printf("Sensor %d sampled - Temperature: %.2f°C, Humidity: %.2f%%\n",
+                   sensor_id, data.temperature, data.humidity);
+        }
 
-        if (send(sock, message, strlen(message), 0) < 0)
+        // Send the buffered samples once the batch is full or its oldest sample is due
+        if (pending_count > 0 && (pending_count == batch_size || now_ms() >= flush_at))
+        {
+            length = encode_binary_batch((unsigned char*)message, pending, pending_count, with_crc);
+            printf("Sensor %d sent a batch of %d samples\n", sensor_id, pending_count);
+            pending_count = 0;
+        }
+
+        if (length > 0 && send(sock, message, length, 0) < 0)
         {
             printf("Sensor node %d: Connection lost\n", sensor_id);
             break;
         }
 
-        printf("Sensor %d sent - Temperature: %.2f°C, Humidity: %.2f%%\n",
-               sensor_id, data.temperature, data.humidity);
-
-        sleep(5); // Send data every 5 seconds
+        // Sleep until the next sample or the batch deadline, whichever comes first
+        long wake_at = next_sample;
+        if (pending_count > 0 && flush_at < wake_at)
+        {
+            wake_at = flush_at;
+        }
+        long delay = wake_at - now_ms();
+        if (delay > 0)
+        {
+            struct timespec pause = {.tv_sec = delay / 1000, .tv_nsec = (delay % 1000) * 1000000L};
+            nanosleep(&pause, NULL);
+        }
     }
 
     close(sock); // Close the socket
@@ -0,0 +1,1241 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include "column_backend.h"
+#include "storage_backend.h"
+#include "storage_schema.h"
+#include "log.h"
+
+#define COLUMN_BLOCK_MAGIC 0x4B4C4243u // "CBLK" in little-endian byte order
+#define COLUMN_TAIL_MAGIC "COLTAIL" // 8 bytes with the terminator
+#define COLUMN_TAIL_PATH COLUMN_DIR "/tail.log"
+#define COLUMN_TAIL_HEADER_SIZE 64
+#define COLUMN_TAIL_CHUNK 1024 // Tail records read per call
+#define COLUMN_PATH_SIZE 64
+#define COLUMN_RECOVER_FILES 2 // Newest day files checked for a torn block on open
+#define COLUMN_INITIAL_READINGS 16 // First allocation of an open block
+
+typedef struct
+{
+    char magic[8];
+    uint64_t generation; // Bumped by every seal, records of older generations are ignored
+} ColumnTailHeader;
+
+typedef struct
+{
+    int sensor_id;
+    long day;
+    uint32_t count;
+    uint32_t capacity;
+    int64_t* ts;
+    double* temperature;
+    double* humidity;
+} OpenBlock;
+
+typedef struct
+{
+    int tail_fd;
+    off_t tail_size;
+    uint64_t generation;
+    int sync_level;
+    OpenBlock* blocks; // Unsealed readings per sensor and day
+    size_t block_count;
+    size_t block_capacity;
+    uint32_t* index; // Open addressing by sensor id and day, block position + 1, 0 when empty
+    size_t index_size; // Always a power of two
+    size_t buffered; // Readings in open blocks
+    ColumnTailRecord* records; // Scratch space for the tail records of one append
+    size_t record_capacity;
+} ColumnState;
+
+typedef struct
+{
+    int tail_fd; // Own descriptor, its shared lock keeps seals out while a query runs
+} ColumnReader;
+
+typedef struct
+{
+    int64_t ts;
+    double temperature;
+    double humidity;
+    size_t seq; // Keeps readings with the same timestamp in stored order
+} ColumnRow;
+
+typedef struct
+{
+    ColumnRow* rows;
+    size_t count;
+    size_t capacity;
+} ColumnRows;
+
+typedef struct
+{
+    uint8_t* out;
+    size_t pos;
+    uint64_t acc;
+    int bits; // Bits held in acc, fewer than 8 between calls
+} BitWriter;
+
+typedef struct
+{
+    const uint8_t* in;
+    size_t size;
+    size_t pos;
+    uint64_t acc;
+    int bits;
+    int overrun; // Read past the end of the payload
+} BitReader;
+
+// Delta-of-delta classes after the '0' of an unchanged delta: prefix, then a signed value of value_bits
+static const struct
+{
+    int prefix_bits;
+    uint64_t prefix;
+    int value_bits;
+} dod_classes[] = {{2, 0x2, 7}, {3, 0x6, 9}, {4, 0xE, 12}, {4, 0xF, 64}};
+
+#define DOD_CLASSES (int)(sizeof(dod_classes) / sizeof(dod_classes[0]))
+
+_Static_assert(sizeof(ColumnBlockHeader) == 80, "block headers are 80 bytes on disk");
+_Static_assert(sizeof(ColumnTailRecord) == 40, "tail records are 40 bytes on disk");
+_Static_assert(sizeof(ColumnTailHeader) <= COLUMN_TAIL_HEADER_SIZE, "tail header must fit its reserved space");
+
+// Function to append bits to the stream, most significant first
+static void put_bits(BitWriter* w, uint64_t value, int count)
+{
+    if (count > 32)
+    {
+        put_bits(w, value >> 32, count - 32);
+        count = 32;
+    }
+    w->acc = (w->acc << count) | (value & ((1ull << count) - 1));
+    w->bits += count;
+    while (w->bits >= 8)
+    {
+        w->bits -= 8;
+        w->out[w->pos++] = (uint8_t)(w->acc >> w->bits);
+    }
+}
+
+// Function to read bits from the stream, zeros past the end set the overrun flag
+static uint64_t get_bits(BitReader* r, int count)
+{
+    if (count > 32)
+    {
+        uint64_t high = get_bits(r, count - 32);
+        return (high << 32) | get_bits(r, 32);
+    }
+    while (r->bits < count)
+    {
+        r->overrun |= r->pos >= r->size;
+        r->acc = (r->acc << 8) | (r->pos < r->size ? r->in[r->pos] : 0);
+        r->pos++;
+        r->bits += 8;
+    }
+    r->bits -= count;
+    return (r->acc >> r->bits) & ((1ull << count) - 1);
+}
+
+// Function to sign-extend the low bits of a value
+static int64_t sign_extend(uint64_t value, int bits)
+{
+    return bits == 64 ? (int64_t)value : (int64_t)(value << (64 - bits)) >> (64 - bits);
+}
+
+// Function to encode timestamps as the first value followed by delta-of-deltas (Gorilla)
+static void encode_timestamps(BitWriter* w, const int64_t* ts, uint32_t count)
+{
+    int64_t prev_delta = 0;
+    put_bits(w, (uint64_t)ts[0], 64);
+    for (uint32_t i = 1; i < count; i++)
+    {
+        int64_t delta = ts[i] - ts[i - 1];
+        int64_t dod = delta - prev_delta;
+        prev_delta = delta;
+        if (dod == 0)
+        {
+            put_bits(w, 0, 1); // Regular interval, the common case
+            continue;
+        }
+        int c = 0;
+        while (c < DOD_CLASSES - 1 && (dod < -(1ll << (dod_classes[c].value_bits - 1)) ||
+                                       dod >= (1ll << (dod_classes[c].value_bits - 1))))
+        {
+            c++;
+        }
+        put_bits(w, dod_classes[c].prefix, dod_classes[c].prefix_bits);
+        put_bits(w, (uint64_t)dod, dod_classes[c].value_bits);
+    }
+}
+
+// Function to decode the timestamps written by encode_timestamps
+static void decode_timestamps(BitReader* r, int64_t* ts, uint32_t count)
+{
+    int64_t prev_delta = 0;
+    ts[0] = (int64_t)get_bits(r, 64);
+    for (uint32_t i = 1; i < count; i++)
+    {
+        int ones = 0;
+        while (ones < DOD_CLASSES && get_bits(r, 1))
+        {
+            ones++;
+        }
+        int64_t dod = ones ? sign_extend(get_bits(r, dod_classes[ones - 1].value_bits),
+                                         dod_classes[ones - 1].value_bits) : 0;
+        prev_delta += dod;
+        ts[i] = ts[i - 1] + prev_delta;
+    }
+}
+
+// Function to encode values as the XOR with their predecessor, reusing the previous bit window when it fits
+static void encode_values(BitWriter* w, const double* values, uint32_t count)
+{
+    uint64_t prev;
+    int prev_lead = -1, prev_trail = 0;
+    memcpy(&prev, &values[0], sizeof(prev));
+    put_bits(w, prev, 64);
+    for (uint32_t i = 1; i < count; i++)
+    {
+        uint64_t bits;
+        memcpy(&bits, &values[i], sizeof(bits));
+        uint64_t x = bits ^ prev;
+        prev = bits;
+        if (x == 0)
+        {
+            put_bits(w, 0, 1); // Same value as before
+            continue;
+        }
+        int lead = __builtin_clzll(x);
+        int trail = __builtin_ctzll(x);
+        lead = lead > 31 ? 31 : lead; // Stored in 5 bits
+        if (prev_lead >= 0 && lead >= prev_lead && trail >= prev_trail)
+        {
+            put_bits(w, 0x2, 2);
+            put_bits(w, x >> prev_trail, 64 - prev_lead - prev_trail);
+        }
+        else
+        {
+            int length = 64 - lead - trail;
+            put_bits(w, 0x3, 2);
+            put_bits(w, (uint64_t)lead, 5);
+            put_bits(w, (uint64_t)(length & 63), 6); // 64 is stored as 0
+            put_bits(w, x >> trail, length);
+            prev_lead = lead;
+            prev_trail = trail;
+        }
+    }
+}
+
+// Function to decode the values written by encode_values
+static void decode_values(BitReader* r, double* values, uint32_t count)
+{
+    uint64_t prev = get_bits(r, 64);
+    int lead = 0, trail = 0;
+    memcpy(&values[0], &prev, sizeof(prev));
+    for (uint32_t i = 1; i < count; i++)
+    {
+        if (get_bits(r, 1))
+        {
+            if (get_bits(r, 1))
+            {
+                lead = (int)get_bits(r, 5);
+                int length = (int)get_bits(r, 6);
+                length = length ? length : 64;
+                trail = 64 - lead - length;
+                trail = trail < 0 ? 0 : trail; // Only a corrupt stream gets here, the check rejects it
+            }
+            prev ^= get_bits(r, 64 - lead - trail) << trail;
+        }
+        memcpy(&values[i], &prev, sizeof(prev));
+    }
+}
+
+// Function to encode the columns of a block, returns the payload size in bytes
+size_t column_encode(const int64_t* ts, const double* temperature, const double* humidity, uint32_t count,
+                     uint8_t* out)
+{
+    BitWriter w = {.out = out};
+    if (count == 0)
+    {
+        return 0;
+    }
+    encode_timestamps(&w, ts, count);
+    encode_values(&w, temperature, count);
+    encode_values(&w, humidity, count);
+    if (w.bits > 0)
+    {
+        w.out[w.pos++] = (uint8_t)(w.acc << (8 - w.bits)); // Pad the last byte with zeros
+    }
+    return w.pos;
+}
+
+// Function to decode the columns of a block, returns -1 if the payload is too short
+int column_decode(const uint8_t* data, size_t size, uint32_t count, int64_t* ts, double* temperature,
+                  double* humidity)
+{
+    BitReader r = {.in = data, .size = size};
+    if (count == 0)
+    {
+        return 0;
+    }
+    decode_timestamps(&r, ts, count);
+    decode_values(&r, temperature, count);
+    decode_values(&r, humidity, count);
+    return r.overrun ? -1 : 0;
+}
+
+// Function to continue an FNV-1a hash over more bytes
+static uint32_t fnv1a(uint32_t h, const void* data, size_t size)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++)
+    {
+        h = (h ^ bytes[i]) * 16777619u;
+    }
+    return h;
+}
+
+// Function to checksum a block header and its payload, never 0
+static uint32_t block_check(const ColumnBlockHeader* header, const uint8_t* payload)
+{
+    ColumnBlockHeader copy = *header;
+    copy.check = 0;
+    uint32_t h = fnv1a(fnv1a(2166136261u, &copy, sizeof(copy)), payload, header->payload_size);
+    return h ? h : 1;
+}
+
+// Function to checksum a tail record, never 0 so a zeroed record reads as the end
+static uint32_t record_check(const ColumnTailRecord* record)
+{
+    ColumnTailRecord copy = *record;
+    copy.check = 0;
+    uint32_t h = fnv1a(2166136261u, &copy, sizeof(copy));
+    return h ? h : 1;
+}
+
+// Function to format the path of a day file, e.g. columns/20240131.col
+static void day_path(long day, char* path, size_t size)
+{
+    time_t start = (time_t)day * PARTITION_SECONDS;
+    struct tm tm_info;
+    gmtime_r(&start, &tm_info);
+    strftime(path, size, COLUMN_DIR "/%Y%m%d.col", &tm_info);
+}
+
+// Function to compare day numbers for qsort
+static int compare_day(const void* a, const void* b)
+{
+    long x = *(const long*)a, y = *(const long*)b;
+    return (x > y) - (x < y);
+}
+
+// Function to list the days that have a file, oldest first; the caller frees the array
+static long* list_days(size_t* count)
+{
+    size_t capacity = 64;
+    long* days = malloc(capacity * sizeof(long));
+    DIR* dir = opendir(COLUMN_DIR);
+    struct dirent* entry;
+
+    *count = 0;
+    while (days && dir && (entry = readdir(dir)) != NULL)
+    {
+        struct tm tm_info = {0};
+        char suffix[8];
+        if (sscanf(entry->d_name, "%4d%2d%2d.%7s", &tm_info.tm_year, &tm_info.tm_mon, &tm_info.tm_mday, suffix) != 4 ||
+            strcmp(suffix, "col") != 0)
+        {
+            continue;
+        }
+        tm_info.tm_year -= 1900;
+        tm_info.tm_mon -= 1;
+        if (*count == capacity)
+        {
+            long* bigger = realloc(days, capacity * 2 * sizeof(long));
+            if (!bigger)
+            {
+                break;
+            }
+            days = bigger;
+            capacity *= 2;
+        }
+        days[(*count)++] = partition_day((long)timegm(&tm_info));
+    }
+    if (dir)
+    {
+        closedir(dir);
+    }
+    if (days)
+    {
+        qsort(days, *count, sizeof(long), compare_day);
+    }
+    return days;
+}
+
+// Function to write a whole buffer at an offset
+static int pwrite_all(int fd, const void* data, size_t size, off_t offset)
+{
+    const char* bytes = (const char*)data;
+    while (size > 0)
+    {
+        ssize_t n = pwrite(fd, bytes, size, offset);
+        if (n <= 0)
+        {
+            return -1;
+        }
+        bytes += n;
+        size -= (size_t)n;
+        offset += n;
+    }
+    return 0;
+}
+
+// Function to read the next valid block of a day file, returns 0 at the end or at a torn block
+static int read_block(int fd, off_t size, off_t* offset, ColumnBlockHeader* header, uint8_t** payload,
+                      size_t* payload_capacity, int want_payload)
+{
+    if (*offset + (off_t)sizeof(*header) > size ||
+        pread(fd, header, sizeof(*header), *offset) != (ssize_t)sizeof(*header) ||
+        header->magic != COLUMN_BLOCK_MAGIC || header->count == 0 ||
+        *offset + (off_t)sizeof(*header) + header->payload_size > size)
+    {
+        return 0;
+    }
+    if (want_payload)
+    {
+        if (header->payload_size > *payload_capacity)
+        {
+            uint8_t* bigger = realloc(*payload, header->payload_size);
+            if (!bigger)
+            {
+                return 0;
+            }
+            *payload = bigger;
+            *payload_capacity = header->payload_size;
+        }
+        if (pread(fd, *payload, header->payload_size, *offset + (off_t)sizeof(*header)) !=
+                (ssize_t)header->payload_size ||
+            block_check(header, *payload) != header->check)
+        {
+            return 0;
+        }
+    }
+    *offset += (off_t)sizeof(*header) + header->payload_size;
+    return 1;
+}
+
+// Function to cut a day file after its last complete block sealed before the given generation
+static void repair_day_file(long day, uint64_t generation)
+{
+    char path[COLUMN_PATH_SIZE];
+    day_path(day, path, sizeof(path));
+    int fd = open(path, O_RDWR);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1)
+    {
+        if (fd != -1)
+        {
+            close(fd);
+        }
+        return;
+    }
+
+    ColumnBlockHeader header;
+    uint8_t* payload = NULL;
+    size_t capacity = 0;
+    off_t offset = 0, valid = 0;
+    while (read_block(fd, st.st_size, &offset, &header, &payload, &capacity, 1) && header.generation < generation)
+    {
+        valid = offset;
+    }
+    if (valid < st.st_size)
+    {
+        write_log("Column file %s: discarding %lld bytes of an interrupted seal", path,
+                  (long long)(st.st_size - valid));
+        if (ftruncate(fd, valid) == -1)
+        {
+            write_log("Failed to repair %s: %s", path, strerror(errno)); // Log error
+        }
+    }
+    free(payload);
+    close(fd);
+}
+
+// Function to spread a sensor id and day over the index
+static size_t block_hash(int sensor_id, long day, size_t size)
+{
+    uint64_t h = (uint64_t)(uint32_t)sensor_id * 0x9E3779B97F4A7C15ull ^ (uint64_t)day * 0xC2B2AE3D27D4EB4Full;
+    return (size_t)(h >> 32) & (size - 1);
+}
+
+// Function to rebuild the index from the open blocks, doubling it when it gets half full
+static int rebuild_index(ColumnState* state)
+{
+    size_t size = state->index_size ? state->index_size : 256;
+    while (state->block_count * 2 >= size)
+    {
+        size *= 2;
+    }
+    if (size != state->index_size)
+    {
+        uint32_t* bigger = realloc(state->index, size * sizeof(uint32_t));
+        if (!bigger)
+        {
+            return -1;
+        }
+        state->index = bigger;
+        state->index_size = size;
+    }
+    memset(state->index, 0, size * sizeof(uint32_t));
+    for (size_t b = 0; b < state->block_count; b++)
+    {
+        size_t i = block_hash(state->blocks[b].sensor_id, state->blocks[b].day, size);
+        while (state->index[i])
+        {
+            i = (i + 1) & (size - 1);
+        }
+        state->index[i] = (uint32_t)(b + 1);
+    }
+    return 0;
+}
+
+// Function to find the open block of a sensor and day, creating it on first use
+static OpenBlock* find_block(ColumnState* state, int sensor_id, long day)
+{
+    if ((state->block_count + 1) * 2 >= state->index_size && rebuild_index(state) == -1)
+    {
+        return NULL;
+    }
+    size_t mask = state->index_size - 1;
+    size_t i = block_hash(sensor_id, day, state->index_size);
+    for (; state->index[i]; i = (i + 1) & mask)
+    {
+        OpenBlock* block = &state->blocks[state->index[i] - 1];
+        if (block->sensor_id == sensor_id && block->day == day)
+        {
+            return block;
+        }
+    }
+
+    if (state->block_count == state->block_capacity)
+    {
+        size_t capacity = state->block_capacity ? state->block_capacity * 2 : 64;
+        OpenBlock* bigger = realloc(state->blocks, capacity * sizeof(OpenBlock));
+        if (!bigger)
+        {
+            return NULL;
+        }
+        state->blocks = bigger;
+        state->block_capacity = capacity;
+    }
+    OpenBlock* block = &state->blocks[state->block_count++];
+    memset(block, 0, sizeof(*block));
+    block->sensor_id = sensor_id;
+    block->day = day;
+    state->index[i] = (uint32_t)state->block_count;
+    return block;
+}
+
+// Function to add a reading to an open block, growing its columns as needed
+static int block_push(OpenBlock* block, int64_t ts, double temperature, double humidity)
+{
+    if (block->count == block->capacity)
+    {
+        uint32_t capacity = block->capacity ? block->capacity * 2 : COLUMN_INITIAL_READINGS;
+        int64_t* new_ts = realloc(block->ts, capacity * sizeof(int64_t));
+        block->ts = new_ts ? new_ts : block->ts;
+        double* new_temperature = realloc(block->temperature, capacity * sizeof(double));
+        block->temperature = new_temperature ? new_temperature : block->temperature;
+        double* new_humidity = realloc(block->humidity, capacity * sizeof(double));
+        block->humidity = new_humidity ? new_humidity : block->humidity;
+        if (!new_ts || !new_temperature || !new_humidity)
+        {
+            return -1;
+        }
+        block->capacity = capacity;
+    }
+    block->ts[block->count] = ts;
+    block->temperature[block->count] = temperature;
+    block->humidity[block->count] = humidity;
+    block->count++;
+    return 0;
+}
+
+// Function to add a reading to the open blocks, returns 1 if its block is full
+static int buffer_reading(ColumnState* state, int sensor_id, int64_t ts, double temperature, double humidity)
+{
+    OpenBlock* block = find_block(state, sensor_id, partition_day((long)ts));
+    if (!block || block_push(block, ts, temperature, humidity) == -1)
+    {
+        return -1;
+    }
+    state->buffered++;
+    return block->count >= COLUMN_BLOCK_READINGS;
+}
+
+// Function to release the columns of every open block
+static void clear_blocks(ColumnState* state)
+{
+    for (size_t b = 0; b < state->block_count; b++)
+    {
+        free(state->blocks[b].ts);
+        free(state->blocks[b].temperature);
+        free(state->blocks[b].humidity);
+    }
+    state->block_count = 0;
+    state->buffered = 0;
+    if (state->index)
+    {
+        memset(state->index, 0, state->index_size * sizeof(uint32_t));
+    }
+}
+
+// Function to encode an open block with its header into a buffer, returns the size
+static size_t build_block(const ColumnState* state, const OpenBlock* block, uint8_t* buffer)
+{
+    ColumnBlockHeader header = {
+        .magic = COLUMN_BLOCK_MAGIC,
+        .generation = state->generation,
+        .sensor_id = block->sensor_id,
+        .count = block->count,
+        .ts_min = block->ts[0],
+        .ts_max = block->ts[0],
+        .temperature_min = block->temperature[0],
+        .temperature_max = block->temperature[0],
+        .humidity_min = block->humidity[0],
+        .humidity_max = block->humidity[0],
+    };
+    for (uint32_t i = 1; i < block->count; i++)
+    {
+        header.ts_min = block->ts[i] < header.ts_min ? block->ts[i] : header.ts_min;
+        header.ts_max = block->ts[i] > header.ts_max ? block->ts[i] : header.ts_max;
+        header.temperature_min = block->temperature[i] < header.temperature_min ? block->temperature[i] : header.temperature_min;
+        header.temperature_max = block->temperature[i] > header.temperature_max ? block->temperature[i] : header.temperature_max;
+        header.humidity_min = block->humidity[i] < header.humidity_min ? block->humidity[i] : header.humidity_min;
+        header.humidity_max = block->humidity[i] > header.humidity_max ? block->humidity[i] : header.humidity_max;
+    }
+
+    uint8_t* payload = buffer + sizeof(header);
+    header.payload_size = (uint32_t)column_encode(block->ts, block->temperature, block->humidity, block->count, payload);
+    header.check = block_check(&header, payload);
+    memcpy(buffer, &header, sizeof(header));
+    return sizeof(header) + header.payload_size;
+}
+
+// Function to compare open blocks by day, then sensor id, so each day file is written once per seal
+static int compare_block(const void* a, const void* b)
+{
+    const OpenBlock* x = (const OpenBlock*)a;
+    const OpenBlock* y = (const OpenBlock*)b;
+    if (x->day != y->day)
+    {
+        return (x->day > y->day) - (x->day < y->day);
+    }
+    return (x->sensor_id > y->sensor_id) - (x->sensor_id < y->sensor_id);
+}
+
+// Function to write the tail header
+static int write_tail_header(int fd, uint64_t generation)
+{
+    ColumnTailHeader header = {.generation = generation};
+    memcpy(header.magic, COLUMN_TAIL_MAGIC, sizeof(header.magic));
+    return pwrite_all(fd, &header, sizeof(header), 0);
+}
+
+// Function to append every open block to its day file, then start a new tail generation.
+// A crash before the new generation is written leaves the tail to be replayed and the partial
+// blocks to be cut off on the next open; a crash after it only leaves stale tail records.
+static int seal_blocks(ColumnState* state)
+{
+    if (state->buffered == 0)
+    {
+        return 0;
+    }
+    qsort(state->blocks, state->block_count, sizeof(OpenBlock), compare_block);
+
+    uint32_t largest = 0;
+    for (size_t b = 0; b < state->block_count; b++)
+    {
+        largest = state->blocks[b].count > largest ? state->blocks[b].count : largest;
+    }
+    uint8_t* buffer = malloc(sizeof(ColumnBlockHeader) + COLUMN_ENCODED_MAX(largest));
+    long* days = malloc(state->block_count * sizeof(long)); // Files appended to, with their previous size
+    off_t* sizes = malloc(state->block_count * sizeof(off_t));
+    size_t file_count = 0;
+    int failed = !buffer || !days || !sizes;
+
+    flock(state->tail_fd, LOCK_EX); // Queries see either the open blocks in the tail or the sealed ones
+    int fd = -1;
+    off_t offset = 0;
+    for (size_t b = 0; b < state->block_count && !failed; b++)
+    {
+        const OpenBlock* block = &state->blocks[b];
+        if (fd == -1 || block->day != days[file_count - 1])
+        {
+            char path[COLUMN_PATH_SIZE];
+            if (fd != -1)
+            {
+                failed = (state->sync_level > 0 && fsync(fd) == -1) | (close(fd) == -1);
+                fd = -1;
+            }
+            day_path(block->day, path, sizeof(path));
+            fd = failed ? -1 : open(path, O_WRONLY | O_CREAT, 0644);
+            offset = fd == -1 ? -1 : lseek(fd, 0, SEEK_END);
+            if (offset == -1)
+            {
+                write_log("Failed to open column file %s: %s", path, strerror(errno)); // Log error
+                failed = 1;
+                break;
+            }
+            days[file_count] = block->day;
+            sizes[file_count++] = offset;
+        }
+        size_t size = build_block(state, block, buffer);
+        failed = pwrite_all(fd, buffer, size, offset) == -1;
+        offset += (off_t)size;
+    }
+    if (fd != -1)
+    {
+        failed |= (state->sync_level > 0 && fsync(fd) == -1) | (close(fd) == -1);
+    }
+
+    // The new generation in the tail header is the commit point of the seal
+    if (!failed && (write_tail_header(state->tail_fd, state->generation + 1) == -1 ||
+                    (state->sync_level > 0 && fsync(state->tail_fd) == -1)))
+    {
+        failed = 1;
+    }
+    if (failed)
+    {
+        write_log("Failed to seal %zu column readings: %s", state->buffered, strerror(errno)); // Log error
+        for (size_t f = 0; f < file_count; f++)
+        {
+            char path[COLUMN_PATH_SIZE];
+            day_path(days[f], path, sizeof(path));
+            if (truncate(path, sizes[f]) == -1)
+            {
+                write_log("Failed to roll back %s", path); // Recovery on the next open cuts it
+            }
+        }
+        rebuild_index(state); // The sort moved the blocks
+    }
+    else
+    {
+        state->generation++;
+        if (ftruncate(state->tail_fd, COLUMN_TAIL_HEADER_SIZE) == 0)
+        {
+            state->tail_size = COLUMN_TAIL_HEADER_SIZE; // Otherwise the stale records stay and are skipped
+        }
+        clear_blocks(state);
+    }
+    flock(state->tail_fd, LOCK_UN);
+
+    free(buffer);
+    free(days);
+    free(sizes);
+    return failed ? -1 : 0;
+}
+
+// Function to load the current generation of the tail into open blocks, returns the days it touches
+static int recover_tail(ColumnState* state, long** days, size_t* day_count)
+{
+    ColumnTailHeader header;
+    struct stat st;
+    *days = NULL;
+    *day_count = 0;
+    if (fstat(state->tail_fd, &st) == -1)
+    {
+        return -1;
+    }
+    if (st.st_size < COLUMN_TAIL_HEADER_SIZE ||
+        pread(state->tail_fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+        memcmp(header.magic, COLUMN_TAIL_MAGIC, sizeof(header.magic)) != 0)
+    {
+        // New store: generation 1, no readings
+        state->generation = 1;
+        state->tail_size = COLUMN_TAIL_HEADER_SIZE;
+        return write_tail_header(state->tail_fd, 1) == -1 || ftruncate(state->tail_fd, COLUMN_TAIL_HEADER_SIZE) == -1
+                   ? -1 : 0;
+    }
+    state->generation = header.generation;
+
+    ColumnTailRecord* chunk = malloc(COLUMN_TAIL_CHUNK * sizeof(ColumnTailRecord));
+    size_t day_capacity = 0;
+    off_t offset = COLUMN_TAIL_HEADER_SIZE;
+    int done = !chunk;
+    while (!done)
+    {
+        ssize_t n = pread(state->tail_fd, chunk, COLUMN_TAIL_CHUNK * sizeof(ColumnTailRecord), offset);
+        size_t records = n > 0 ? (size_t)n / sizeof(ColumnTailRecord) : 0;
+        done = records < COLUMN_TAIL_CHUNK;
+        for (size_t i = 0; i < records; i++)
+        {
+            const ColumnTailRecord* record = &chunk[i];
+            if (record->check == 0 || record->check != record_check(record))
+            {
+                done = 1; // Torn by a crash, this is where appending stopped
+                break;
+            }
+            offset += (off_t)sizeof(ColumnTailRecord);
+            if (record->generation != state->generation)
+            {
+                continue; // Sealed already, left behind by a crash before the tail was truncated
+            }
+            if (buffer_reading(state, record->sensor_id, record->timestamp, record->temperature, record->humidity) == -1)
+            {
+                free(chunk);
+                return -1;
+            }
+            long day = partition_day((long)record->timestamp);
+            if (*day_count == 0 || (*days)[*day_count - 1] != day)
+            {
+                if (*day_count == day_capacity)
+                {
+                    day_capacity = day_capacity ? day_capacity * 2 : 16;
+                    long* bigger = realloc(*days, day_capacity * sizeof(long));
+                    if (!bigger)
+                    {
+                        free(chunk);
+                        return -1;
+                    }
+                    *days = bigger;
+                }
+                (*days)[(*day_count)++] = day;
+            }
+        }
+    }
+    free(chunk);
+    state->tail_size = offset;
+    return ftruncate(state->tail_fd, offset); // Drop a torn record so appends continue after the valid ones
+}
+
+// Function to release the open blocks, the scratch space and the tail of the writer
+static void column_close(StorageBackend* backend)
+{
+    ColumnState* state = backend->state;
+    if (state->tail_fd != -1)
+    {
+        seal_blocks(state); // Anything left unsealed is replayed from the tail on the next open
+        close(state->tail_fd);
+    }
+    clear_blocks(state);
+    free(state->blocks);
+    free(state->index);
+    free(state->records);
+    free(state);
+    backend->state = NULL;
+}
+
+// Function to open the column store, replaying the tail and repairing the files of an interrupted seal
+static int column_open(StorageBackend* backend)
+{
+    ColumnState* state = calloc(1, sizeof(ColumnState));
+    if (!state)
+    {
+        return -1;
+    }
+    backend->state = state;
+    state->sync_level = backend->config->sync_level;
+    state->tail_fd = -1;
+
+    if (mkdir(COLUMN_DIR, 0755) == -1 && errno != EEXIST)
+    {
+        write_log("Failed to create %s: %s", COLUMN_DIR, strerror(errno)); // Log error
+        column_close(backend);
+        return -1;
+    }
+    state->tail_fd = open(COLUMN_TAIL_PATH, O_RDWR | O_CREAT, 0644);
+    long* tail_days = NULL;
+    size_t tail_day_count = 0;
+    if (state->tail_fd == -1 || recover_tail(state, &tail_days, &tail_day_count) == -1)
+    {
+        write_log("Failed to open %s: %s", COLUMN_TAIL_PATH, strerror(errno)); // Log error
+        free(tail_days);
+        if (state->tail_fd != -1)
+        {
+            close(state->tail_fd);
+            state->tail_fd = -1; // Nothing may be sealed from a partly loaded tail
+        }
+        column_close(backend);
+        return -1;
+    }
+
+    // Blocks of the current generation come from a seal that never committed. The newest files are
+    // checked too: without a synced tail (sync off or normal) a power loss can leave a torn block.
+    for (size_t d = 0; d < tail_day_count; d++)
+    {
+        repair_day_file(tail_days[d], state->generation);
+    }
+    size_t file_count = 0;
+    long* file_days = list_days(&file_count);
+    for (size_t d = file_count > COLUMN_RECOVER_FILES ? file_count - COLUMN_RECOVER_FILES : 0;
+         file_days && d < file_count; d++)
+    {
+        repair_day_file(file_days[d], state->generation);
+    }
+    free(file_days);
+    free(tail_days);
+
+    if (state->buffered)
+    {
+        write_log("Column store: %zu unsealed readings recovered from %s", state->buffered, COLUMN_TAIL_PATH);
+    }
+    write_log("Column store opened in %s", COLUMN_DIR);
+    return 0;
+}
+
+// Function to append a batch to the tail and the open blocks, sealing them when they are full.
+// Rollup windows are not kept by this backend.
+static int column_append(StorageBackend* backend, const StorageBatch* batch)
+{
+    ColumnState* state = backend->state;
+    if (batch->count == 0)
+    {
+        return 0;
+    }
+
+    if ((size_t)batch->count > state->record_capacity)
+    {
+        ColumnTailRecord* bigger = realloc(state->records, batch->count * sizeof(ColumnTailRecord));
+        if (!bigger)
+        {
+            return -1;
+        }
+        state->records = bigger;
+        state->record_capacity = batch->count;
+    }
+    for (int i = 0; i < batch->count; i++)
+    {
+        ColumnTailRecord* record = &state->records[i];
+        const SensorReading* reading = &batch->readings[i];
+        memset(record, 0, sizeof(*record));
+        record->sensor_id = reading->sensor_id;
+        record->temperature = reading->temperature;
+        record->humidity = reading->humidity;
+        record->timestamp = reading->timestamp;
+        record->generation = state->generation;
+        record->check = record_check(record);
+    }
+
+    // The tail makes the batch durable, one write per batch and a sync only at the highest levels
+    size_t bytes = batch->count * sizeof(ColumnTailRecord);
+    if (pwrite_all(state->tail_fd, state->records, bytes, state->tail_size) == -1 ||
+        (state->sync_level >= 2 && fdatasync(state->tail_fd) == -1))
+    {
+        write_log("Failed to append to %s: %s", COLUMN_TAIL_PATH, strerror(errno)); // Log error
+        if (ftruncate(state->tail_fd, state->tail_size) == -1)
+        {
+            write_log("Failed to roll back %s", COLUMN_TAIL_PATH); // Log error
+        }
+        return -1;
+    }
+    state->tail_size += (off_t)bytes;
+
+    int full = 0;
+    for (int i = 0; i < batch->count; i++)
+    {
+        const SensorReading* reading = &batch->readings[i];
+        int rc = buffer_reading(state, reading->sensor_id, reading->timestamp, reading->temperature, reading->humidity);
+        if (rc == -1)
+        {
+            // The batch is in the tail already, reopening the store rebuilds the blocks from it
+            write_log("Out of memory buffering column readings, reopening the store");
+            backend->connected = 0;
+            return 0;
+        }
+        full |= rc;
+    }
+    if (full || state->buffered >= COLUMN_SEAL_READINGS)
+    {
+        seal_blocks(state); // Retried on the next append if it fails, the tail keeps the readings
+    }
+    return 0;
+}
+
+// Function to seal every open block
+static int column_flush(StorageBackend* backend)
+{
+    return seal_blocks(backend->state);
+}
+
+// Function to delete the day files that fell out of the retention window
+static int column_expire(StorageBackend* backend, long oldest_day)
+{
+    (void)backend;
+    size_t count = 0;
+    long* days = list_days(&count);
+    int dropped = 0;
+    for (size_t d = 0; days && d < count && days[d] < oldest_day; d++)
+    {
+        char path[COLUMN_PATH_SIZE];
+        day_path(days[d], path, sizeof(path));
+        if (unlink(path) == 0)
+        {
+            write_log("Dropped expired column file %s", path);
+            dropped++;
+        }
+    }
+    free(days);
+    return dropped;
+}
+
+// Function to open the tail for the shared lock of one query thread
+static void* column_open_reader(StorageBackend* backend)
+{
+    (void)backend;
+    ColumnReader* reader = malloc(sizeof(ColumnReader));
+    if (!reader)
+    {
+        return NULL;
+    }
+    reader->tail_fd = open(COLUMN_TAIL_PATH, O_RDONLY);
+    if (reader->tail_fd == -1)
+    {
+        write_log("Failed to open %s for queries: %s", COLUMN_TAIL_PATH, strerror(errno)); // Log error
+        free(reader);
+        return NULL;
+    }
+    return reader;
+}
+
+// Function to close the tail of one query thread
+static void column_close_reader(void* handle)
+{
+    ColumnReader* reader = handle;
+    close(reader->tail_fd);
+    free(reader);
+}
+
+// Function to append a row to a growable row set
+static int add_row(ColumnRows* rows, int64_t ts, double temperature, double humidity)
+{
+    if (rows->count == rows->capacity)
+    {
+        size_t capacity = rows->capacity ? rows->capacity * 2 : 256;
+        ColumnRow* bigger = realloc(rows->rows, capacity * sizeof(ColumnRow));
+        if (!bigger)
+        {
+            return -1;
+        }
+        rows->rows = bigger;
+        rows->capacity = capacity;
+    }
+    rows->rows[rows->count] = (ColumnRow){.ts = ts, .temperature = temperature, .humidity = humidity,
+                                          .seq = rows->count};
+    rows->count++;
+    return 0;
+}
+
+// Function to compare rows by timestamp, then by stored order
+static int compare_row(const void* a, const void* b)
+{
+    const ColumnRow* x = (const ColumnRow*)a;
+    const ColumnRow* y = (const ColumnRow*)b;
+    if (x->ts != y->ts)
+    {
+        return (x->ts > y->ts) - (x->ts < y->ts);
+    }
+    return (x->seq > y->seq) - (x->seq < y->seq);
+}
+
+// Function to collect the current tail readings of a sensor between two timestamps
+static int read_tail_rows(int fd, int sensor_id, long from, long to, ColumnRows* rows)
+{
+    ColumnTailHeader header;
+    if (pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header))
+    {
+        return 0; // Empty store
+    }
+    ColumnTailRecord* chunk = malloc(COLUMN_TAIL_CHUNK * sizeof(ColumnTailRecord));
+    off_t offset = COLUMN_TAIL_HEADER_SIZE;
+    int rc = chunk ? 0 : -1;
+    int done = !chunk;
+    while (!done)
+    {
+        ssize_t n = pread(fd, chunk, COLUMN_TAIL_CHUNK * sizeof(ColumnTailRecord), offset);
+        size_t records = n > 0 ? (size_t)n / sizeof(ColumnTailRecord) : 0;
+        int torn = 0;
+        for (size_t i = 0; i < records && !torn && rc == 0; i++)
+        {
+            const ColumnTailRecord* record = &chunk[i];
+            if (record->check != record_check(record))
+            {
+                torn = 1; // Being appended right now
+            }
+            else if (record->generation == header.generation && record->sensor_id == sensor_id &&
+                     record->timestamp >= from && record->timestamp <= to &&
+                     add_row(rows, record->timestamp, record->temperature, record->humidity) == -1)
+            {
+                rc = -1;
+            }
+        }
+        done = torn || rc == -1 || records < COLUMN_TAIL_CHUNK;
+        offset += (off_t)(records * sizeof(ColumnTailRecord));
+    }
+    free(chunk);
+    return rc;
+}
+
+// Function to collect the sealed readings of a sensor in one day file, skipping blocks by their bounds
+static int read_day_rows(long day, int sensor_id, long from, long to, ColumnRows* rows)
+{
+    char path[COLUMN_PATH_SIZE];
+    day_path(day, path, sizeof(path));
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1)
+    {
+        if (fd != -1)
+        {
+            close(fd);
+        }
+        return 0; // Expired meanwhile
+    }
+
+    ColumnBlockHeader header;
+    uint8_t* payload = NULL;
+    size_t capacity = 0;
+    int64_t* ts = NULL;
+    double* temperature = NULL;
+    double* humidity = NULL;
+    uint32_t columns = 0; // Readings the decode arrays hold
+    int rc = 0;
+    off_t offset = 0;
+    while (rc == 0 && read_block(fd, st.st_size, &offset, &header, &payload, &capacity, 0))
+    {
+        if (header.sensor_id != sensor_id || header.ts_max < from || header.ts_min > to)
+        {
+            continue;
+        }
+        if (header.count > columns)
+        {
+            free(ts);
+            free(temperature);
+            free(humidity);
+            ts = malloc(header.count * sizeof(int64_t));
+            temperature = malloc(header.count * sizeof(double));
+            humidity = malloc(header.count * sizeof(double));
+            columns = ts && temperature && humidity ? header.count : 0;
+            if (!columns)
+            {
+                rc = -1;
+                break;
+            }
+        }
+        off_t start = offset - (off_t)(sizeof(header) + header.payload_size);
+        if (!read_block(fd, st.st_size, &start, &header, &payload, &capacity, 1) ||
+            column_decode(payload, header.payload_size, header.count, ts, temperature, humidity) == -1)
+        {
+            write_log("Corrupt block in %s at offset %lld", path, (long long)start); // Log error
+            break;
+        }
+        for (uint32_t i = 0; i < header.count && rc == 0; i++)
+        {
+            if (ts[i] >= from && ts[i] <= to)
+            {
+                rc = add_row(rows, ts[i], temperature[i], humidity[i]);
+            }
+        }
+    }
+    free(ts);
+    free(temperature);
+    free(humidity);
+    free(payload);
+    close(fd);
+    return rc;
+}
+
+// Function to stream the readings of a sensor between two timestamps, oldest first.
+// Days hold disjoint time ranges, so rows are sorted and collected one day at a time; they are only handed
+// to fn once the tail lock is released, a slow client must not hold up seal_blocks() in the writer.
+static int column_query_range(void* handle, int sensor_id, long from, long to, int limit, StorageRangeFn fn, void* ctx)
+{
+    ColumnReader* reader = handle;
+    ColumnRows tail = {0}, rows = {0}, result = {0};
+    size_t day_count = 0;
+    long* days = NULL;
+    int rc = 0, emitted = 0;
+
+    flock(reader->tail_fd, LOCK_SH); // No seal moves readings from the tail to the files meanwhile
+    if (read_tail_rows(reader->tail_fd, sensor_id, from, to, &tail) == -1 || !(days = list_days(&day_count)))
+    {
+        rc = -1;
+    }
+
+    // Candidate days: files in the range plus the days of unsealed readings
+    for (size_t r = 0; rc == 0 && r < tail.count; r++)
+    {
+        long* bigger = realloc(days, (day_count + 1) * sizeof(long));
+        if (!bigger)
+        {
+            rc = -1;
+            break;
+        }
+        days = bigger;
+        days[day_count++] = partition_day((long)tail.rows[r].ts);
+    }
+    if (rc == 0)
+    {
+        qsort(days, day_count, sizeof(long), compare_day);
+    }
+
+    long first = partition_day(from), last = partition_day(to);
+    for (size_t d = 0; rc == 0 && d < day_count && emitted < limit; d++)
+    {
+        if (days[d] < first || days[d] > last || (d > 0 && days[d] == days[d - 1]))
+        {
+            continue;
+        }
+        rows.count = 0;
+        rc = read_day_rows(days[d], sensor_id, from, to, &rows);
+        for (size_t r = 0; rc == 0 && r < tail.count; r++)
+        {
+            if (partition_day((long)tail.rows[r].ts) == days[d])
+            {
+                rc = add_row(&rows, tail.rows[r].ts, tail.rows[r].temperature, tail.rows[r].humidity);
+            }
+        }
+        qsort(rows.rows, rows.count, sizeof(ColumnRow), compare_row);
+        for (size_t r = 0; rc == 0 && r < rows.count && emitted < limit; r++, emitted++)
+        {
+            rc = add_row(&result, rows.rows[r].ts, rows.rows[r].temperature, rows.rows[r].humidity);
+        }
+    }
+    flock(reader->tail_fd, LOCK_UN);
+
+    for (size_t r = 0; rc == 0 && r < result.count; r++)
+    {
+        SensorReading reading = {.sensor_id = sensor_id, .temperature = result.rows[r].temperature,
+                                 .humidity = result.rows[r].humidity, .timestamp = (long)result.rows[r].ts};
+        if (fn(ctx, &reading) == -1)
+        {
+            break; // The client went away
+        }
+    }
+
+    free(days);
+    free(tail.rows);
+    free(rows.rows);
+    free(result.rows);
+    return rc;
+}
+
+const StorageBackendOps column_backend_ops = {
+    .name = "column",
+    .open = column_open,
+    .append = column_append,
+    .flush = column_flush,
+    .expire = column_expire,
+    .close = column_close,
+    .open_reader = column_open_reader,
+    .query_range = column_query_range,
+    .query_rollup = NULL, // Rollup windows are only kept by the sqlite backend
+    .close_reader = column_close_reader,
+};
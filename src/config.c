@@ -0,0 +1,320 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <getopt.h>
+#include "config.h"
+
+// Function to print the command line usage of the gateway
+void print_usage(const char* prog)
+{
+    fprintf(stderr, "Usage: %s [options] <port>\n", prog);
+    fprintf(stderr, "  -l, --event-loops <n>   Number of epoll event loops (default %d)\n", DEFAULT_EVENT_LOOPS);
+    fprintf(stderr, "  -w, --workers <n>       Number of reading worker threads (default %d)\n", DEFAULT_WORKERS);
+    fprintf(stderr, "  -b, --batch-size <n>    Readings per database transaction (default %d)\n", DEFAULT_BATCH_SIZE);
+    fprintf(stderr, "  -f, --flush-ms <ms>     Maximum time before a batch is committed (default %d)\n", DEFAULT_FLUSH_MS);
+    fprintf(stderr, "  -s, --sync <level>      SQLite synchronous level: off, normal, full, extra (default %s)\n",
+            sync_level_name(DEFAULT_SYNC_LEVEL));
+    fprintf(stderr, "  -q, --queue-size <n>    Readings buffered for the storage writer (default %d)\n", DEFAULT_QUEUE_SIZE);
+    fprintf(stderr, "  -m, --log-max-mb <n>    Rotate gateway.log at this size (default %d)\n", DEFAULT_LOG_MAX_MB);
+    fprintf(stderr, "  -R, --log-rotate-s <s>  Also rotate gateway.log at this age (default off)\n");
+    fprintf(stderr, "  -F, --log-flush-ms <ms> Maximum time a log entry stays buffered (default %d)\n", DEFAULT_LOG_FLUSH_MS);
+    fprintf(stderr, "  -z, --log-compress      Compress rotated log files with gzip\n");
+    fprintf(stderr, "  -D, --retention-days <n> Drop stored readings older than n days (default keep all)\n");
+    fprintf(stderr, "  -Q, --query-threads <n> Concurrent clients of the query socket (default %d)\n",
+            DEFAULT_QUERY_THREADS);
+    fprintf(stderr, "  -S, --spool-max-mb <n>  Disk for readings buffered while the database is down (default %d)\n",
+            DEFAULT_SPOOL_MAX_MB);
+    fprintf(stderr, "  -B, --backend <name>    Storage backend: sqlite or column (default %s)\n", DEFAULT_BACKEND);
+    fprintf(stderr, "  -T, --shutdown-s <s>    Longest drain of queued readings on SIGINT/SIGTERM (default %d)\n",
+            DEFAULT_SHUTDOWN_S);
+    fprintf(stderr, "  -H, --takeover          Take the sockets over from the gateway running in this directory\n");
+    fprintf(stderr, "  -P, --metrics-s <s>     Log a metrics summary this often (default %d)\n", DEFAULT_METRICS_S);
+    fprintf(stderr, "  -r, --sensor-rate <n>   Readings per second accepted from one sensor (default no limit)\n");
+    fprintf(stderr, "  -G, --global-rate <n>   Readings per second accepted from all sensors (default no limit)\n");
+    fprintf(stderr, "  -O, --overload <policy> Readings over a limit: drop, sample or coalesce (default %s)\n",
+            overload_policy_name(OVERLOAD_DROP));
+    fprintf(stderr, "  -a, --acceptors <n>     Accepting threads, each on its own SO_REUSEPORT socket (default %d)\n",
+            DEFAULT_ACCEPTORS);
+    fprintf(stderr, "  -k, --backlog <n>       Pending connections queued per listening socket (default %d)\n",
+            DEFAULT_BACKLOG);
+    fprintf(stderr, "  -W, --handshake-ms <ms> Close new nodes that send no ID frame within this time (default %d)\n",
+            DEFAULT_HANDSHAKE_MS);
+    fprintf(stderr, "  -N, --max-sensors <n>   Distinct sensor IDs registered at most (default %d)\n",
+            DEFAULT_MAX_SENSORS);
+    fprintf(stderr, "  -C, --clock-skew-s <s>  Node timestamps further off are replaced by arrival time (default %d)\n",
+            DEFAULT_CLOCK_SKEW_S);
+}
+
+static const char* sync_levels[] = {"off", "normal", "full", "extra"}; // Indexed by SQLite synchronous value
+
+static const char* overload_policies[] = {"drop", "sample", "coalesce"}; // Indexed by OVERLOAD_* value
+
+// Function to return the name of a SQLite synchronous level
+const char* sync_level_name(int level)
+{
+    return sync_levels[level];
+}
+
+// Function to return the name of an overload policy
+const char* overload_policy_name(int policy)
+{
+    return overload_policies[policy];
+}
+
+// Function to parse a SQLite synchronous level name
+static int parse_sync_level(const char* value, int* out)
+{
+    for (int i = 0; i < (int)(sizeof(sync_levels) / sizeof(sync_levels[0])); i++)
+    {
+        if (strcasecmp(value, sync_levels[i]) == 0)
+        {
+            *out = i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Function to parse an overload policy name
+static int parse_overload_policy(const char* value, int* out)
+{
+    for (int i = 0; i < (int)(sizeof(overload_policies) / sizeof(overload_policies[0])); i++)
+    {
+        if (strcasecmp(value, overload_policies[i]) == 0)
+        {
+            *out = i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Function to parse a strictly positive integer option value
+static int parse_positive(const char* value, int* out)
+{
+    char* end = NULL;
+    long n = strtol(value, &end, 10);
+    if (end == value || *end != '\0' || n <= 0 || n > 1000000)
+    {
+        return -1; // Reject empty, trailing garbage and out of range values
+    }
+    *out = (int)n;
+    return 0;
+}
+
+// Function to fill the gateway configuration from the command line
+int parse_config(int argc, char *argv[], GatewayConfig* config)
+{
+    static const struct option long_options[] = {
+        {"event-loops", required_argument, NULL, 'l'},
+        {"workers", required_argument, NULL, 'w'},
+        {"batch-size", required_argument, NULL, 'b'},
+        {"flush-ms", required_argument, NULL, 'f'},
+        {"sync", required_argument, NULL, 's'},
+        {"queue-size", required_argument, NULL, 'q'},
+        {"log-max-mb", required_argument, NULL, 'm'},
+        {"log-rotate-s", required_argument, NULL, 'R'},
+        {"log-flush-ms", required_argument, NULL, 'F'},
+        {"log-compress", no_argument, NULL, 'z'},
+        {"retention-days", required_argument, NULL, 'D'},
+        {"query-threads", required_argument, NULL, 'Q'},
+        {"spool-max-mb", required_argument, NULL, 'S'},
+        {"backend", required_argument, NULL, 'B'},
+        {"shutdown-s", required_argument, NULL, 'T'},
+        {"takeover", no_argument, NULL, 'H'},
+        {"metrics-s", required_argument, NULL, 'P'},
+        {"sensor-rate", required_argument, NULL, 'r'},
+        {"global-rate", required_argument, NULL, 'G'},
+        {"overload", required_argument, NULL, 'O'},
+        {"acceptors", required_argument, NULL, 'a'},
+        {"backlog", required_argument, NULL, 'k'},
+        {"handshake-ms", required_argument, NULL, 'W'},
+        {"max-sensors", required_argument, NULL, 'N'},
+        {"clock-skew-s", required_argument, NULL, 'C'},
+        {NULL, 0, NULL, 0}
+    };
+
+    config->port = 0;
+    config->event_loops = DEFAULT_EVENT_LOOPS;
+    config->workers = DEFAULT_WORKERS;
+    config->batch_size = DEFAULT_BATCH_SIZE;
+    config->flush_ms = DEFAULT_FLUSH_MS;
+    config->sync_level = DEFAULT_SYNC_LEVEL;
+    config->queue_size = DEFAULT_QUEUE_SIZE;
+    config->log_max_mb = DEFAULT_LOG_MAX_MB;
+    config->log_rotate_s = 0;
+    config->log_flush_ms = DEFAULT_LOG_FLUSH_MS;
+    config->log_compress = 0;
+    config->retention_days = 0;
+    config->query_threads = DEFAULT_QUERY_THREADS;
+    config->spool_max_mb = DEFAULT_SPOOL_MAX_MB;
+    config->backend = DEFAULT_BACKEND;
+    config->shutdown_s = DEFAULT_SHUTDOWN_S;
+    config->takeover = 0;
+    config->metrics_s = DEFAULT_METRICS_S;
+    config->sensor_rate = 0;
+    config->global_rate = 0;
+    config->overload_policy = OVERLOAD_DROP;
+    config->acceptors = DEFAULT_ACCEPTORS;
+    config->backlog = DEFAULT_BACKLOG;
+    config->handshake_ms = DEFAULT_HANDSHAKE_MS;
+    config->max_sensors = DEFAULT_MAX_SENSORS;
+    config->clock_skew_s = DEFAULT_CLOCK_SKEW_S;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "l:w:b:f:s:q:m:R:F:zD:Q:S:B:T:HP:r:G:O:a:k:W:N:C:", long_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'l':
+            if (parse_positive(optarg, &config->event_loops) == -1)
+            {
+                return -1;
+            }
+            break;
+        case 'w':
+            if (parse_positive(optarg, &config->workers) == -1)
+            {
+                return -1;
+            }
+            break;
+        case 'b':
+            if (parse_positive(optarg, &config->batch_size) == -1)
+            {
+                return -1;
+            }
+            break;
+        case 'f':
+            if (parse_positive(optarg, &config->flush_ms) == -1)
+            {
+                return -1;
+            }
+            break;
+        case 's':
+            if (parse_sync_level(optarg, &config->sync_level) == -1)
+            {
+                return -1;
+            }
+            break;
+        case 'q':
+            if (parse_positive(optarg, &config->queue_size) == -1)
+            {
+                return -1;
+            }
+            break;
+        case 'm':
+            if (parse_positive(optarg, &config->log_max_mb) == -1)
+            {
+                return -1;
+            }
+            break;
+        case 'R':
+            if (parse_positive(optarg, &config->log_rotate_s) == -1)
+            {
+                return -1;
+            }
+            break;
+        case 'F':
+            if (parse_positive(optarg, &config->log_flush_ms) == -1)
+            {
+                return -1;
+            }
+            break;
+        case 'z':
+            config->log_compress = 1;
+            break;
+        case 'D':
+            if (parse_positive(optarg, &config->retention_days) == -1)
+            {
+                return -1;
+            }
+            break;
+        case 'Q':
+            if (parse_positive(optarg, &config->query_threads) == -1)
+            {
+                return -1;
+            }
+            break;
+        case 'S':
+            if (parse_positive(optarg, &config->spool_max_mb) == -1)
+            {
+                return -1;
+            }
+            break;
+        case 'B':
+            config->backend = optarg; // Checked against the known backends by storage_backend_init()
+            break;
+        case 'T':
+            if (parse_positive(optarg, &config->shutdown_s) == -1)
+            {
+                return -1;
+            }
+            break;
+        case 'H':
+            config->takeover = 1;
+            break;
+        case 'P':
+            if (parse_positive(optarg, &config->metrics_s) == -1)
+            {
+                return -1;
+            }
+            break;
+        case 'r':
+            if (parse_positive(optarg, &config->sensor_rate) == -1)
+            {
+                return -1;
+            }
+            break;
+        case 'G':
+            if (parse_positive(optarg, &config->global_rate) == -1)
+            {
+                return -1;
+            }
+            break;
+        case 'O':
+            if (parse_overload_policy(optarg, &config->overload_policy) == -1)
+            {
+                return -1;
+            }
+            break;
+        case 'a':
+            if (parse_positive(optarg, &config->acceptors) == -1 || config->acceptors > MAX_ACCEPTORS)
+            {
+                return -1;
+            }
+            break;
+        case 'k':
+            if (parse_positive(optarg, &config->backlog) == -1)
+            {
+                return -1;
+            }
+            break;
+        case 'W':
+            if (parse_positive(optarg, &config->handshake_ms) == -1)
+            {
+                return -1;
+            }
+            break;
+        case 'N':
+            if (parse_positive(optarg, &config->max_sensors) == -1)
+            {
+                return -1;
+            }
+            break;
+        case 'C':
+            if (parse_positive(optarg, &config->clock_skew_s) == -1)
+            {
+                return -1;
+            }
+            break;
+        default:
+            return -1; // Unknown option or missing argument
+        }
+    }
+
+    if (optind != argc - 1 || parse_positive(argv[optind], &config->port) == -1 || config->port > 65535)
+    {
+        return -1; // Exactly one positional argument (the port) is required
+    }
+    return 0;
+}
\ No newline at end of file
@@ -1,116 +1,413 @@
+#define _GNU_SOURCE // pthread_timedjoin_np
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <errno.h>
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
 #include "connection_manager.h"
 #include "log.h"
-#include "sensor_handler.h"
+#include "event_loop.h"
+#include "sensor_registry.h"
 #include "socket_utils.h"
+#include "sensor_parser.h"
+#include "metrics.h"
 
-#define BUFF_SIZE 1024
-#define LISTEN_BACKLOG 5
+#define ID_FRAME_MAX 64 // Longest ID frame, "ID:<id>,BIN:<version>\r\n" with both numbers at their widest
+#define MAX_EVENTS 64 // Events handled per epoll_wait call
 
-// Function to manage connections from sensor nodes
-void* connection_manager(void* arg)
+typedef struct Handshake
 {
-    SharedData* shared = (SharedData*)arg; // Shared data between threads
-    struct sockaddr_in client_addr; // Client address structure
+    int fd;
+    struct sockaddr_in addr;
+    char id_frame[ID_FRAME_MAX]; // ID bytes received so far, an ID may arrive over several segments
+    size_t length;
+    int64_t accepted_ns;
+    int64_t deadline_ns; // The node is closed if its ID frame has not come by then
+    struct Handshake* prev;
+    struct Handshake* next;
+} Handshake;
+
+typedef struct
+{
+    pthread_t thread;
+    int listen_fd; // Own SO_REUSEPORT socket, the kernel spreads new connections over the acceptors
+    int epoll_fd; // Listening socket, wakeup and the nodes that have not sent their ID yet
+    Handshake* oldest; // Pending handshakes in accept order, which is also deadline order
+    Handshake* newest;
+    SharedData* shared;
+} Acceptor;
+
+static pthread_once_t wake_once = PTHREAD_ONCE_INIT;
+static int wake_fd = -1; // Written by connection_manager_stop(), the listening socket may live on in a new process
+static Acceptor* acceptors = NULL;
+static int acceptor_total = 0;
+static _Atomic int start_failed = 0; // Stops the acceptors of a failed start without touching should_exit
 
-    // Create server socket
-    int server_fd = create_server_socket(shared->port);
-    if (server_fd == -1)
+// Function to create the descriptor that interrupts the accept wait, once per process
+static void create_wake_fd(void)
+{
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+}
+
+// Function to take a pending handshake off the acceptor's list and epoll set, the socket stays open
+static void remove_handshake(Acceptor* acceptor, Handshake* handshake)
+{
+    epoll_ctl(acceptor->epoll_fd, EPOLL_CTL_DEL, handshake->fd, NULL);
+    if (handshake->prev)
     {
-        return NULL; // Exit if socket creation fails
+        handshake->prev->next = handshake->next;
     }
+    else
+    {
+        acceptor->oldest = handshake->next;
+    }
+    if (handshake->next)
+    {
+        handshake->next->prev = handshake->prev;
+    }
+    else
+    {
+        acceptor->newest = handshake->prev;
+    }
+}
 
-    // Main loop to accept connections from sensor nodes
-    while (!shared->should_exit)
+// Function to close a node during the handshake
+static void reject_handshake(Acceptor* acceptor, Handshake* handshake)
+{
+    remove_handshake(acceptor, handshake);
+    close(handshake->fd);
+    free(handshake);
+    metrics_count(METRIC_CONNECTIONS_REJECTED, 1);
+}
+
+// Function to accept every queued connection and wait for their ID frames without blocking the accept path
+static void accept_pending(Acceptor* acceptor)
+{
+    struct sockaddr_in client_addr; // Client address structure
+    int client_fd;
+    int handshake_ms = acceptor->shared->config.handshake_ms;
+
+    // The socket is non-blocking, so drain the accept queue until it is empty
+    while ((client_fd = accept_client_connection(acceptor->listen_fd, &client_addr)) != -1)
     {
-        // Accept connection from client
-        int client_fd = accept_client_connection(server_fd, &client_addr);
-        if (client_fd == -1)
+        Handshake* handshake = malloc(sizeof(Handshake));
+        if (!handshake)
         {
-            continue; // Continue loop if connection acceptance fails
+            close(client_fd);
+            metrics_count(METRIC_CONNECTIONS_REJECTED, 1);
+            continue;
         }
+        handshake->fd = client_fd;
+        handshake->addr = client_addr;
+        handshake->length = 0;
+        handshake->accepted_ns = metrics_now_ns();
+        handshake->deadline_ns = handshake->accepted_ns + handshake_ms * 1000000LL;
 
-        char buffer[BUFF_SIZE];
-        memset(buffer, 0, BUFF_SIZE); // Clear buffer
-        int bytes_read = read(client_fd, buffer, BUFF_SIZE); // Read data from client
-        if (bytes_read <= 0)
+        struct epoll_event ev = {.events = EPOLLIN | EPOLLRDHUP, .data.ptr = handshake};
+        if (epoll_ctl(acceptor->epoll_fd, EPOLL_CTL_ADD, client_fd, &ev) == -1)
         {
-            close(client_fd); // Close connection if read fails
+            close(client_fd);
+            free(handshake);
+            metrics_count(METRIC_CONNECTIONS_REJECTED, 1);
             continue;
         }
-
-        int sensor_id;
-        // Check sensor ID format
-        if (sscanf(buffer, "ID:%d", &sensor_id) != 1)
+        handshake->next = NULL;
+        handshake->prev = acceptor->newest;
+        if (acceptor->newest)
         {
-            write_log("Invalid sensor ID format"); // Log if ID format is invalid
-            close(client_fd); // Close connection
-            continue;
+            acceptor->newest->next = handshake;
         }
+        else
+        {
+            acceptor->oldest = handshake;
+        }
+        acceptor->newest = handshake;
+    }
+}
 
-        pthread_mutex_lock(&shared->sensor_data.mutex); // Lock mutex to access shared data
+// Function to register a node that sent a valid ID frame and hand its socket to an event loop; readings sent
+// after the ID are still in the socket and read by that loop, the acceptor never waits on a worker
+static void register_sensor(SharedData* shared, Handshake* handshake)
+{
+    int client_fd = handshake->fd;
+    int sensor_id;
+    int binary_version; // Framing the node asked for, 0 keeps the text protocol
+    size_t id_length;
+    // Check sensor ID format
+    if (parse_id_frame(handshake->id_frame, handshake->length, &sensor_id, &binary_version, &id_length) == -1 ||
+        id_length != handshake->length)
+    {
+        write_log("Invalid sensor ID format"); // Log if ID format is invalid
+        close(client_fd); // Close connection
+        metrics_count(METRIC_CONNECTIONS_REJECTED, 1);
+        return;
+    }
+    if (binary_version > BINARY_VERSION)
+    {
+        write_log("Sensor node %d requested unsupported binary version %d", sensor_id, binary_version);
+        close(client_fd); // Close connection
+        metrics_count(METRIC_CONNECTIONS_REJECTED, 1);
+        return;
+    }
+
+    pthread_mutex_lock(&shared->sensor_data.mutex); // Lock mutex to access shared data
+
+    // Look up (or create) the registry slot for this sensor ID
+    SensorSlot* slot = sensor_registry_get_or_add(&shared->sensor_data.registry, sensor_id);
+    if (!slot)
+    {
+        // Log if the registry cannot grow, or already holds --max-sensors ids
+        write_log("No registry slot for sensor %d, %zu sensor IDs known", sensor_id,
+                  sensor_registry_count(&shared->sensor_data.registry));
+        close(client_fd); // Close connection
+        pthread_mutex_unlock(&shared->sensor_data.mutex); // Unlock mutex
+        metrics_count(METRIC_CONNECTIONS_REJECTED, 1);
+        return;
+    }
+
+    if (slot->connected)
+    {
+        write_log("Sensor node %d already connected", sensor_id); // Log if sensor is already connected
+        close(client_fd); // Close connection
+        pthread_mutex_unlock(&shared->sensor_data.mutex); // Unlock mutex
+        metrics_count(METRIC_CONNECTIONS_REJECTED, 1);
+        return;
+    }
+
+    // Fill in the connection details of the sensor slot
+    SensorConnection* new_conn = &slot->conn;
+    new_conn->socket_fd = client_fd;
+    inet_ntop(AF_INET, &handshake->addr.sin_addr, new_conn->ip, INET_ADDRSTRLEN); // Get client IP address
+    new_conn->port = ntohs(handshake->addr.sin_port); // Get client port
 
-        int id_exists = 0;
-        // Check if sensor ID already exists
-        for (int i = 0; i < shared->sensor_data.connection_count; i++)
+    slot->connected = 1; // Mark sensor as connected
+    frame_parser_reset(&slot->parser, binary_version); // Drop any partial frame of a previous connection
+    write_log("Sensor node %d has opened a new %s connection from %s:%d", sensor_id,
+              binary_version ? "binary" : "text", new_conn->ip, new_conn->port); // Log new connection info
+
+    // Hand the socket to an event loop which services it from now on, adding it reports bytes already waiting
+    if (event_loop_add_connection(slot) == -1)
+    {
+        write_log("Failed to register sensor %d with an event loop", sensor_id); // Log if registration fails
+        close(client_fd); // Close connection
+        new_conn->socket_fd = -1;
+        slot->connected = 0; // Mark sensor as not connected
+        metrics_count(METRIC_CONNECTIONS_REJECTED, 1);
+    }
+    else
+    {
+        shared->sensor_data.connection_count++; // Increase sensor connection count
+        metrics_count(METRIC_CONNECTIONS_ACCEPTED, 1);
+        metrics_observe(STAGE_ACCEPT, metrics_now_ns() - handshake->accepted_ns);
+    }
+
+    pthread_mutex_unlock(&shared->sensor_data.mutex); // Unlock mutex
+}
+
+// Function to return how many leading bytes belong to the ID frame: up to its newline, or up to the first
+// byte that cannot be part of one, as older nodes send readings right after the ID; sets complete if found
+static size_t id_frame_end(const char* data, size_t length, int* complete)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        if (data[i] == '\n')
         {
-            if (shared->sensor_data.sensor_connections[i].id == sensor_id)
-            {
-                id_exists = 1;
-                break;
-            }
+            *complete = 1;
+            return i + 1;
         }
-
-        if (id_exists)
+        if (data[i] == '\0' || !strchr("0123456789+-IDBN:,\r", data[i]))
         {
-            write_log("Sensor node %d already connected", sensor_id); // Log if sensor is already connected
-            close(client_fd); // Close connection
-            pthread_mutex_unlock(&shared->sensor_data.mutex); // Unlock mutex
-            continue;
+            *complete = 1;
+            return i;
         }
+    }
+    *complete = 0;
+    return length;
+}
+
+// Function to take the ID bytes of a node that became readable, without consuming any reading sent after them
+static void finish_handshake(Acceptor* acceptor, Handshake* handshake)
+{
+    char peeked[ID_FRAME_MAX];
+    size_t room = ID_FRAME_MAX - handshake->length;
+    ssize_t bytes_read = recv(handshake->fd, peeked, room, MSG_PEEK);
+    if (bytes_read < 0 && (errno == EAGAIN || errno == EINTR))
+    {
+        return; // Nothing to read after all, keep waiting
+    }
+    if (bytes_read <= 0)
+    {
+        reject_handshake(acceptor, handshake); // Closed or failed before sending its ID
+        return;
+    }
+
+    int complete;
+    size_t take = id_frame_end(peeked, (size_t)bytes_read, &complete);
+    if (take > 0 && recv(handshake->fd, handshake->id_frame + handshake->length, take, 0) != (ssize_t)take)
+    {
+        reject_handshake(acceptor, handshake);
+        return;
+    }
+    handshake->length += take;
+    if (!complete && handshake->length < ID_FRAME_MAX)
+    {
+        return; // The rest of the ID is still on its way
+    }
+
+    remove_handshake(acceptor, handshake);
+    register_sensor(acceptor->shared, handshake);
+    free(handshake);
+}
 
-        // Check if maximum number of sensors is reached
-        if (shared->sensor_data.connection_count >= MAX_SENSORS)
+// Function to close the nodes whose ID frame did not come in time, returns the wait until the next deadline
+static int expire_handshakes(Acceptor* acceptor)
+{
+    int64_t now = metrics_now_ns();
+    while (acceptor->oldest && acceptor->oldest->deadline_ns <= now)
+    {
+        Handshake* handshake = acceptor->oldest;
+        int sensor_id, binary_version;
+        size_t id_length;
+        if (parse_id_frame(handshake->id_frame, handshake->length, &sensor_id, &binary_version, &id_length) == 0)
         {
-            write_log("Maximum number of sensors reached"); // Log if max sensors reached
-            close(client_fd); // Close connection
-            pthread_mutex_unlock(&shared->sensor_data.mutex); // Unlock mutex
+            // An older node that sent its ID without a newline and no reading yet
+            remove_handshake(acceptor, handshake);
+            register_sensor(acceptor->shared, handshake);
+            free(handshake);
             continue;
         }
+        char ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &handshake->addr.sin_addr, ip, sizeof(ip));
+        write_log("Node %s:%d sent no sensor ID within %d ms", ip, ntohs(handshake->addr.sin_port),
+                  acceptor->shared->config.handshake_ms);
+        reject_handshake(acceptor, handshake);
+    }
+    if (!acceptor->oldest)
+    {
+        return -1;
+    }
+    return (int)((acceptor->oldest->deadline_ns - now + 999999) / 1000000); // Rounded up, never wakes early
+}
 
-        // Add new sensor connection to the list
-        SensorConnection* new_conn = &shared->sensor_data.sensor_connections[shared->sensor_data.connection_count];
-        new_conn->id = sensor_id;
-        new_conn->socket_fd = client_fd;
-        inet_ntop(AF_INET, &client_addr.sin_addr, new_conn->ip, INET_ADDRSTRLEN); // Get client IP address
-        new_conn->port = ntohs(client_addr.sin_port); // Get client port
-
-        shared->sensor_data.connected_sensors[sensor_id] = 1; // Mark sensor as connected
-        write_log("Sensor node %d has opened a new connection from %s:%d",
-                  sensor_id, new_conn->ip, new_conn->port); // Log new connection info
+// Function run by each acceptor thread: accept connections from sensor nodes and complete their handshakes
+static void* acceptor_main(void* arg)
+{
+    Acceptor* acceptor = (Acceptor*)arg;
+    SharedData* shared = acceptor->shared;
+    struct epoll_event events[MAX_EVENTS];
 
-        pthread_t tid;
-        // Create thread to handle messages from sensor
-        if (pthread_create(&tid, NULL, handle_sensor_messages, shared) != 0)
+    // Main loop on the socket main created or took over, until shutdown starts
+    while (!shared->should_exit && !start_failed)
+    {
+        int n = epoll_wait(acceptor->epoll_fd, events, MAX_EVENTS, expire_handshakes(acceptor));
+        for (int i = 0; i < n && !shared->should_exit && !start_failed; i++)
         {
-            write_log("Failed to create handler thread for sensor %d", sensor_id); // Log if thread creation fails
-            close(client_fd); // Close connection
-            shared->sensor_data.connected_sensors[sensor_id] = 0; // Mark sensor as not connected
+            if (events[i].data.ptr == NULL)
+            {
+                continue; // Wakeup, left readable so that every acceptor sees it
+            }
+            if (events[i].data.ptr == acceptor)
+            {
+                accept_pending(acceptor);
+            }
+            else
+            {
+                finish_handshake(acceptor, (Handshake*)events[i].data.ptr);
+            }
         }
-        else
+    }
+
+    // Nodes still in their handshake reconnect, to this gateway's successor if there is one
+    while (acceptor->oldest)
+    {
+        reject_handshake(acceptor, acceptor->oldest);
+    }
+    return NULL; // main closes the listening socket, or hands it to the next gateway
+}
+
+// Function to start one acceptor thread per listening socket
+int connection_manager_start(SharedData* shared)
+{
+    pthread_once(&wake_once, create_wake_fd);
+    acceptors = calloc(shared->listen_count, sizeof(Acceptor));
+    if (!acceptors || wake_fd == -1)
+    {
+        write_log("Failed to allocate acceptors");
+        free(acceptors);
+        acceptors = NULL;
+        return -1;
+    }
+
+    for (int i = 0; i < shared->listen_count; i++)
+    {
+        Acceptor* acceptor = &acceptors[i];
+        acceptor->shared = shared;
+        acceptor->listen_fd = shared->listen_fds[i];
+        acceptor->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+        struct epoll_event listen_ev = {.events = EPOLLIN, .data.ptr = acceptor};
+        struct epoll_event wake_ev = {.events = EPOLLIN, .data.ptr = NULL};
+        if (acceptor->epoll_fd == -1 ||
+            epoll_ctl(acceptor->epoll_fd, EPOLL_CTL_ADD, acceptor->listen_fd, &listen_ev) == -1 ||
+            epoll_ctl(acceptor->epoll_fd, EPOLL_CTL_ADD, wake_fd, &wake_ev) == -1 ||
+            pthread_create(&acceptor->thread, NULL, acceptor_main, acceptor) != 0)
         {
-            pthread_detach(tid); // Detach thread to automatically free resources when done
-            shared->sensor_data.connection_count++; // Increase sensor connection count
+            write_log("Failed to create acceptor %d", i);
+            if (acceptor->epoll_fd != -1)
+            {
+                close(acceptor->epoll_fd);
+            }
+            // The event loops and workers already run, so only the acceptors started so far are stopped
+            acceptor_total = i;
+            start_failed = 1;
+            connection_manager_stop();
+            connection_manager_join(NULL);
+            start_failed = 0;
+            uint64_t value;
+            if (read(wake_fd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+            {
+                perror("eventfd read failed");
+            }
+            return -1;
         }
+        acceptor_total = i + 1;
+    }
+    write_log("%d acceptors listening on port %d", acceptor_total, shared->port);
+    return 0;
+}
 
-        pthread_mutex_unlock(&shared->sensor_data.mutex); // Unlock mutex
+// Function to stop accepting sensor nodes, should_exit must be set already
+void connection_manager_stop(void)
+{
+    pthread_once(&wake_once, create_wake_fd);
+    uint64_t one = 1;
+    if (write(wake_fd, &one, sizeof(one)) < 0)
+    {
+        perror("eventfd write failed");
     }
+}
 
-    close(server_fd); // Close server socket when exiting loop
-    return NULL;
-}
\ No newline at end of file
+// Function to wait for the acceptors to exit, returns -1 if the deadline passes first (NULL waits indefinitely)
+int connection_manager_join(const struct timespec* deadline)
+{
+    for (int i = 0; i < acceptor_total; i++)
+    {
+        int rc = deadline ? pthread_timedjoin_np(acceptors[i].thread, NULL, deadline) :
+                            pthread_join(acceptors[i].thread, NULL);
+        if (rc != 0)
+        {
+            return -1; // It may still hand a socket to the event loops, so its state is left alone
+        }
+        close(acceptors[i].epoll_fd);
+    }
+    free(acceptors);
+    acceptors = NULL;
+    acceptor_total = 0;
+    return 0;
+}
@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "dedup_cache.h"
+
+#define DEDUP_INITIAL_SIZE 256 // Initial number of buckets (power of two)
+
+// Function to spread sensor ids over the table (Fibonacci hashing)
+static size_t dedup_hash(int sensor_id, size_t size)
+{
+    uint64_t h = (uint64_t)(uint32_t)sensor_id * 0x9E3779B97F4A7C15ull;
+    return (size_t)(h >> 32) & (size - 1);
+}
+
+// Function to initialize an empty cache
+int dedup_cache_init(DedupCache* cache)
+{
+    cache->entries = calloc(DEDUP_INITIAL_SIZE, sizeof(DedupEntry));
+    if (!cache->entries)
+    {
+        return -1;
+    }
+    cache->size = DEDUP_INITIAL_SIZE;
+    cache->count = 0;
+    return 0;
+}
+
+// Function to release the cache
+void dedup_cache_destroy(DedupCache* cache)
+{
+    free(cache->entries);
+    memset(cache, 0, sizeof(*cache));
+}
+
+// Function to forget every stored value, keeping the table
+void dedup_cache_clear(DedupCache* cache)
+{
+    memset(cache->entries, 0, cache->size * sizeof(DedupEntry));
+    cache->count = 0;
+}
+
+// Function to find the bucket of a sensor id, or the empty bucket where it belongs
+static DedupEntry* find_entry(const DedupCache* cache, int sensor_id)
+{
+    size_t mask = cache->size - 1;
+    for (size_t i = dedup_hash(sensor_id, cache->size);; i = (i + 1) & mask)
+    {
+        DedupEntry* entry = &cache->entries[i];
+        if (!entry->used || entry->sensor_id == sensor_id)
+        {
+            return entry;
+        }
+    }
+}
+
+// Function to double the table once it is three quarters full
+static int grow(DedupCache* cache)
+{
+    DedupCache bigger = {.entries = calloc(cache->size * 2, sizeof(DedupEntry)), .size = cache->size * 2};
+    if (!bigger.entries)
+    {
+        return -1;
+    }
+    for (size_t i = 0; i < cache->size; i++)
+    {
+        if (cache->entries[i].used)
+        {
+            *find_entry(&bigger, cache->entries[i].sensor_id) = cache->entries[i];
+            bigger.count++;
+        }
+    }
+    free(cache->entries);
+    *cache = bigger;
+    return 0;
+}
+
+// Function to check whether a reading repeats the last stored value of its sensor within the time limit
+int dedup_cache_is_duplicate(const DedupCache* cache, const SensorReading* reading, long now)
+{
+    const DedupEntry* entry = find_entry(cache, reading->sensor_id);
+    return entry->used &&
+           now - entry->stored_at < DUPLICATE_TIME_LIMIT &&
+           fabs(reading->temperature - entry->temperature) <= FLOAT_TOLERANCE &&
+           fabs(reading->humidity - entry->humidity) <= FLOAT_TOLERANCE;
+}
+
+// Function to record a reading as the last stored value of its sensor
+int dedup_cache_remember(DedupCache* cache, const SensorReading* reading, long now)
+{
+    if ((cache->count + 1) * 4 > cache->size * 3 && grow(cache) == -1)
+    {
+        return -1; // Keep the old table, the reading is just not remembered
+    }
+
+    DedupEntry* entry = find_entry(cache, reading->sensor_id);
+    if (!entry->used)
+    {
+        entry->used = 1;
+        entry->sensor_id = reading->sensor_id;
+        cache->count++;
+    }
+    entry->temperature = reading->temperature;
+    entry->humidity = reading->humidity;
+    entry->stored_at = now;
+    return 0;
+}
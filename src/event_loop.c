@@ -0,0 +1,164 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include "event_loop.h"
+#include "sensor_handler.h"
+#include "log.h"
+
+#define MAX_EVENTS 64 // Events handled per epoll_wait call
+#define DRAIN_QUIET_MS 50 // On stop, a loop keeps reading until its sockets have been quiet this long
+#define DRAIN_MAX_MS 1000 // but no longer, nodes that keep sending cannot hold up the shutdown
+
+typedef struct
+{
+    pthread_t thread;
+    int epoll_fd;
+    int wake_fd; // eventfd used to interrupt epoll_wait on shutdown
+    SharedData* shared;
+} EventLoop;
+
+static EventLoop* loops = NULL; // Reactors owning all sensor sockets
+static int loop_total = 0;
+static unsigned int next_loop = 0; // Round-robin cursor for new connections
+static volatile int loops_running = 0;
+
+// Function run by each event loop thread to service its sensor sockets
+static void* event_loop_main(void* arg)
+{
+    EventLoop* loop = (EventLoop*)arg;
+    struct epoll_event events[MAX_EVENTS];
+    struct timespec drain_until = {0, 0};
+
+    while (1)
+    {
+        // Once stopped, bytes the nodes sent before are still read: reading reopens the receive window and
+        // lets the rest of what they had sent arrive, so wait for a quiet period instead of exiting at once
+        int n = epoll_wait(loop->epoll_fd, events, MAX_EVENTS, loops_running ? -1 : DRAIN_QUIET_MS);
+        if (!loops_running)
+        {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            if (drain_until.tv_sec == 0)
+            {
+                drain_until.tv_sec = now.tv_sec + DRAIN_MAX_MS / 1000;
+                drain_until.tv_nsec = now.tv_nsec + (DRAIN_MAX_MS % 1000) * 1000000L;
+            }
+            if (n == 0 || now.tv_sec > drain_until.tv_sec ||
+                (now.tv_sec == drain_until.tv_sec && now.tv_nsec >= drain_until.tv_nsec))
+            {
+                break;
+            }
+        }
+        for (int i = 0; i < n; i++)
+        {
+            if (events[i].data.ptr == NULL)
+            {
+                uint64_t value;
+                if (read(loop->wake_fd, &value, sizeof(value)) < 0)
+                {
+                    perror("eventfd read failed");
+                }
+                continue; // Wakeup request, the loop condition decides what to do
+            }
+
+            // A closed connection leaves the epoll set together with its socket
+            handle_sensor_messages(loop->shared, (SensorSlot*)events[i].data.ptr);
+        }
+    }
+    return NULL;
+}
+
+// Function to start the configured number of event loops
+int event_loops_start(SharedData* shared, int loop_count)
+{
+    loops = calloc(loop_count, sizeof(EventLoop));
+    if (!loops)
+    {
+        write_log("Failed to allocate event loops");
+        return -1;
+    }
+
+    loops_running = 1;
+    for (int i = 0; i < loop_count; i++)
+    {
+        EventLoop* loop = &loops[i];
+        loop->shared = shared;
+        loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        loop->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (loop->epoll_fd == -1 || loop->wake_fd == -1)
+        {
+            write_log("Failed to create event loop %d", i);
+            loop_total = i + 1;
+            event_loops_stop();
+            return -1;
+        }
+
+        struct epoll_event ev = {.events = EPOLLIN, .data.ptr = NULL};
+        epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->wake_fd, &ev);
+
+        if (pthread_create(&loop->thread, NULL, event_loop_main, loop) != 0)
+        {
+            write_log("Failed to create event loop thread %d", i);
+            close(loop->epoll_fd);
+            close(loop->wake_fd);
+            loop_total = i;
+            event_loops_stop();
+            return -1;
+        }
+    }
+    loop_total = loop_count;
+    return 0;
+}
+
+// Function to hand a connected sensor socket to one of the event loops
+int event_loop_add_connection(SensorSlot* slot)
+{
+    int flags = fcntl(slot->conn.socket_fd, F_GETFL, 0);
+    if (flags == -1 || fcntl(slot->conn.socket_fd, F_SETFL, flags | O_NONBLOCK) == -1)
+    {
+        return -1; // Edge-triggered reads need a non-blocking socket
+    }
+
+    EventLoop* loop = &loops[__atomic_fetch_add(&next_loop, 1, __ATOMIC_RELAXED) % (unsigned int)loop_total];
+    struct epoll_event ev = {.events = EPOLLIN | EPOLLRDHUP | EPOLLET, .data.ptr = slot};
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, slot->conn.socket_fd, &ev) == -1)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+// Function to stop all event loops once they have read what the sensors already sent, the workers must
+// still be running
+void event_loops_stop(void)
+{
+    loops_running = 0;
+    for (int i = 0; i < loop_total; i++)
+    {
+        uint64_t one = 1;
+        if (write(loops[i].wake_fd, &one, sizeof(one)) < 0)
+        {
+            perror("eventfd write failed");
+        }
+    }
+
+    for (int i = 0; i < loop_total; i++)
+    {
+        if (loops[i].thread)
+        {
+            pthread_join(loops[i].thread, NULL);
+        }
+        close(loops[i].epoll_fd);
+        close(loops[i].wake_fd);
+    }
+
+    free(loops);
+    loops = NULL;
+    loop_total = 0;
+}
\ No newline at end of file
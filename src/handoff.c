@@ -0,0 +1,326 @@
+#define _GNU_SOURCE // accept4
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include "handoff.h"
+#include "socket_utils.h"
+#include "sensor_registry.h"
+#include "event_loop.h"
+#include "log.h"
+
+#define HANDOFF_WAIT_MARGIN_S 5 // Waited beyond our own shutdown deadline for the old process to finish
+#define HANDOFF_PEER_TIMEOUT_MS 1000 // Longest a takeover peer may stall the main thread, which also reads signals
+
+// Function to send one message, passing count descriptors along with it
+static int send_message(int fd, HandoffType type, const int* fds, int count, const void* records, size_t size)
+{
+    HandoffHeader header = {.type = type, .version = HANDOFF_VERSION, .record_size = sizeof(HandoffSensor),
+                            .count = (uint32_t)count};
+    struct iovec iov[2] = {{.iov_base = &header, .iov_len = sizeof(header)},
+                           {.iov_base = (void*)records, .iov_len = size}};
+    char control[CMSG_SPACE(sizeof(int) * HANDOFF_BATCH)];
+    struct msghdr msg = {.msg_iov = iov, .msg_iovlen = size ? 2 : 1};
+
+    if (fds && count > 0)
+    {
+        memset(control, 0, sizeof(control));
+        msg.msg_control = control;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS; // The kernel duplicates the descriptors into the receiver
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * count);
+    }
+
+    if (sendmsg(fd, &msg, MSG_NOSIGNAL) != (ssize_t)(sizeof(header) + size))
+    {
+        write_log("Failed to send handoff message %d", type); // Log error
+        return -1;
+    }
+    return 0;
+}
+
+// Function to receive one message with its descriptors, returns the number of descriptors or -1
+static int receive_message(int fd, HandoffHeader* header, int* fds, HandoffSensor* records)
+{
+    struct iovec iov[2] = {{.iov_base = header, .iov_len = sizeof(*header)},
+                           {.iov_base = records, .iov_len = records ? sizeof(HandoffSensor) * HANDOFF_BATCH : 0}};
+    char control[CMSG_SPACE(sizeof(int) * HANDOFF_BATCH)];
+    struct msghdr msg = {.msg_iov = iov, .msg_iovlen = records ? 2 : 1,
+                         .msg_control = control, .msg_controllen = sizeof(control)};
+
+    ssize_t n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+    if (n < (ssize_t)sizeof(*header) || (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)))
+    {
+        return -1; // Closed, timed out or not one of our messages
+    }
+
+    int received = 0;
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+        {
+            received = (int)((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+            memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * received);
+        }
+    }
+    if (header->version != HANDOFF_VERSION || header->record_size != sizeof(HandoffSensor) ||
+        header->count > HANDOFF_BATCH || (uint32_t)received != (fds ? header->count : 0) ||
+        (size_t)n != sizeof(*header) + (header->type == HANDOFF_SENSORS ? header->count * sizeof(HandoffSensor) : 0))
+    {
+        for (int i = 0; i < received; i++)
+        {
+            close(fds[i]);
+        }
+        return -1;
+    }
+    return received;
+}
+
+// Function to offer the running gateway's sockets to a new process started with --takeover
+int handoff_listen(void)
+{
+    return create_unix_server_socket(HANDOFF_SOCKET_PATH, SOCK_SEQPACKET, 1);
+}
+
+// Function to accept a takeover request, -1 if it came from another user, stayed silent or came from
+// a gateway that cannot read our state
+int handoff_accept(int listen_fd)
+{
+    int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (fd == -1)
+    {
+        return -1;
+    }
+
+    // Only a process of our own user gets the sockets, whatever the permissions on the socket file
+    struct ucred peer;
+    socklen_t length = sizeof(peer);
+    int known = getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &peer, &length) == 0;
+    if (!known || peer.uid != geteuid())
+    {
+        write_log("Refusing takeover from uid %d", known ? (int)peer.uid : -1); // Log the stranger, keep running
+        close(fd);
+        return -1;
+    }
+    // Neither a silent peer nor one that stops reading may hold up shutdown
+    struct timeval timeout = {.tv_sec = HANDOFF_PEER_TIMEOUT_MS / 1000,
+                              .tv_usec = HANDOFF_PEER_TIMEOUT_MS % 1000 * 1000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    HandoffHeader hello;
+    if (receive_message(fd, &hello, NULL, NULL) == -1 || hello.type != HANDOFF_HELLO)
+    {
+        write_log("Refusing takeover from an incompatible gateway"); // Log the mismatch, keep running
+        send_message(fd, HANDOFF_REFUSED, NULL, 0, NULL, 0);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Function to pass the listening sockets one per message, connections keep queuing in their backlogs meanwhile
+int handoff_send_listeners(int fd, SharedData* shared)
+{
+    for (int i = 0; i < shared->listen_count; i++)
+    {
+        if (send_message(fd, HANDOFF_LISTENER, &shared->listen_fds[i], 1, NULL, 0) == -1)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Function to pass a batch of sensor sockets and release ours once the new process holds them
+static int send_batch(int fd, SharedData* shared, SensorSlot** slots, const HandoffSensor* records, int count)
+{
+    int fds[HANDOFF_BATCH] = {0}; // Zeroed so -O2 does not warn about the slots past count
+    for (int i = 0; i < count; i++)
+    {
+        fds[i] = slots[i]->conn.socket_fd;
+    }
+    if (send_message(fd, HANDOFF_SENSORS, fds, count, records, count * sizeof(HandoffSensor)) == -1)
+    {
+        return -1; // Sockets not passed yet stay ours and are closed on exit
+    }
+
+    // The new process has its own reference, closing ours does not end the connection
+    pthread_mutex_lock(&shared->sensor_data.mutex);
+    for (int i = 0; i < count; i++)
+    {
+        close(slots[i]->conn.socket_fd);
+        slots[i]->conn.socket_fd = -1;
+        slots[i]->connected = 0;
+        shared->sensor_data.connection_count--;
+    }
+    pthread_mutex_unlock(&shared->sensor_data.mutex);
+    return 0;
+}
+
+// Function to pass every connected sensor socket with its parser state, the event loops must be stopped;
+// returns the number of sockets handed over or -1
+int handoff_send_sensors(int fd, SharedData* shared)
+{
+    static HandoffSensor records[HANDOFF_BATCH]; // Only the main thread hands off
+    SensorSlot* slots[HANDOFF_BATCH];
+    int count = 0;
+    int total = 0;
+
+    size_t slot_count = sensor_registry_count(&shared->sensor_data.registry);
+    for (size_t i = 0; i < slot_count; i++)
+    {
+        SensorSlot* slot = sensor_registry_slot_at(&shared->sensor_data.registry, i);
+        if (!slot->connected)
+        {
+            continue;
+        }
+        HandoffSensor* record = &records[count];
+        memset(record, 0, sizeof(*record));
+        record->id = slot->conn.id;
+        record->port = slot->conn.port;
+        memcpy(record->ip, slot->conn.ip, sizeof(record->ip));
+        sensor_slot_snapshot(slot, &record->live);
+        record->parser = slot->parser;
+        slots[count++] = slot;
+
+        if (count == HANDOFF_BATCH)
+        {
+            if (send_batch(fd, shared, slots, records, count) == -1)
+            {
+                return -1;
+            }
+            total += count;
+            count = 0;
+        }
+    }
+    if (count > 0 && send_batch(fd, shared, slots, records, count) == -1)
+    {
+        return -1;
+    }
+    total += count;
+    log_event(LOG_HANDOFF_SENT, total, 0, 0);
+    return total;
+}
+
+// Function to tell the new process that the storage backend is free
+int handoff_send_done(int fd)
+{
+    return send_message(fd, HANDOFF_DONE, NULL, 0, NULL, 0);
+}
+
+// Function to take over the sockets of the running gateway, returns the number of sensors adopted or -1
+int handoff_receive(SharedData* shared)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    strncpy(addr.sun_path, HANDOFF_SOCKET_PATH, sizeof(addr.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd == -1 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1)
+    {
+        write_log("No running gateway to take over on %s", HANDOFF_SOCKET_PATH); // Log error
+        if (fd != -1)
+        {
+            close(fd);
+        }
+        return -1;
+    }
+
+    // The old process drains its readings before it is done, which is bounded by its shutdown deadline
+    struct timeval timeout = {.tv_sec = shared->config.shutdown_s + HANDOFF_WAIT_MARGIN_S};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    static HandoffSensor records[HANDOFF_BATCH];
+    int fds[HANDOFF_BATCH];
+    HandoffHeader header;
+    int adopted = 0;
+    shared->listen_count = 0;
+    if (send_message(fd, HANDOFF_HELLO, NULL, 0, NULL, 0) == -1)
+    {
+        close(fd);
+        return -1;
+    }
+
+    while (1)
+    {
+        int received = receive_message(fd, &header, fds, records);
+        if (received == -1 || header.type == HANDOFF_REFUSED)
+        {
+            write_log("Takeover failed after %d sensors", adopted); // Log error
+            close(fd);
+            return -1;
+        }
+        if (header.type == HANDOFF_DONE)
+        {
+            break;
+        }
+        if (header.type == HANDOFF_LISTENER && received == 1)
+        {
+            if (shared->listen_count < MAX_ACCEPTORS)
+            {
+                shared->listen_fds[shared->listen_count++] = fds[0]; // Kept even beyond --acceptors, closing it
+            }                                                        // would reset the connections it queued
+            else
+            {
+                close(fds[0]);
+            }
+            continue;
+        }
+
+        for (int i = 0; i < received; i++)
+        {
+            const HandoffSensor* record = &records[i];
+            SensorSlot* slot = sensor_registry_get_or_add(&shared->sensor_data.registry, record->id);
+            if (!slot)
+            {
+                write_log("Failed to allocate registry slot for sensor %d", record->id);
+                close(fds[i]); // The node reconnects
+                continue;
+            }
+            slot->conn.socket_fd = fds[i];
+            slot->conn.port = record->port;
+            memcpy(slot->conn.ip, record->ip, sizeof(slot->conn.ip));
+            slot->parser = record->parser;
+            if (record->live.at != 0)
+            {
+                sensor_slot_publish(slot, record->live.temperature, record->live.humidity, record->live.at);
+            }
+            slot->connected = 1;
+            shared->sensor_data.connection_count++;
+            adopted++;
+        }
+    }
+    close(fd);
+    if (shared->listen_count == 0)
+    {
+        write_log("The running gateway did not pass its listening socket"); // Log error
+        return -1;
+    }
+    log_event(LOG_HANDOFF_RECEIVED, adopted, 0, 0);
+    return adopted;
+}
+
+// Function to hand the adopted sensor sockets to the event loops once they run
+void handoff_attach(SharedData* shared)
+{
+    size_t slot_count = sensor_registry_count(&shared->sensor_data.registry);
+    for (size_t i = 0; i < slot_count; i++)
+    {
+        SensorSlot* slot = sensor_registry_slot_at(&shared->sensor_data.registry, i);
+        if (slot->connected && event_loop_add_connection(slot) == -1)
+        {
+            write_log("Failed to register sensor %d with an event loop", slot->conn.id); // Log error
+            pthread_mutex_lock(&shared->sensor_data.mutex);
+            close(slot->conn.socket_fd);
+            slot->conn.socket_fd = -1;
+            slot->connected = 0;
+            shared->sensor_data.connection_count--;
+            pthread_mutex_unlock(&shared->sensor_data.mutex);
+        }
+    }
+}
@@ -0,0 +1,198 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/eventfd.h>
+#include "ingest_queue.h"
+
+#define PUSH_RETRIES 50 // Attempts on a full ring before a reading is dropped
+#define PUSH_RETRY_NS 200000L // Pause between attempts (0.2 ms), about 10 ms in total
+
+// Function to allocate the ring, capacity is rounded up to a power of two
+int ingest_queue_init(IngestQueue* queue, int capacity)
+{
+    size_t size = 2;
+    while (size < (size_t)capacity)
+    {
+        size <<= 1;
+    }
+
+    queue->cells = malloc(size * sizeof(IngestCell));
+    if (!queue->cells)
+    {
+        return -1;
+    }
+    queue->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (queue->wake_fd == -1)
+    {
+        free(queue->cells);
+        queue->cells = NULL;
+        return -1;
+    }
+
+    // A cell is free for the producer that claims position p once its sequence equals p
+    for (size_t i = 0; i < size; i++)
+    {
+        atomic_init(&queue->cells[i].sequence, i);
+    }
+    queue->mask = size - 1;
+    queue->head = 0;
+    atomic_init(&queue->tail, 0);
+    atomic_init(&queue->wake_at, 0);
+    atomic_init(&queue->pushed, 0);
+    atomic_init(&queue->full_events, 0);
+    atomic_init(&queue->dropped, 0);
+    return 0;
+}
+
+// Function to release the ring and its wakeup descriptor
+void ingest_queue_destroy(IngestQueue* queue)
+{
+    free(queue->cells);
+    queue->cells = NULL;
+    if (queue->wake_fd != -1)
+    {
+        close(queue->wake_fd);
+        queue->wake_fd = -1;
+    }
+}
+
+// Function to interrupt a consumer sleeping in ingest_queue_wait
+void ingest_queue_wake(IngestQueue* queue)
+{
+    uint64_t one = 1;
+    if (write(queue->wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+    {
+        perror("eventfd write failed");
+    }
+}
+
+// Function to claim count consecutive cells and publish readings without blocking, -1 if they do not fit
+static int try_push(IngestQueue* queue, const SensorReading* readings, size_t count, int64_t now_ns)
+{
+    size_t pos = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+
+    while (1)
+    {
+        // The consumer frees cells in order, so if the last one is free at this lap all of them are
+        size_t last = pos + count - 1;
+        size_t seq = atomic_load_explicit(&queue->cells[last & queue->mask].sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)last;
+        if (diff == 0)
+        {
+            // The cells are free at this lap, race the other producers for them
+            if (atomic_compare_exchange_weak_explicit(&queue->tail, &pos, pos + count,
+                                                      memory_order_relaxed, memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            return -1; // The consumer has not released these cells yet
+        }
+        else
+        {
+            pos = atomic_load_explicit(&queue->tail, memory_order_relaxed); // Another producer won, retry
+        }
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        IngestCell* cell = &queue->cells[(pos + i) & queue->mask];
+        cell->reading = readings[i];
+        cell->enqueued_ns = now_ns;
+        atomic_store_explicit(&cell->sequence, pos + i + 1, memory_order_release);
+    }
+
+    // Wake the consumer once the position it is waiting for has been reached
+    size_t wake_at = atomic_load(&queue->wake_at);
+    if (wake_at != 0 && pos + count >= wake_at && atomic_exchange(&queue->wake_at, 0) != 0)
+    {
+        ingest_queue_wake(queue);
+    }
+    return 0;
+}
+
+// Function to queue readings as one contiguous run, waits briefly on a full ring and drops them if it stays full
+int ingest_queue_push(IngestQueue* queue, const SensorReading* readings, int count)
+{
+    if ((size_t)count > queue->mask + 1)
+    {
+        atomic_fetch_add_explicit(&queue->dropped, count, memory_order_relaxed);
+        return -1; // Larger than the whole ring
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t now_ns = (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec; // The wait on a full ring counts as queued
+
+    if (try_push(queue, readings, (size_t)count, now_ns) == 0)
+    {
+        atomic_fetch_add_explicit(&queue->pushed, count, memory_order_relaxed);
+        return 0;
+    }
+
+    atomic_fetch_add_explicit(&queue->full_events, 1, memory_order_relaxed);
+    ingest_queue_wake(queue); // Make sure the consumer is draining
+
+    struct timespec pause = {.tv_sec = 0, .tv_nsec = PUSH_RETRY_NS};
+    for (int i = 0; i < PUSH_RETRIES; i++)
+    {
+        nanosleep(&pause, NULL);
+        if (try_push(queue, readings, (size_t)count, now_ns) == 0)
+        {
+            atomic_fetch_add_explicit(&queue->pushed, count, memory_order_relaxed);
+            return 0;
+        }
+    }
+
+    atomic_fetch_add_explicit(&queue->dropped, count, memory_order_relaxed);
+    return -1;
+}
+
+// Function to take the oldest reading and when it was queued, only ever called by the single consumer
+int ingest_queue_pop(IngestQueue* queue, SensorReading* reading, int64_t* enqueued_ns)
+{
+    IngestCell* cell = &queue->cells[queue->head & queue->mask];
+    if (atomic_load_explicit(&cell->sequence, memory_order_acquire) != queue->head + 1)
+    {
+        return -1; // Empty, or the producer of this cell has not published yet
+    }
+
+    *reading = cell->reading;
+    *enqueued_ns = cell->enqueued_ns;
+    // Hand the cell back to producers for the next lap of the ring
+    atomic_store_explicit(&cell->sequence, queue->head + queue->mask + 1, memory_order_release);
+    queue->head++;
+    return 0;
+}
+
+// Function to sleep until count readings are queued or timeout_ms has passed
+void ingest_queue_wait(IngestQueue* queue, size_t count, int timeout_ms)
+{
+    atomic_store(&queue->wake_at, queue->head + count);
+
+    // A producer may have passed the target before wake_at was visible to it
+    if (atomic_load(&queue->tail) < queue->head + count)
+    {
+        struct pollfd pfd = {.fd = queue->wake_fd, .events = POLLIN};
+        poll(&pfd, 1, timeout_ms);
+    }
+    atomic_store(&queue->wake_at, 0);
+
+    uint64_t value;
+    if (read(queue->wake_fd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+    {
+        perror("eventfd read failed"); // EAGAIN only means the wait ended on timeout
+    }
+}
+
+// Function to return the approximate number of queued readings, called by the consumer
+size_t ingest_queue_length(IngestQueue* queue)
+{
+    return atomic_load_explicit(&queue->tail, memory_order_relaxed) - queue->head;
+}
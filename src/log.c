@@ -1,17 +1,73 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <pthread.h>
+#include <stdint.h>
+#include <stdatomic.h>
 #include <stdarg.h>
 #include <string.h>
-#include <fcntl.h>
+#include <errno.h>
 #include <unistd.h>
+#include <poll.h>
 #include <time.h>
 #include <signal.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
 #include "log.h"
+#include "log_writer.h"
+#include "metrics.h"
 
-#define FIFO_NAME "logFifo" // Name of the FIFO (named pipe) for logging
 #define MAX_LOG_MSG 256 // Maximum length of a log message
+#define LOG_RING_SLOTS 4096 // Messages buffered between the gateway and the log process (power of two)
+#define LOG_IDLE_WAIT_MS 1000 // Re-check the running flag every second while idle
+#define LOG_EXIT_POLL_MS 10 // How often log_shutdown() checks whether the log process has exited
 
+#define LOG_FILE_EVENTS ((1u << LOG_READING) | (1u << LOG_SHUTDOWN) | (1u << LOG_HANDOFF_SENT) | \
+                         (1u << LOG_HANDOFF_RECEIVED) | (1u << LOG_METRICS) | \
+                         (1u << LOG_RATE_LIMITED) | (1u << LOG_QUEUE_FULL) | \
+                         (1u << LOG_STORAGE_UNAVAILABLE) | (1u << LOG_SPOOL_LOST)) // Events written to gateway.log
+
+typedef struct
+{
+    _Atomic size_t sequence; // Ring lap at which the slot may be written or read
+    int event; // LogEvent
+    int sensor_id;
+    int64_t mono_ns; // CLOCK_MONOTONIC when the event was emitted
+    double values[2];
+    char text[MAX_LOG_MSG]; // Only used by LOG_TEXT and LOG_METRICS records
+} LogSlot;
+
+// Formats applied by the log process, each receives sensor id, value1 and value2
+static const char* event_formats[LOG_EVENT_COUNT] = {
+    [LOG_TEXT] = "%s",
+    [LOG_READING] = "Sensor node %d reports temperature: %.1f, humidity: %.1f\n",
+    [LOG_SENSOR_CLOSED] = "Sensor node %d has closed the connection\n",
+    [LOG_INVALID_FORMAT] = "Invalid data format from sensor node %d\n",
+    [LOG_INVALID_SENSOR_ID] = "Received sensor data with invalid sensor node ID %d\n",
+    [LOG_DUPLICATE] = "Skipping duplicate data for sensor %d\n",
+    [LOG_SHUTDOWN] = "Gateway stopped: %d queued readings drained in %.0f ms, %.0f left in the spool\n",
+    [LOG_HANDOFF_SENT] = "Handed %d sensor connections over to the new gateway\n",
+    [LOG_HANDOFF_RECEIVED] = "Took over %d sensor connections from the previous gateway\n",
+    [LOG_METRICS] = "%s",
+    [LOG_RATE_LIMITED] = "Sensor node %d is over the ingest rate limit, %.0f readings held back\n",
+    [LOG_QUEUE_FULL] = "Ingest queue full: %d readings dropped (%.0f full events, %.0f queued in total)\n",
+    [LOG_STORAGE_UNAVAILABLE] = "Storage unavailable at startup, readings are spooled until it opens\n",
+    [LOG_SPOOL_LOST] = "Spool lost %d readings (%.0f to its disk bound in total, %.0f still spooled)\n",
+};
+
+typedef struct
+{
+    _Alignas(64) _Atomic size_t tail; // Next slot reserved by a writer thread
+    _Alignas(64) size_t head; // Next slot read by the log process
+    _Alignas(64) _Atomic int consumer_sleeping; // Set while the log process waits on wake_fd
+    _Atomic int closing; // Set by log_shutdown(), the log process writes out what is queued and exits
+    _Atomic unsigned long written;
+    _Atomic unsigned long dropped; // Messages lost because the ring was full
+    int wake_fd; // eventfd shared across the fork
+    LogSlot slots[LOG_RING_SLOTS];
+} LogRing;
+
+static LogRing* log_ring = NULL; // Shared mapping, inherited by the forked log process
 static volatile int keep_running = 1; // Flag to control the running state of the log process
 
 // Signal handler to set the keep_running flag to 0
@@ -21,103 +77,309 @@ void log_handle_signal(int signum)
     keep_running = 0;
 }
 
-// Function to write a log message to the FIFO
-void write_log(const char* format, ...)
+// Function to map the log ring shared with the log process, must run before fork
+int log_init(void)
 {
-    static pthread_mutex_t fifo_mutex = PTHREAD_MUTEX_INITIALIZER; // Mutex to protect FIFO access
-    char message[MAX_LOG_MSG]; // Buffer to hold the log message
-    va_list args;
+    LogRing* ring = mmap(NULL, sizeof(LogRing), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED)
+    {
+        perror("mmap log ring");
+        return -1;
+    }
 
-    memset(message, 0, sizeof(message)); // Clear the message buffer
+    ring->wake_fd = eventfd(0, EFD_NONBLOCK);
+    if (ring->wake_fd == -1)
+    {
+        perror("eventfd");
+        munmap(ring, sizeof(LogRing));
+        return -1;
+    }
+    for (size_t i = 0; i < LOG_RING_SLOTS; i++)
+    {
+        atomic_init(&ring->slots[i].sequence, i); // Slot i is free for the writer that reserves position i
+    }
+    log_ring = ring;
+    return 0;
+}
 
+// Function to reserve a slot of our own in the log ring, NULL if the ring is full
+static LogSlot* reserve_slot(LogRing* ring, size_t* pos_out)
+{
+    size_t pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    while (1)
+    {
+        LogSlot* slot = &ring->slots[pos & (LOG_RING_SLOTS - 1)];
+        size_t seq = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&ring->tail, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+            {
+                *pos_out = pos;
+                return slot;
+            }
+        }
+        else if (diff < 0)
+        {
+            atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+            return NULL; // The log process is behind, never block the caller
+        }
+        else
+        {
+            pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        }
+    }
+}
+
+// Function to stamp, publish and signal a filled slot, returns the stamp
+static int64_t publish_slot(LogRing* ring, LogSlot* slot, size_t pos)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t mono_ns = (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec;
+    slot->mono_ns = mono_ns; // The slot may be reused as soon as it is published
+
+    atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release); // Publish the record
+    atomic_fetch_add_explicit(&ring->written, 1, memory_order_relaxed);
+
+    if (atomic_load(&ring->consumer_sleeping) && atomic_exchange(&ring->consumer_sleeping, 0))
+    {
+        uint64_t one = 1;
+        if (write(ring->wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        {
+            perror("eventfd write failed");
+        }
+    }
+    return mono_ns;
+}
+
+// Function to emit a structured event, formatting is left to the log process
+void log_event(LogEvent event, int sensor_id, double value1, double value2)
+{
+    int64_t start = metrics_now_ns();
+    LogRing* ring = log_ring;
+    size_t pos;
+    LogSlot* slot = ring ? reserve_slot(ring, &pos) : NULL;
+    if (!slot)
+    {
+        return; // Logging not set up, or the record was counted as dropped
+    }
+
+    slot->event = event;
+    slot->sensor_id = sensor_id;
+    slot->values[0] = value1;
+    slot->values[1] = value2;
+    metrics_observe(STAGE_LOG_ENQUEUE, publish_slot(ring, slot, pos) - start);
+}
+
+// Function to format a text record of the given event into the shared log ring
+static void log_text(LogEvent event, const char* format, va_list args)
+{
+    int64_t start = metrics_now_ns();
+    LogRing* ring = log_ring;
+    size_t pos;
+    LogSlot* slot = ring ? reserve_slot(ring, &pos) : NULL;
+    if (!slot)
+    {
+        return; // Logging not set up, or the message was counted as dropped
+    }
+
+    int len = vsnprintf(slot->text, sizeof(slot->text) - 1, format, args); // Format the log message
+
+    if (len < 0)
+    {
+        len = 0;
+    }
+    else if (len > (int)sizeof(slot->text) - 2)
+    {
+        len = (int)sizeof(slot->text) - 2; // Truncated
+    }
+    if (len == 0 || slot->text[len - 1] != '\n')
+    {
+        slot->text[len++] = '\n'; // Ensure the message ends with a newline
+        slot->text[len] = '\0';
+    }
+
+    slot->event = event;
+    metrics_observe(STAGE_LOG_ENQUEUE, publish_slot(ring, slot, pos) - start);
+}
+
+// Function to write a free-form log message to the shared log ring
+void write_log(const char* format, ...)
+{
+    va_list args;
     va_start(args, format); // Initialize the variable argument list
-    vsnprintf(message, sizeof(message) - 2, format, args); // Format the log message
+    log_text(LOG_TEXT, format, args);
     va_end(args); // End the variable argument list
+}
+
+// Function to write a metrics summary line, which unlike write_log() messages goes to gateway.log
+void log_metrics(const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    log_text(LOG_METRICS, format, args);
+    va_end(args);
+}
+
+// Function to return the number of log records lost to a full ring so far
+unsigned long log_dropped_count(void)
+{
+    return log_ring ? atomic_load_explicit(&log_ring->dropped, memory_order_relaxed) : 0;
+}
 
-    size_t len = strlen(message);
-    if (len > 0 && message[len-1] != '\n')
+// Function to take the oldest published record, NULL if there is none
+static const LogSlot* next_record(LogRing* ring)
+{
+    LogSlot* slot = &ring->slots[ring->head & (LOG_RING_SLOTS - 1)];
+    if (atomic_load_explicit(&slot->sequence, memory_order_acquire) != ring->head + 1)
     {
-        strcat(message, "\n"); // Ensure the message ends with a newline
+        return NULL;
     }
+    return slot;
+}
 
-    pthread_mutex_lock(&fifo_mutex); // Lock the mutex
-    int fd = open(FIFO_NAME, O_WRONLY | O_NONBLOCK); // Open the FIFO for writing
-    if (fd != -1)
+// Function to hand the slot of the last record back to the writers
+static void release_record(LogRing* ring)
+{
+    LogSlot* slot = &ring->slots[ring->head & (LOG_RING_SLOTS - 1)];
+    atomic_store_explicit(&slot->sequence, ring->head + LOG_RING_SLOTS, memory_order_release);
+    ring->head++;
+}
+
+// Function to sleep until a writer publishes a message or the timeout passes
+static void wait_for_messages(LogRing* ring, int timeout_ms)
+{
+    atomic_store(&ring->consumer_sleeping, 1);
+    if (next_record(ring) == NULL) // A writer may have published before it saw the flag
     {
-        ssize_t bytes_written = write(fd, message, strlen(message)); // Write the message to the FIFO
-        if (bytes_written < 0)
-        {
-            perror("write to FIFO failed"); // Print an error message if the write fails
-        }
-        close(fd); // Close the FIFO
+        struct pollfd pfd = {.fd = ring->wake_fd, .events = POLLIN};
+        poll(&pfd, 1, timeout_ms); // Signals interrupt the wait as well
+    }
+    atomic_store(&ring->consumer_sleeping, 0);
+
+    uint64_t value;
+    if (read(ring->wake_fd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+    {
+        perror("eventfd read failed");
     }
-    pthread_mutex_unlock(&fifo_mutex); // Unlock the mutex
 }
 
-// Function to process log messages from the FIFO and write them to a log file
-void log_process()
+// Function to append one numbered entry stamped with the wall-clock time of the event
+static void write_entry(LogWriter* writer, const LogSlot* record, int64_t realtime_offset_ns)
 {
-    signal(SIGINT, log_handle_signal); // Set up signal handler for SIGINT
-    signal(SIGTERM, log_handle_signal); // Set up signal handler for SIGTERM
+    static int seq_num = 1; // Sequence number for log entries
+    time_t when = (time_t)((record->mono_ns + realtime_offset_ns) / 1000000000LL);
 
-    FILE* log_file = fopen("gateway.log", "a"); // Open the log file for appending
-    if (!log_file)
+    char* out = log_writer_reserve(writer);
+    int n = snprintf(out, LOG_ENTRY_MAX, "%d %s ", seq_num++, log_writer_timestamp(writer, when));
+    if (record->event == LOG_TEXT || record->event == LOG_METRICS)
     {
-        perror("Failed to open log file"); // Print an error message if the log file cannot be opened
-        exit(1);
+        n += snprintf(out + n, LOG_ENTRY_MAX - n, "%s", record->text);
     }
+    else
+    {
+        n += snprintf(out + n, LOG_ENTRY_MAX - n, event_formats[record->event],
+                      record->sensor_id, record->values[0], record->values[1]);
+    }
+    log_writer_commit(writer, n < LOG_ENTRY_MAX ? (size_t)n : LOG_ENTRY_MAX - 1);
+}
+
+// Function to return the offset that turns CLOCK_MONOTONIC into wall-clock time
+static int64_t realtime_offset(void)
+{
+    struct timespec real, mono;
+    clock_gettime(CLOCK_REALTIME, &real);
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+    return ((int64_t)real.tv_sec - mono.tv_sec) * 1000000000LL + (real.tv_nsec - mono.tv_nsec);
+}
+
+// Function to process log records from the log ring and write them to a log file
+void log_process(const GatewayConfig* config)
+{
+    // The gateway stops the log process itself once it has drained, a terminal's SIGINT or a
+    // service manager's SIGTERM to the whole group must not end it first
+    signal(SIGINT, SIG_IGN);
+    signal(SIGTERM, SIG_IGN);
+    signal(SIGHUP, log_handle_signal); // Sent if the gateway dies without stopping us
+    prctl(PR_SET_PDEATHSIG, SIGHUP);
+    if (getppid() == 1)
+    {
+        keep_running = 0; // The gateway died before the death signal was armed
+    }
+    signal(SIGCHLD, SIG_IGN); // Background gzip children are reaped automatically
 
-    int fd = open(FIFO_NAME, O_RDONLY | O_NONBLOCK); // Open the FIFO for reading
-    if (fd == -1)
+    static LogWriter writer; // Large buffer, kept off the stack
+    if (log_writer_open(&writer, "gateway.log", config) == -1)
     {
-        perror("Failed to open FIFO"); // Print an error message if the FIFO cannot be opened
         exit(1);
     }
 
-    char buffer[MAX_LOG_MSG]; // Buffer to hold data read from the FIFO
-    char line[MAX_LOG_MSG]; // Buffer to hold a single log line
-    char timestamp[32]; // Buffer to hold the timestamp
-    static int seq_num = 1; // Sequence number for log entries
-    size_t line_pos = 0; // Position in the line buffer
+    LogRing* ring = log_ring;
+    unsigned long reported_drops = 0;
 
-    while (keep_running)
+    while (1)
     {
-        ssize_t bytes_read = read(fd, buffer, sizeof(buffer) - 1); // Read data from the FIFO
-        if (bytes_read > 0)
+        int closing = atomic_load(&ring->closing); // Read first, so everything published before it is written
+        int64_t offset = realtime_offset(); // Refreshed per run to follow clock adjustments
+        const LogSlot* record;
+        while ((record = next_record(ring)) != NULL)
         {
-            for (size_t i = 0; i < (size_t)bytes_read; i++)
+            // Filter by event type; free-form messages are diagnostics and stay out of the file
+            if (record->event > LOG_TEXT && record->event < LOG_EVENT_COUNT &&
+                (LOG_FILE_EVENTS & (1u << record->event)))
             {
-                if (line_pos < sizeof(line) - 1)
-                {
-                    line[line_pos++] = buffer[i]; // Add the character to the line buffer
-
-                    if (buffer[i] == '\n' || line_pos >= sizeof(line) - 1)
-                    {
-                        line[line_pos] = '\0'; // Null-terminate the line
-
-                        if (strstr(line, "Sensor node") && strstr(line, "reports"))
-                        {
-                            time_t now = time(NULL);
-                            struct tm *tm_info = localtime(&now);
-                            strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", tm_info); // Format the timestamp
-
-                            fprintf(log_file, "%d %s %s", seq_num++, timestamp, line); // Write the log entry to the file
-                            fflush(log_file); // Flush the log file
-                        }
-
-                        line_pos = 0; // Reset the line position
-                        memset(line, 0, sizeof(line)); // Clear the line buffer
-                    }
-                }
+                write_entry(&writer, record, offset);
             }
+            release_record(ring);
         }
-        else
+
+        unsigned long dropped = atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+        if (dropped != reported_drops)
         {
-            usleep(100000); // Sleep for 100ms to avoid busy-waiting
+            LogSlot notice = {.event = LOG_TEXT};
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            notice.mono_ns = (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec;
+            snprintf(notice.text, sizeof(notice.text), "Log ring full, %lu messages dropped\n",
+                     dropped - reported_drops);
+            write_entry(&writer, &notice, offset);
+            reported_drops = dropped;
         }
+
+        if (!keep_running || closing)
+        {
+            break; // Everything published before the signal or log_shutdown() has been written
+        }
+        // Sleep no longer than the oldest buffered entry may wait
+        wait_for_messages(ring, log_writer_poll(&writer, LOG_IDLE_WAIT_MS));
     }
 
-    close(fd); // Close the FIFO
-    fclose(log_file); // Close the log file
-    unlink(FIFO_NAME); // Remove the FIFO
-}
\ No newline at end of file
+    log_writer_close(&writer);
+}
+
+// Function to have the log process write out every queued record and exit, it is killed after timeout_ms
+int log_shutdown(pid_t pid, int timeout_ms)
+{
+    LogRing* ring = log_ring;
+    atomic_store(&ring->closing, 1);
+    uint64_t one = 1;
+    if (write(ring->wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+    {
+        perror("eventfd write failed");
+    }
+
+    struct timespec pause = {.tv_sec = 0, .tv_nsec = LOG_EXIT_POLL_MS * 1000000L};
+    for (int waited = 0; waited < timeout_ms; waited += LOG_EXIT_POLL_MS)
+    {
+        if (waitpid(pid, NULL, WNOHANG) == pid)
+        {
+            return 0;
+        }
+        nanosleep(&pause, NULL);
+    }
+    kill(pid, SIGKILL); // Stuck on a full disk or the like
+    waitpid(pid, NULL, 0);
+    return -1;
+}
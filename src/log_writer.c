@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "log_writer.h"
+
+// Function to return a monotonic timestamp in milliseconds
+static int64_t monotonic_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+// Function to open (or reopen after a rotation) the log file for appending
+static int open_file(LogWriter* writer)
+{
+    writer->fd = open(writer->path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (writer->fd == -1)
+    {
+        perror("Failed to open log file");
+        return -1;
+    }
+
+    struct stat st;
+    writer->file_size = fstat(writer->fd, &st) == 0 ? (size_t)st.st_size : 0;
+    writer->opened_at = time(NULL);
+    return 0;
+}
+
+// Function to prepare a buffered writer for the given file
+int log_writer_open(LogWriter* writer, const char* path, const GatewayConfig* config)
+{
+    memset(writer, 0, sizeof(*writer));
+    snprintf(writer->path, sizeof(writer->path), "%s", path);
+    writer->max_bytes = (size_t)config->log_max_mb * 1024 * 1024;
+    writer->rotate_seconds = config->log_rotate_s;
+    writer->flush_ms = config->log_flush_ms;
+    writer->compress = config->log_compress;
+    writer->cached_second = (time_t)-1;
+    return open_file(writer);
+}
+
+// Function to return the text form of a wall-clock second, reformatted only when the second changes
+const char* log_writer_timestamp(LogWriter* writer, time_t when)
+{
+    if (when != writer->cached_second)
+    {
+        struct tm tm_info;
+        localtime_r(&when, &tm_info);
+        strftime(writer->cached_stamp, sizeof(writer->cached_stamp), "%Y-%m-%d %H:%M:%S", &tm_info);
+        writer->cached_second = when;
+    }
+    return writer->cached_stamp;
+}
+
+// Function to write the buffered entries to the log file
+void log_writer_flush(LogWriter* writer)
+{
+    size_t done = 0;
+    while (done < writer->used)
+    {
+        ssize_t n = write(writer->fd, writer->buffer + done, writer->used - done);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            perror("write to log file failed");
+            break; // Drop the buffer rather than spin on a broken file
+        }
+        done += (size_t)n;
+    }
+    writer->file_size += done;
+    writer->used = 0;
+    writer->first_pending_ms = 0;
+}
+
+// Function to gzip a rolled file without waiting for it
+static void compress_file(const char* path)
+{
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        execlp("gzip", "gzip", "-f", path, (char*)NULL);
+        _exit(127); // gzip is not installed, the file stays uncompressed
+    }
+    if (pid == -1)
+    {
+        perror("fork gzip");
+    }
+}
+
+// Function to move the current file aside and start a new one
+static void rotate(LogWriter* writer)
+{
+    log_writer_flush(writer);
+    close(writer->fd);
+
+    char stamp[32];
+    char rolled[sizeof(writer->path) + 48];
+    time_t now = time(NULL);
+    struct tm tm_info;
+    localtime_r(&now, &tm_info);
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm_info);
+    snprintf(rolled, sizeof(rolled), "%s.%s.%lu", writer->path, stamp, ++writer->rotations);
+
+    if (rename(writer->path, rolled) == -1)
+    {
+        perror("rename log file");
+    }
+    else if (writer->compress)
+    {
+        compress_file(rolled);
+    }
+
+    if (open_file(writer) == -1)
+    {
+        writer->fd = STDERR_FILENO; // Keep logging somewhere rather than lose entries
+    }
+}
+
+// Function to get room for one entry of up to LOG_ENTRY_MAX bytes at the end of the buffer
+char* log_writer_reserve(LogWriter* writer)
+{
+    if (LOG_WRITER_BUFFER - writer->used < LOG_ENTRY_MAX)
+    {
+        log_writer_flush(writer); // Size threshold
+    }
+    return writer->buffer + writer->used;
+}
+
+// Function to account for an entry written into the reserved space
+void log_writer_commit(LogWriter* writer, size_t length)
+{
+    if (writer->used == 0)
+    {
+        writer->first_pending_ms = monotonic_ms();
+    }
+    writer->used += length;
+
+    if (writer->max_bytes && writer->file_size + writer->used >= writer->max_bytes)
+    {
+        rotate(writer);
+    }
+}
+
+// Function to apply the time thresholds, returns how long the caller may sleep
+int log_writer_poll(LogWriter* writer, int idle_ms)
+{
+    if (writer->rotate_seconds && writer->file_size + writer->used > 0 &&
+        time(NULL) - writer->opened_at >= writer->rotate_seconds)
+    {
+        rotate(writer);
+    }
+
+    if (writer->used == 0)
+    {
+        return idle_ms;
+    }
+    int64_t due = writer->first_pending_ms + writer->flush_ms - monotonic_ms();
+    if (due <= 0)
+    {
+        log_writer_flush(writer);
+        return idle_ms;
+    }
+    return due < idle_ms ? (int)due : idle_ms;
+}
+
+// Function to flush and close the log file
+void log_writer_close(LogWriter* writer)
+{
+    log_writer_flush(writer);
+    if (writer->fd != STDERR_FILENO)
+    {
+        close(writer->fd);
+    }
+    writer->fd = -1;
+}
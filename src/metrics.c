@@ -0,0 +1,368 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include "metrics.h"
+#include "log.h"
+
+#define METRICS_LINE_MAX 256
+
+typedef struct
+{
+    _Alignas(64) _Atomic uint64_t counters[METRIC_COUNTER_COUNT];
+    _Atomic uint64_t buckets[STAGE_COUNT][METRICS_BUCKETS];
+    _Atomic uint64_t sum_ns[STAGE_COUNT];
+    int owned; // Written by a single thread, which then needs no atomic read-modify-write
+} MetricsShard;
+
+static MetricsShard metrics_shards[METRICS_SHARDS];
+static _Atomic int shards_taken = 0;
+static _Thread_local MetricsShard* local_shard = NULL;
+
+static const char* counter_names[METRIC_COUNTER_COUNT][2] = {
+    [METRIC_CONNECTIONS_ACCEPTED] = {"gateway_connections_accepted_total", "Sensor nodes handed to an event loop"},
+    [METRIC_CONNECTIONS_REJECTED] = {"gateway_connections_rejected_total", "Sensor nodes closed during the ID handshake"},
+    [METRIC_READINGS_RECEIVED] = {"gateway_readings_received_total", "Readings parsed from sensor frames"},
+    [METRIC_FRAMES_INVALID] = {"gateway_frames_invalid_total", "Frames that could not be parsed"},
+    [METRIC_READINGS_DUPLICATE] = {"gateway_readings_duplicate_total", "Readings skipped as duplicates"},
+    [METRIC_READINGS_STORED] = {"gateway_readings_stored_total", "Readings committed to the storage backend"},
+    [METRIC_READINGS_SPOOLED] = {"gateway_readings_spooled_total", "Readings spooled to disk for the backend"},
+    [METRIC_QUERIES] = {"gateway_queries_total", "Requests on the query socket"},
+    [METRIC_READINGS_SHED] = {"gateway_readings_shed_total", "Readings discarded for being over a rate limit"},
+    [METRIC_READINGS_COALESCED] = {"gateway_readings_coalesced_total",
+                                   "Readings replaced by a newer one of the same sensor while over a rate limit"},
+    [METRIC_TIMESTAMPS_REPLACED] = {"gateway_timestamps_replaced_total",
+                                    "Node timestamps too far from gateway time, replaced by the arrival time"},
+    [METRIC_READINGS_LOST] = {"gateway_readings_lost_total",
+                              "Readings lost to the spool disk bound or a failed spool write"},
+};
+
+static const char* stage_names[STAGE_COUNT] = {
+    [STAGE_ACCEPT] = "accept",
+    [STAGE_PARSE] = "parse",
+    [STAGE_QUEUE_WAIT] = "queue_wait",
+    [STAGE_DB_COMMIT] = "db_commit",
+    [STAGE_LOG_ENQUEUE] = "log_enqueue",
+};
+
+// Upper bounds of the exposed histogram buckets in nanoseconds, from 1 us to 10 s
+static const int64_t exposed_bounds_ns[] = {
+    1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000,
+    1000000, 2500000, 5000000, 10000000, 25000000, 50000000, 100000000, 250000000, 500000000,
+    1000000000, 2500000000LL, 5000000000LL, 10000000000LL,
+};
+
+// Function to return the current monotonic time in nanoseconds
+int64_t metrics_now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+// Function to return the calling thread's shard, taking a free one on first use
+static MetricsShard* thread_shard(void)
+{
+    if (!local_shard)
+    {
+        int index = atomic_fetch_add(&shards_taken, 1);
+        if (index < METRICS_SHARDS - 1)
+        {
+            metrics_shards[index].owned = 1;
+            local_shard = &metrics_shards[index];
+        }
+        else
+        {
+            local_shard = &metrics_shards[METRICS_SHARDS - 1]; // Shared, so updated with atomic adds
+        }
+    }
+    return local_shard;
+}
+
+// Function to add to a shard cell, a plain load and store when no other thread writes the shard
+static inline void shard_add(const MetricsShard* shard, _Atomic uint64_t* cell, uint64_t n)
+{
+    if (shard->owned)
+    {
+        atomic_store_explicit(cell, atomic_load_explicit(cell, memory_order_relaxed) + n, memory_order_relaxed);
+    }
+    else
+    {
+        atomic_fetch_add_explicit(cell, n, memory_order_relaxed);
+    }
+}
+
+// Function to map a duration to its log-linear bucket: exact below 16 ns, then 16 buckets per power of two
+static int bucket_index(uint64_t ns)
+{
+    if (ns < METRICS_SUB_BUCKETS)
+    {
+        return (int)ns;
+    }
+    int shift = 63 - __builtin_clzll(ns) - 4; // Keeps the 4 bits below the leading one
+    int index = (shift + 1) * METRICS_SUB_BUCKETS + (int)((ns >> shift) - METRICS_SUB_BUCKETS);
+    return index < METRICS_BUCKETS ? index : METRICS_BUCKETS - 1;
+}
+
+// Function to return the smallest duration of a bucket
+static uint64_t bucket_lower(int index)
+{
+    if (index < METRICS_SUB_BUCKETS)
+    {
+        return (uint64_t)index;
+    }
+    int shift = index / METRICS_SUB_BUCKETS - 1;
+    return (uint64_t)(METRICS_SUB_BUCKETS + index % METRICS_SUB_BUCKETS) << shift;
+}
+
+// Function to return the first duration past a bucket
+static uint64_t bucket_upper(int index)
+{
+    if (index < METRICS_SUB_BUCKETS)
+    {
+        return (uint64_t)index + 1;
+    }
+    return bucket_lower(index) + (1ULL << (index / METRICS_SUB_BUCKETS - 1));
+}
+
+// Function to add to a counter of the calling thread
+void metrics_count(MetricCounter counter, uint64_t n)
+{
+    MetricsShard* shard = thread_shard();
+    shard_add(shard, &shard->counters[counter], n);
+}
+
+// Function to record one duration of a stage in the calling thread's histogram
+void metrics_observe(MetricStage stage, int64_t ns)
+{
+    MetricsShard* shard = thread_shard();
+    uint64_t value = ns > 0 ? (uint64_t)ns : 0; // The clock is monotonic, but stamps may come from two reads
+    shard_add(shard, &shard->buckets[stage][bucket_index(value)], 1);
+    shard_add(shard, &shard->sum_ns[stage], value);
+}
+
+// Function to add up every shard, concurrent updates land in this snapshot or the next
+void metrics_snapshot(MetricsSnapshot* snapshot)
+{
+    memset(snapshot, 0, sizeof(*snapshot));
+    for (int s = 0; s < METRICS_SHARDS; s++)
+    {
+        MetricsShard* shard = &metrics_shards[s];
+        for (int c = 0; c < METRIC_COUNTER_COUNT; c++)
+        {
+            snapshot->counters[c] += atomic_load_explicit(&shard->counters[c], memory_order_relaxed);
+        }
+        for (int stage = 0; stage < STAGE_COUNT; stage++)
+        {
+            for (int b = 0; b < METRICS_BUCKETS; b++)
+            {
+                snapshot->buckets[stage][b] += atomic_load_explicit(&shard->buckets[stage][b], memory_order_relaxed);
+            }
+            snapshot->sum_ns[stage] += atomic_load_explicit(&shard->sum_ns[stage], memory_order_relaxed);
+        }
+    }
+}
+
+// Function to read the current gauges from the shared state
+void metrics_read_gauges(SharedData* shared, MetricsGauges* gauges)
+{
+    pthread_mutex_lock(&shared->sensor_data.mutex);
+    gauges->connected_sensors = shared->sensor_data.connection_count;
+    pthread_mutex_unlock(&shared->sensor_data.mutex);
+
+    // ingest_queue_length() belongs to the consumer, other threads read the positions for an estimate
+    IngestQueue* queue = &shared->ingest_queue;
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    size_t head = *(volatile size_t*)&queue->head;
+    gauges->queue_depth = tail > head ? (long)(tail - head) : 0;
+    gauges->sql_retry_count = shared->storage.retry_count;
+    gauges->readings_dropped = atomic_load_explicit(&queue->dropped, memory_order_relaxed);
+    gauges->queue_full_events = atomic_load_explicit(&queue->full_events, memory_order_relaxed);
+    gauges->log_dropped = log_dropped_count();
+}
+
+// Function to return the number of observations in a histogram
+static uint64_t histogram_count(const uint64_t* buckets)
+{
+    uint64_t count = 0;
+    for (int b = 0; b < METRICS_BUCKETS; b++)
+    {
+        count += buckets[b];
+    }
+    return count;
+}
+
+// Function to print one formatted line through the caller's printer
+static void print_line(MetricsPrinter print, void* ctx, const char* format, ...)
+{
+    char line[METRICS_LINE_MAX];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    print(ctx, line);
+}
+
+// Function to print a metric that has a single value
+static void print_metric(MetricsPrinter print, void* ctx, const char* name, const char* type, const char* help,
+                         double value)
+{
+    print_line(print, ctx, "# HELP %s %s\n", name, help);
+    print_line(print, ctx, "# TYPE %s %s\n", name, type);
+    print_line(print, ctx, "%s %.17g\n", name, value);
+}
+
+// Function to print every counter, gauge and stage histogram in the Prometheus text exposition format
+void metrics_write_prometheus(SharedData* shared, MetricsPrinter print, void* ctx)
+{
+    static MetricsSnapshot snapshot; // Too large for a query thread's stack
+    static pthread_mutex_t snapshot_mutex = PTHREAD_MUTEX_INITIALIZER;
+    MetricsGauges gauges;
+
+    pthread_mutex_lock(&snapshot_mutex);
+    metrics_snapshot(&snapshot);
+    metrics_read_gauges(shared, &gauges);
+
+    for (int c = 0; c < METRIC_COUNTER_COUNT; c++)
+    {
+        print_metric(print, ctx, counter_names[c][0], "counter", counter_names[c][1], (double)snapshot.counters[c]);
+    }
+    print_metric(print, ctx, "gateway_readings_dropped_total", "counter",
+                 "Readings lost to a full ingest queue", (double)gauges.readings_dropped);
+    print_metric(print, ctx, "gateway_ingest_queue_full_events_total", "counter",
+                 "Pushes that found the ingest queue full", (double)gauges.queue_full_events);
+    print_metric(print, ctx, "gateway_log_lines_dropped_total", "counter",
+                 "Log records lost to a full log ring", (double)gauges.log_dropped);
+    print_metric(print, ctx, "gateway_connected_sensors", "gauge", "Sensor nodes currently connected",
+                 (double)gauges.connected_sensors);
+    print_metric(print, ctx, "gateway_ingest_queue_depth", "gauge", "Readings waiting for the storage writer",
+                 (double)gauges.queue_depth);
+    print_metric(print, ctx, "gateway_sql_retry_count", "gauge",
+                 "Failed attempts to reopen the storage backend since it was lost", (double)gauges.sql_retry_count);
+
+    print_line(print, ctx, "# HELP gateway_stage_duration_seconds Time spent in each stage of the pipeline\n");
+    print_line(print, ctx, "# TYPE gateway_stage_duration_seconds histogram\n");
+    for (int stage = 0; stage < STAGE_COUNT; stage++)
+    {
+        const uint64_t* buckets = snapshot.buckets[stage];
+        uint64_t cumulative = 0;
+        int b = 0;
+        for (size_t i = 0; i < sizeof(exposed_bounds_ns) / sizeof(exposed_bounds_ns[0]); i++)
+        {
+            // A bucket counts once all of it lies below the bound, so counts err on the slow side
+            while (b < METRICS_BUCKETS && bucket_upper(b) <= (uint64_t)exposed_bounds_ns[i] + 1)
+            {
+                cumulative += buckets[b++];
+            }
+            print_line(print, ctx, "gateway_stage_duration_seconds_bucket{stage=\"%s\",le=\"%g\"} %llu\n",
+                       stage_names[stage], exposed_bounds_ns[i] / 1e9, (unsigned long long)cumulative);
+        }
+        uint64_t count = histogram_count(buckets);
+        print_line(print, ctx, "gateway_stage_duration_seconds_bucket{stage=\"%s\",le=\"+Inf\"} %llu\n",
+                   stage_names[stage], (unsigned long long)count);
+        print_line(print, ctx, "gateway_stage_duration_seconds_sum{stage=\"%s\"} %.9f\n", stage_names[stage],
+                   snapshot.sum_ns[stage] / 1e9);
+        print_line(print, ctx, "gateway_stage_duration_seconds_count{stage=\"%s\"} %llu\n", stage_names[stage],
+                   (unsigned long long)count);
+    }
+    pthread_mutex_unlock(&snapshot_mutex);
+}
+
+// Function to return the duration below which a share q of the observations fall, to bucket precision
+static uint64_t histogram_quantile(const uint64_t* buckets, uint64_t count, double q)
+{
+    uint64_t rank = (uint64_t)(q * count);
+    uint64_t seen = 0;
+    for (int b = 0; b < METRICS_BUCKETS; b++)
+    {
+        seen += buckets[b];
+        if (seen > rank)
+        {
+            return (bucket_lower(b) + bucket_upper(b)) / 2;
+        }
+    }
+    return bucket_lower(METRICS_BUCKETS - 1);
+}
+
+// Function to format a duration with a unit that keeps it short
+static const char* format_duration(uint64_t ns, char* out, size_t size)
+{
+    if (ns < 1000)
+    {
+        snprintf(out, size, "%llu ns", (unsigned long long)ns);
+    }
+    else if (ns < 1000000)
+    {
+        snprintf(out, size, "%.1f us", ns / 1e3);
+    }
+    else if (ns < 1000000000)
+    {
+        snprintf(out, size, "%.1f ms", ns / 1e6);
+    }
+    else
+    {
+        snprintf(out, size, "%.2f s", ns / 1e9);
+    }
+    return out;
+}
+
+// Function to log the gauges, the counters and the stage latencies of the last interval
+void metrics_log_summary(SharedData* shared, int interval_s)
+{
+    static MetricsSnapshot previous, current; // Only main logs the summary
+    static MetricsSnapshot delta;
+    MetricsGauges gauges;
+
+    metrics_snapshot(&current);
+    metrics_read_gauges(shared, &gauges);
+    for (int c = 0; c < METRIC_COUNTER_COUNT; c++)
+    {
+        delta.counters[c] = current.counters[c] - previous.counters[c];
+    }
+    for (int stage = 0; stage < STAGE_COUNT; stage++)
+    {
+        for (int b = 0; b < METRICS_BUCKETS; b++)
+        {
+            delta.buckets[stage][b] = current.buckets[stage][b] - previous.buckets[stage][b];
+        }
+    }
+    previous = current;
+
+    log_metrics("Metrics over %d s: %llu readings received, %llu stored, %llu duplicate, %llu spooled, %llu shed, "
+                "%llu coalesced, %llu invalid frames, %llu connections accepted, %llu rejected, %llu queries",
+                interval_s, (unsigned long long)delta.counters[METRIC_READINGS_RECEIVED],
+                (unsigned long long)delta.counters[METRIC_READINGS_STORED],
+                (unsigned long long)delta.counters[METRIC_READINGS_DUPLICATE],
+                (unsigned long long)delta.counters[METRIC_READINGS_SPOOLED],
+                (unsigned long long)delta.counters[METRIC_READINGS_SHED],
+                (unsigned long long)delta.counters[METRIC_READINGS_COALESCED],
+                (unsigned long long)delta.counters[METRIC_FRAMES_INVALID],
+                (unsigned long long)delta.counters[METRIC_CONNECTIONS_ACCEPTED],
+                (unsigned long long)delta.counters[METRIC_CONNECTIONS_REJECTED],
+                (unsigned long long)delta.counters[METRIC_QUERIES]);
+    log_metrics("Gauges: %ld sensors connected, %ld readings queued, %ld sql retries; "
+                "%lu readings and %lu log lines dropped since start", gauges.connected_sensors,
+                gauges.queue_depth, gauges.sql_retry_count, gauges.readings_dropped, gauges.log_dropped);
+
+    for (int stage = 0; stage < STAGE_COUNT; stage++)
+    {
+        const uint64_t* buckets = delta.buckets[stage];
+        uint64_t count = histogram_count(buckets);
+        if (count == 0)
+        {
+            continue; // Nothing went through this stage, e.g. no new connections
+        }
+        int last = METRICS_BUCKETS - 1;
+        while (buckets[last] == 0)
+        {
+            last--;
+        }
+        char p50[16], p99[16], max[16];
+        log_metrics("Latency of %s over %d s: p50 %s, p99 %s, max %s, %llu samples", stage_names[stage], interval_s,
+                    format_duration(histogram_quantile(buckets, count, 0.50), p50, sizeof(p50)),
+                    format_duration(histogram_quantile(buckets, count, 0.99), p99, sizeof(p99)),
+                    format_duration(bucket_upper(last) - 1, max, sizeof(max)), (unsigned long long)count);
+    }
+}
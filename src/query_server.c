@@ -0,0 +1,355 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include "query_server.h"
+#include "socket_utils.h"
+#include "sensor_registry.h"
+#include "storage_backend.h"
+#include "log.h"
+#include "metrics.h"
+
+#define QUERY_BACKLOG 64
+#define QUERY_LINE_MAX 256 // Longest request line
+#define QUERY_REPLY_SIZE 16384 // Replies are sent in chunks of this size
+#define QUERY_ROW_LIMIT 10000 // Rows returned by one RANGE or ROLLUP request at most
+#define QUERY_SEND_TIMEOUT_S 5 // A client that reads no reply for this long is dropped, freeing its thread
+#define QUERY_IDLE_TIMEOUT_S 10 // A client that sends no request for this long is dropped as well
+
+typedef struct
+{
+    pthread_t thread;
+    void* reader; // Backend reader owned by this thread
+    pthread_mutex_t client_mutex; // Guards client_fd, so query_server_stop() never shuts down a reused fd
+    int client_fd; // Client being served, -1 while waiting in accept()
+    SharedData* shared;
+} QueryWorker;
+
+typedef struct
+{
+    int fd;
+    int failed; // The client went away, the rest of the reply is discarded
+    size_t length;
+    char data[QUERY_REPLY_SIZE];
+} QueryReply;
+
+static QueryWorker* query_workers = NULL; // Fixed-size pool sharing one listening socket
+static int query_total = 0;
+static int query_listen_fd = -1;
+static volatile int query_stopping = 0;
+
+// Function to send the buffered part of a reply
+static void reply_flush(QueryReply* reply)
+{
+    size_t sent = 0;
+    while (!reply->failed && sent < reply->length)
+    {
+        ssize_t n = send(reply->fd, reply->data + sent, reply->length - sent, MSG_NOSIGNAL);
+        if (n <= 0)
+        {
+            reply->failed = 1;
+        }
+        else
+        {
+            sent += (size_t)n;
+        }
+    }
+    reply->length = 0;
+}
+
+// Function to append one formatted line to a reply
+static void reply_printf(QueryReply* reply, const char* fmt, ...)
+{
+    if (QUERY_REPLY_SIZE - reply->length < QUERY_LINE_MAX)
+    {
+        reply_flush(reply);
+    }
+    va_list args;
+    va_start(args, fmt);
+    size_t room = QUERY_REPLY_SIZE - reply->length;
+    int n = vsnprintf(reply->data + reply->length, room, fmt, args);
+    va_end(args);
+    if (n > 0 && (size_t)n < room)
+    {
+        reply->length += (size_t)n;
+    }
+}
+
+// Function to answer LATEST [id] from the live readings, without touching SQLite or any lock
+static void query_latest(SharedData* shared, QueryReply* reply, int sensor_id)
+{
+    const SensorRegistry* registry = &shared->sensor_data.registry;
+    size_t total = sensor_registry_count(registry);
+    for (size_t i = 0; i < total && !reply->failed; i++)
+    {
+        const SensorSlot* slot = sensor_registry_slot_at(registry, i);
+        if (sensor_id >= 0 && slot->conn.id != sensor_id)
+        {
+            continue;
+        }
+        LiveValue live;
+        sensor_slot_snapshot(slot, &live);
+        if (live.at)
+        {
+            reply_printf(reply, "%d %ld %.2f %.2f\n", slot->conn.id, live.at, live.temperature, live.humidity);
+        }
+    }
+    reply_printf(reply, "END\n");
+}
+
+// Function to send one reading of a RANGE reply
+static int reply_reading(void* ctx, const SensorReading* reading)
+{
+    QueryReply* reply = (QueryReply*)ctx;
+    reply_printf(reply, "%ld %.3f %.3f\n", reading->timestamp, reading->temperature, reading->humidity);
+    return reply->failed ? -1 : 0;
+}
+
+// Function to send one window of a ROLLUP reply
+static int reply_rollup(void* ctx, const StoredRollup* rollup)
+{
+    QueryReply* reply = (QueryReply*)ctx;
+    const StoredMetric* t = &rollup->temperature;
+    const StoredMetric* h = &rollup->humidity;
+    reply_printf(reply, "%ld %ld %.3f %.3f %.3f %.3f %.3f %.3f %.3f %.3f %.3f %.3f\n", rollup->window_start,
+                 rollup->count, t->min, t->max, t->mean, t->var, t->p95, h->min, h->max, h->mean, h->var, h->p95);
+    return reply->failed ? -1 : 0;
+}
+
+// Function to end a reply streamed by a backend query
+static void reply_end(QueryReply* reply, int rc)
+{
+    reply_printf(reply, rc == 0 ? "END\n" : "ERR query failed\n");
+}
+
+// Function to send one line of a METRICS reply
+static void reply_metric_line(void* ctx, const char* line)
+{
+    reply_printf((QueryReply*)ctx, "%s", line);
+}
+
+// Function to make sure this thread has a reader, the gateway may have started before its storage could open
+static int query_reader(QueryWorker* worker, QueryReply* reply)
+{
+    if (!worker->reader)
+    {
+        worker->reader = worker->shared->storage.ops->open_reader(&worker->shared->storage);
+    }
+    if (!worker->reader)
+    {
+        reply_printf(reply, "ERR storage unavailable\n");
+        return 0;
+    }
+    return 1;
+}
+
+// Function to parse and answer one request line
+static void handle_query(QueryWorker* worker, const char* line, QueryReply* reply)
+{
+    char command[16];
+    int sensor_id = -1, resolution = 0, limit = QUERY_ROW_LIMIT;
+    long from = 0, to = 0;
+
+    if (sscanf(line, "%15s", command) != 1)
+    {
+        return; // Blank line
+    }
+    metrics_count(METRIC_QUERIES, 1);
+
+    const StorageBackendOps* ops = worker->shared->storage.ops;
+    if (strcmp(command, "LATEST") == 0)
+    {
+        sscanf(line, "%*s %d", &sensor_id); // All sensors without an id
+        query_latest(worker->shared, reply, sensor_id);
+    }
+    else if (strcmp(command, "RANGE") == 0 &&
+             sscanf(line, "%*s %d %ld %ld %d", &sensor_id, &from, &to, &limit) >= 3)
+    {
+        limit = limit > 0 && limit < QUERY_ROW_LIMIT ? limit : QUERY_ROW_LIMIT;
+        if (query_reader(worker, reply))
+        {
+            reply_end(reply, ops->query_range(worker->reader, sensor_id, from, to, limit, reply_reading, reply));
+        }
+    }
+    else if (strcmp(command, "ROLLUP") == 0 && !ops->query_rollup)
+    {
+        reply_printf(reply, "ERR the %s backend keeps no rollups\n", ops->name);
+    }
+    else if (strcmp(command, "ROLLUP") == 0 &&
+             sscanf(line, "%*s %d %d %ld %ld", &sensor_id, &resolution, &from, &to) == 4)
+    {
+        if (query_reader(worker, reply))
+        {
+            reply_end(reply, ops->query_rollup(worker->reader, sensor_id, resolution, from, to, QUERY_ROW_LIMIT,
+                                               reply_rollup, reply));
+        }
+    }
+    else if (strcmp(command, "METRICS") == 0)
+    {
+        // Prometheus text format; its "# EOF" terminator stands in for END, scrapers ignore it as a comment
+        metrics_write_prometheus(worker->shared, reply_metric_line, reply);
+        reply_printf(reply, "# EOF\n");
+    }
+    else
+    {
+        reply_printf(reply, "ERR usage: LATEST [id] | RANGE id from to [limit] | ROLLUP id resolution from to | "
+                     "METRICS\n");
+    }
+}
+
+// Function to serve one client until it disconnects, requests are answered in order
+static void serve_client(QueryWorker* worker, int fd)
+{
+    QueryReply* reply = malloc(sizeof(QueryReply));
+    char buffer[QUERY_LINE_MAX * 4];
+    size_t used = 0;
+    if (!reply)
+    {
+        return;
+    }
+    reply->fd = fd;
+    reply->failed = 0;
+    reply->length = 0;
+
+    while (!reply->failed)
+    {
+        ssize_t n = recv(fd, buffer + used, sizeof(buffer) - used - 1, 0);
+        if (n <= 0)
+        {
+            break; // Closed by the client or by query_server_stop(), or idle for QUERY_IDLE_TIMEOUT_S
+        }
+        used += (size_t)n;
+        buffer[used] = '\0';
+
+        char* start = buffer;
+        char* newline;
+        while ((newline = strchr(start, '\n')) != NULL)
+        {
+            *newline = '\0';
+            handle_query(worker, start, reply);
+            start = newline + 1;
+        }
+        reply_flush(reply); // Pipelined requests share one send
+
+        used -= (size_t)(start - buffer);
+        memmove(buffer, start, used);
+        if (used == sizeof(buffer) - 1)
+        {
+            break; // Line too long
+        }
+    }
+    free(reply);
+}
+
+// Function run by each query thread: accept a client, serve it, repeat
+static void* query_main(void* arg)
+{
+    QueryWorker* worker = (QueryWorker*)arg;
+    while (!query_stopping)
+    {
+        int fd = accept(query_listen_fd, NULL, NULL);
+        if (fd == -1)
+        {
+            continue; // Interrupted, or woken by query_server_stop()
+        }
+        // Either query_server_stop() sees the client and shuts it down, or this thread sees it stopping
+        pthread_mutex_lock(&worker->client_mutex);
+        int stopping = query_stopping;
+        worker->client_fd = stopping ? -1 : fd;
+        pthread_mutex_unlock(&worker->client_mutex);
+        if (!stopping)
+        {
+            // Each thread serves one client at a time, so neither a silent client nor one that stops reading
+            // may keep it from the others
+            struct timeval send_timeout = {.tv_sec = QUERY_SEND_TIMEOUT_S, .tv_usec = 0};
+            struct timeval idle_timeout = {.tv_sec = QUERY_IDLE_TIMEOUT_S, .tv_usec = 0};
+            setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &idle_timeout, sizeof(idle_timeout));
+            serve_client(worker, fd);
+        }
+        pthread_mutex_lock(&worker->client_mutex);
+        worker->client_fd = -1;
+        close(fd);
+        pthread_mutex_unlock(&worker->client_mutex);
+    }
+    return NULL;
+}
+
+// Function to start the query threads on the local socket
+int query_server_start(SharedData* shared, int thread_count)
+{
+    query_workers = calloc(thread_count, sizeof(QueryWorker));
+    if (!query_workers)
+    {
+        write_log("Failed to allocate query threads");
+        return -1;
+    }
+    query_listen_fd = create_unix_server_socket(QUERY_SOCKET_PATH, SOCK_STREAM, QUERY_BACKLOG);
+    if (query_listen_fd == -1)
+    {
+        free(query_workers);
+        query_workers = NULL;
+        return -1;
+    }
+
+    query_stopping = 0;
+    for (int i = 0; i < thread_count; i++)
+    {
+        QueryWorker* worker = &query_workers[i];
+        worker->shared = shared;
+        worker->client_fd = -1;
+        pthread_mutex_init(&worker->client_mutex, NULL);
+        // Each thread gets its own reader, e.g. a read-only connection that WAL lets run beside the writer;
+        // one that can't open yet is retried by the first query that needs it
+        worker->reader = shared->storage.ops->open_reader(&shared->storage);
+        if (pthread_create(&worker->thread, NULL, query_main, worker) != 0)
+        {
+            if (worker->reader)
+            {
+                shared->storage.ops->close_reader(worker->reader);
+            }
+            write_log("Failed to create query thread");
+            query_server_stop();
+            return -1;
+        }
+        query_total++;
+    }
+    write_log("Query API listening on %s", QUERY_SOCKET_PATH);
+    return 0;
+}
+
+// Function to stop the query threads and remove the socket
+void query_server_stop(void)
+{
+    query_stopping = 1;
+    shutdown(query_listen_fd, SHUT_RDWR); // Wakes threads blocked in accept()
+    for (int i = 0; i < query_total; i++)
+    {
+        pthread_mutex_lock(&query_workers[i].client_mutex);
+        if (query_workers[i].client_fd != -1)
+        {
+            shutdown(query_workers[i].client_fd, SHUT_RDWR); // Wakes a thread blocked in recv()
+        }
+        pthread_mutex_unlock(&query_workers[i].client_mutex);
+    }
+    for (int i = 0; i < query_total; i++)
+    {
+        pthread_join(query_workers[i].thread, NULL);
+        if (query_workers[i].reader)
+        {
+            query_workers[i].shared->storage.ops->close_reader(query_workers[i].reader);
+        }
+        pthread_mutex_destroy(&query_workers[i].client_mutex);
+    }
+    close(query_listen_fd);
+    unlink(QUERY_SOCKET_PATH);
+    query_listen_fd = -1;
+    query_total = 0;
+    free(query_workers);
+    query_workers = NULL;
+}
@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <stdatomic.h>
+#include <time.h>
+#include "rate_limit.h"
+#include "log.h"
+#include "metrics.h"
+
+// Buckets are kept as the time at which they are full again: taking n tokens moves that time n intervals
+// later, and a bucket has room for as many intervals as that time is less than the burst ahead of now
+typedef struct
+{
+    int64_t interval_ns; // Time in which one token is earned, 0 for no limit
+    int64_t burst_ns; // Capacity of the bucket expressed as time
+} RateBucket;
+
+static RateBucket sensor_bucket; // Same rate for every sensor, each keeps its own fill state in its slot
+static RateBucket global_bucket;
+static _Atomic int64_t global_full_at_ns = 0; // Shared by the event loops and the connection manager
+static int overload_policy = OVERLOAD_DROP;
+
+// Function to size a bucket for a rate, with room for a whole batch frame at least
+static void bucket_configure(RateBucket* bucket, int rate)
+{
+    bucket->interval_ns = rate > 0 ? 1000000000LL / rate : 0;
+    long tokens = (long)rate * RATE_BURST_S;
+    bucket->burst_ns = (tokens > READING_BATCH_MAX ? tokens : READING_BATCH_MAX) * bucket->interval_ns;
+}
+
+// Function to set the limits from the configuration, before any sensor is read
+void rate_limit_configure(const GatewayConfig* config)
+{
+    bucket_configure(&sensor_bucket, config->sensor_rate);
+    bucket_configure(&global_bucket, config->global_rate);
+    overload_policy = config->overload_policy;
+    atomic_store(&global_full_at_ns, 0);
+}
+
+// Function to return how many tokens a bucket holds at now_ns, at most wanted
+static int bucket_available(const RateBucket* bucket, int64_t full_at_ns, int64_t now_ns, int wanted)
+{
+    if (bucket->interval_ns == 0)
+    {
+        return wanted;
+    }
+    int64_t start = full_at_ns > now_ns ? full_at_ns : now_ns;
+    int64_t room = now_ns + bucket->burst_ns - start;
+    int64_t tokens = room > 0 ? room / bucket->interval_ns : 0;
+    return tokens < wanted ? (int)tokens : wanted;
+}
+
+// Function to take count tokens from a sensor bucket, they must be available
+static void sensor_take(RateLimit* limit, int64_t now_ns, int count)
+{
+    if (sensor_bucket.interval_ns != 0 && count > 0)
+    {
+        int64_t start = limit->full_at_ns > now_ns ? limit->full_at_ns : now_ns;
+        limit->full_at_ns = start + count * sensor_bucket.interval_ns;
+    }
+}
+
+// Function to take up to wanted tokens from the global budget without a lock, returns how many were taken
+static int global_take(int64_t now_ns, int wanted)
+{
+    if (global_bucket.interval_ns == 0 || wanted == 0)
+    {
+        return wanted;
+    }
+    int64_t full_at = atomic_load_explicit(&global_full_at_ns, memory_order_relaxed);
+    while (1)
+    {
+        int taken = bucket_available(&global_bucket, full_at, now_ns, wanted);
+        if (taken == 0)
+        {
+            return 0;
+        }
+        int64_t start = full_at > now_ns ? full_at : now_ns;
+        if (atomic_compare_exchange_weak_explicit(&global_full_at_ns, &full_at,
+                                                  start + taken * global_bucket.interval_ns,
+                                                  memory_order_relaxed, memory_order_relaxed))
+        {
+            return taken;
+        }
+    }
+}
+
+// Function to report a sensor over the limits, at most once per RATE_REPORT_S
+static void report_over_limit(RateLimit* limit, int sensor_id, int64_t now_ns, int held)
+{
+    limit->unreported += (unsigned long)held;
+    if (now_ns - limit->reported_ns >= RATE_REPORT_S * 1000000000LL)
+    {
+        log_event(LOG_RATE_LIMITED, sensor_id, (double)limit->unreported, 0);
+        limit->reported_ns = now_ns;
+        limit->unreported = 0;
+    }
+}
+
+// Function to hand out the reading held back by the coalesce policy once both buckets have a token for it,
+// returns 1 if reading was filled in; it goes ahead of the frame being admitted
+int rate_limit_release(RateLimit* limit, int64_t now_ns, SensorReading* reading)
+{
+    if (!limit->has_pending || bucket_available(&sensor_bucket, limit->full_at_ns, now_ns, 1) == 0 ||
+        global_take(now_ns, 1) == 0)
+    {
+        return 0;
+    }
+    sensor_take(limit, now_ns, 1);
+    *reading = limit->pending;
+    limit->has_pending = 0;
+    return 1;
+}
+
+// Function to keep the readings of one frame that fit the sensor's bucket and the global budget and apply
+// the overload policy to the rest, returns how many readings are left at the start of readings
+int rate_limit_admit(RateLimit* limit, SensorReading* readings, int count, int64_t now_ns)
+{
+    // Tokens of the sensor are only spent on readings the global budget lets through as well
+    int admitted = global_take(now_ns, bucket_available(&sensor_bucket, limit->full_at_ns, now_ns, count));
+    sensor_take(limit, now_ns, admitted);
+    if (admitted == count)
+    {
+        return count;
+    }
+
+    int held = count - admitted;
+    int kept = admitted;
+    if (overload_policy == OVERLOAD_SAMPLE)
+    {
+        // Sampled readings skip the sensor's bucket but not the global budget
+        for (int i = admitted; i < count; i++)
+        {
+            if (++limit->misses % RATE_SAMPLE_EVERY == 0 && global_take(now_ns, 1) == 1)
+            {
+                readings[kept++] = readings[i];
+            }
+        }
+        metrics_count(METRIC_READINGS_SHED, (uint64_t)(count - kept));
+    }
+    else if (overload_policy == OVERLOAD_COALESCE)
+    {
+        // Only the newest reading survives, stamped now since it is stored later than it arrived
+        metrics_count(METRIC_READINGS_COALESCED, (uint64_t)(held - 1 + limit->has_pending));
+        limit->pending = readings[count - 1];
+        if (limit->pending.timestamp == 0)
+        {
+            limit->pending.timestamp = (long)time(NULL);
+        }
+        limit->has_pending = 1;
+    }
+    else
+    {
+        metrics_count(METRIC_READINGS_SHED, (uint64_t)held);
+    }
+    report_over_limit(limit, readings[0].sensor_id, now_ns, held);
+    return kept;
+}
+
+// Function to hand out the held back reading of a sensor that disconnects, whatever the buckets hold
+int rate_limit_flush(RateLimit* limit, SensorReading* reading)
+{
+    if (!limit->has_pending)
+    {
+        return 0;
+    }
+    *reading = limit->pending;
+    limit->has_pending = 0;
+    return 1;
+}
@@ -0,0 +1,279 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "rollup.h"
+
+#define ROLLUP_INITIAL_SIZE 256 // Initial number of buckets (power of two)
+#define ROLLUP_INITIAL_FINISHED 64
+
+const int rollup_resolutions[ROLLUP_LEVELS] = {60, 3600};
+
+// Function to spread sensor ids over the table (Fibonacci hashing)
+static size_t rollup_hash(int sensor_id, size_t size)
+{
+    uint64_t h = (uint64_t)(uint32_t)sensor_id * 0x9E3779B97F4A7C15ull;
+    return (size_t)(h >> 32) & (size - 1);
+}
+
+// Function to initialize an empty engine
+int rollup_init(RollupEngine* engine)
+{
+    memset(engine, 0, sizeof(*engine));
+    engine->entries = calloc(ROLLUP_INITIAL_SIZE, sizeof(RollupEntry));
+    engine->finished = malloc(ROLLUP_INITIAL_FINISHED * sizeof(RollupResult));
+    if (!engine->entries || !engine->finished)
+    {
+        rollup_destroy(engine);
+        return -1;
+    }
+    engine->size = ROLLUP_INITIAL_SIZE;
+    engine->finished_capacity = ROLLUP_INITIAL_FINISHED;
+    return 0;
+}
+
+// Function to release the engine, open windows are discarded
+void rollup_destroy(RollupEngine* engine)
+{
+    free(engine->entries);
+    free(engine->finished);
+    memset(engine, 0, sizeof(*engine));
+}
+
+// Function to find the bucket of a sensor id, or the empty bucket where it belongs
+static RollupEntry* find_entry(const RollupEngine* engine, int sensor_id)
+{
+    size_t mask = engine->size - 1;
+    for (size_t i = rollup_hash(sensor_id, engine->size);; i = (i + 1) & mask)
+    {
+        RollupEntry* entry = &engine->entries[i];
+        if (!entry->used || entry->sensor_id == sensor_id)
+        {
+            return entry;
+        }
+    }
+}
+
+// Function to double the table once it is three quarters full
+static int grow(RollupEngine* engine)
+{
+    RollupEngine bigger = {.entries = calloc(engine->size * 2, sizeof(RollupEntry)), .size = engine->size * 2};
+    if (!bigger.entries)
+    {
+        return -1;
+    }
+    for (size_t i = 0; i < engine->size; i++)
+    {
+        if (engine->entries[i].used)
+        {
+            *find_entry(&bigger, engine->entries[i].sensor_id) = engine->entries[i];
+        }
+    }
+    free(engine->entries);
+    engine->entries = bigger.entries;
+    engine->size = bigger.size;
+    return 0;
+}
+
+// Function to add an observation to a P-square quantile sketch (Jain and Chlamtac, 1985)
+static void sketch_add(QuantileSketch* s, long count, double x)
+{
+    const double p = ROLLUP_QUANTILE;
+
+    if (count < 5)
+    {
+        // Keep the first observations sorted, they become the initial markers
+        int i = (int)count;
+        while (i > 0 && s->q[i - 1] > x)
+        {
+            s->q[i] = s->q[i - 1];
+            i--;
+        }
+        s->q[i] = x;
+        if (count == 4)
+        {
+            const double np[5] = {1, 1 + 2 * p, 1 + 4 * p, 3 + 2 * p, 5};
+            for (i = 0; i < 5; i++)
+            {
+                s->n[i] = i + 1;
+                s->np[i] = np[i];
+            }
+        }
+        return;
+    }
+
+    int k;
+    if (x < s->q[0])
+    {
+        s->q[0] = x;
+        k = 0;
+    }
+    else if (x >= s->q[4])
+    {
+        s->q[4] = x;
+        k = 3;
+    }
+    else
+    {
+        k = 0;
+        while (x >= s->q[k + 1])
+        {
+            k++; // Cell whose markers bracket x
+        }
+    }
+
+    const double dn[5] = {0, p / 2, p, (1 + p) / 2, 1};
+    for (int i = 0; i < 5; i++)
+    {
+        s->n[i] += i > k;
+        s->np[i] += dn[i];
+    }
+
+    // Move the middle markers towards their desired positions
+    for (int i = 1; i < 4; i++)
+    {
+        double d = s->np[i] - s->n[i];
+        if ((d >= 1 && s->n[i + 1] - s->n[i] > 1) || (d <= -1 && s->n[i - 1] - s->n[i] < -1))
+        {
+            int step = d > 0 ? 1 : -1;
+            double q = s->q[i] + (double)step / (s->n[i + 1] - s->n[i - 1]) *
+                       ((s->n[i] - s->n[i - 1] + step) * (s->q[i + 1] - s->q[i]) / (s->n[i + 1] - s->n[i]) +
+                        (s->n[i + 1] - s->n[i] - step) * (s->q[i] - s->q[i - 1]) / (s->n[i] - s->n[i - 1]));
+            if (q <= s->q[i - 1] || q >= s->q[i + 1])
+            {
+                q = s->q[i] + step * (s->q[i + step] - s->q[i]) / (s->n[i + step] - s->n[i]); // Linear fallback
+            }
+            s->q[i] = q;
+            s->n[i] += step;
+        }
+    }
+}
+
+// Function to return the quantile estimate of a sketch
+double rollup_quantile(const QuantileSketch* sketch, long count)
+{
+    if (count >= 5)
+    {
+        return sketch->q[2];
+    }
+    int rank = (int)(ROLLUP_QUANTILE * count + 0.999999); // Nearest rank among the sorted observations
+    return count > 0 ? sketch->q[rank - 1] : 0.0;
+}
+
+// Function to return the population variance of a metric
+double rollup_variance(const RollupMetric* metric, long count)
+{
+    return count > 0 ? metric->m2 / count : 0.0;
+}
+
+// Function to fold one value into a metric, count is the number of values before this one
+static void metric_add(RollupMetric* metric, long count, double x)
+{
+    if (count == 0)
+    {
+        metric->min = metric->max = x;
+    }
+    else
+    {
+        metric->min = x < metric->min ? x : metric->min;
+        metric->max = x > metric->max ? x : metric->max;
+    }
+    double delta = x - metric->mean;
+    metric->mean += delta / (count + 1);
+    metric->m2 += delta * (x - metric->mean);
+    sketch_add(&metric->p95, count, x);
+}
+
+// Function to move a window with data to the finished list and reset it
+static int finish_window(RollupEngine* engine, RollupEntry* entry, int level)
+{
+    RollupWindow* window = &entry->windows[level];
+    if (window->count == 0)
+    {
+        return 0;
+    }
+
+    if (engine->finished_count == engine->finished_capacity)
+    {
+        RollupResult* grown = realloc(engine->finished, engine->finished_capacity * 2 * sizeof(RollupResult));
+        if (!grown)
+        {
+            return -1; // The window stays open and is retried on the next call
+        }
+        engine->finished = grown;
+        engine->finished_capacity *= 2;
+    }
+    RollupResult* result = &engine->finished[engine->finished_count++];
+    result->sensor_id = entry->sensor_id;
+    result->resolution = rollup_resolutions[level];
+    result->window = *window;
+    memset(window, 0, sizeof(*window));
+    return 0;
+}
+
+// Function to fold a stored reading into the open windows of its sensor
+int rollup_add(RollupEngine* engine, const SensorReading* reading, long ts)
+{
+    if ((engine->count + 1) * 4 > engine->size * 3 && grow(engine) == -1)
+    {
+        return -1;
+    }
+
+    RollupEntry* entry = find_entry(engine, reading->sensor_id);
+    if (!entry->used)
+    {
+        memset(entry, 0, sizeof(*entry));
+        entry->used = 1;
+        entry->sensor_id = reading->sensor_id;
+        engine->count++;
+    }
+
+    for (int level = 0; level < ROLLUP_LEVELS; level++)
+    {
+        long start = ts - ts % rollup_resolutions[level];
+        RollupWindow* window = &entry->windows[level];
+        if (window->count > 0 && start < window->start)
+        {
+            engine->late++; // Its window was already finished
+            continue;
+        }
+        if (window->count > 0 && start > window->start && finish_window(engine, entry, level) == -1)
+        {
+            return -1;
+        }
+        window->start = start;
+        metric_add(&window->temperature, window->count, reading->temperature);
+        metric_add(&window->humidity, window->count, reading->humidity);
+        window->count++;
+    }
+    return 0;
+}
+
+// Function to finish every window that ended more than the grace period before now
+int rollup_expire(RollupEngine* engine, long now)
+{
+    if (now == engine->last_expire)
+    {
+        return 0; // Windows only end on second boundaries
+    }
+    engine->last_expire = now;
+
+    for (size_t i = 0; i < engine->size; i++)
+    {
+        RollupEntry* entry = &engine->entries[i];
+        if (!entry->used)
+        {
+            continue;
+        }
+        for (int level = 0; level < ROLLUP_LEVELS; level++)
+        {
+            const RollupWindow* window = &entry->windows[level];
+            if (window->count > 0 && window->start + rollup_resolutions[level] + ROLLUP_GRACE_S <= now &&
+                finish_window(engine, entry, level) == -1)
+            {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
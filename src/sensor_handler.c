@@ -1,58 +1,138 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <time.h>
 #include "sensor_handler.h"
 #include "log.h"
 #include "storage_manager.h"
+#include "worker_pool.h"
+#include "sensor_parser.h"
+#include "sensor_registry.h"
+#include "metrics.h"
+#include "rate_limit.h"
 
-#define BUFF_SIZE 1024 // Buffer size for reading messages
+#define BUFF_SIZE 4096 // Bytes taken from the socket per read, may hold many frames
 
-// Function to handle messages from a sensor node
-void* handle_sensor_messages(void* arg)
+// Function to parse every complete frame in a chunk of bytes received from a sensor node
+void handle_sensor_bytes(SensorSlot* slot, const char* data, size_t length)
 {
-    SharedData* shared = (SharedData*)arg; // Shared data between threads
-    SensorConnection* conn = &shared->sensor_data.sensor_connections[shared->sensor_data.connection_count - 1]; // Get the latest sensor connection
+    SensorReading readings[BINARY_BATCH_MAX]; // A batch frame yields all its readings at once
+    if (length == 0)
+    {
+        return; // An ID frame that carried no readings
+    }
+    int64_t start = metrics_now_ns();
+    int received = 0;
+    while (length > 0)
+    {
+        int count = frame_parser_next(&slot->parser, &data, &length, readings);
+        if (count > 0)
+        {
+            if (readings[0].sensor_id != slot->conn.id)
+            {
+                // A node may only report for the ID it registered with
+                log_event(LOG_INVALID_SENSOR_ID, readings[0].sensor_id, 0, 0);
+                continue;
+            }
+            received += count;
+
+            // A reading held back while the sensor was over its limit goes first, it is the older one
+            SensorReading held;
+            if (rate_limit_release(&slot->limit, start, &held))
+            {
+                worker_pool_submit(slot, &held, 1);
+            }
+            count = rate_limit_admit(&slot->limit, readings, count, start);
+            if (count > 0)
+            {
+                worker_pool_submit(slot, readings, count); // Hand the readings to the worker pool as one unit
+            }
+        }
+        else if (count == PARSE_INVALID)
+        {
+            // Log an error if the data format is invalid
+            log_event(LOG_INVALID_FORMAT, slot->conn.id, 0, 0);
+            metrics_count(METRIC_FRAMES_INVALID, 1);
+        }
+    }
+    metrics_count(METRIC_READINGS_RECEIVED, (uint64_t)received);
+    metrics_observe(STAGE_PARSE, metrics_now_ns() - start);
+}
+
+// Function to handle readable events from a sensor node, returns -1 once the connection is closed
+int handle_sensor_messages(SharedData* shared, SensorSlot* slot)
+{
+    SensorConnection* conn = &slot->conn; // Stable handle kept by the event loop
     char buffer[BUFF_SIZE]; // Buffer to hold incoming messages
 
-    while (!shared->should_exit)
+    // The socket is edge-triggered, so keep reading until the kernel buffer is empty
+    while (1)
     {
-        memset(buffer, 0, BUFF_SIZE); // Clear the buffer
-        int bytes_read = read(conn->socket_fd, buffer, BUFF_SIZE); // Read data from the sensor node
+        ssize_t bytes_read = read(conn->socket_fd, buffer, BUFF_SIZE); // Read data from the sensor node
+
+        if (bytes_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return 0; // Nothing more to read for now
+        }
+        if (bytes_read < 0 && errno == EINTR)
+        {
+            continue;
+        }
 
         if (bytes_read <= 0)
         {
+            // The latest reading held back by the coalesce policy is stored rather than lost
+            SensorReading held;
+            if (rate_limit_flush(&slot->limit, &held))
+            {
+                worker_pool_submit(slot, &held, 1);
+            }
+
             // If read fails, log the disconnection and update the shared data
             pthread_mutex_lock(&shared->sensor_data.mutex);
-            write_log("Sensor node %d has closed the connection", conn->id);
-            shared->sensor_data.connected_sensors[conn->id] = 0;
+            log_event(LOG_SENSOR_CLOSED, conn->id, 0, 0);
+            close(conn->socket_fd); // Close the socket before the slot can be reused
+            conn->socket_fd = -1;
+            slot->connected = 0;
+            shared->sensor_data.connection_count--;
             pthread_mutex_unlock(&shared->sensor_data.mutex);
-            close(conn->socket_fd); // Close the socket
-            break; // Exit the loop
+            return -1;
         }
+        handle_sensor_bytes(slot, buffer, (size_t)bytes_read);
+    }
+}
 
-        pthread_mutex_lock(&shared->sensor_data.mutex); // Lock the mutex to access shared data
-        int sensor_id;
-        double temperature, humidity;
-        // Parse the incoming message
-        if (sscanf(buffer, "SENSOR:%d,TEMP:%lf,HUM:%lf", &sensor_id, &temperature, &humidity) == 3)
+// Function to submit the readings held back by the coalesce policy, the event loops must be stopped and the
+// workers still running
+void flush_held_readings(SharedData* shared)
+{
+    size_t slot_count = sensor_registry_count(&shared->sensor_data.registry);
+    for (size_t i = 0; i < slot_count; i++)
+    {
+        SensorSlot* slot = sensor_registry_slot_at(&shared->sensor_data.registry, i);
+        SensorReading held;
+        if (rate_limit_flush(&slot->limit, &held))
         {
-            // Update the shared data with the new sensor readings
-            shared->sensor_data.running_temps[sensor_id] = temperature;
-            shared->sensor_data.running_humidity[sensor_id] = humidity;
-            write_log("Sensor node %d reports temperature: %.1f, humidity: %.1f",
-                      sensor_id, temperature, humidity);
-
-            // Insert the sensor data into the database immediately
-            insert_sensor_data(shared, sensor_id, temperature, humidity);
+            worker_pool_submit(slot, &held, 1);
         }
-        else
-        {
-            // Log an error if the data format is invalid
-            write_log("Invalid data format from sensor node %d", conn->id);
-        }
-        pthread_mutex_unlock(&shared->sensor_data.mutex); // Unlock the mutex
     }
-    return NULL; // Return NULL when done
+}
+
+// Function run by the worker pool for the readings of one frame
+void process_sensor_readings(SharedData* shared, SensorSlot* slot, const SensorReading* readings, int count)
+{
+    // Publish the latest values without a lock, readers retry if they overlap the update
+    const SensorReading* last = &readings[count - 1];
+    sensor_slot_publish(slot, last->temperature, last->humidity, last->timestamp ? last->timestamp : (long)time(NULL));
+
+    for (int i = 0; i < count; i++)
+    {
+        log_event(LOG_READING, readings[i].sensor_id, readings[i].temperature, readings[i].humidity);
+    }
+
+    // Queue the sensor data for the storage writer immediately, a batch stays contiguous
+    insert_sensor_batch(shared, readings, count);
 }
\ No newline at end of file
@@ -0,0 +1,435 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include "sensor_parser.h"
+
+#define MAX_DECIMAL_DIGITS 18 // Digits that fit the integer mantissa of a decimal value
+
+_Static_assert(BINARY_BATCH_FRAME_MAX <= FRAME_MAX_SIZE, "a binary batch frame must fit the partial frame buffer");
+
+static const double powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+    1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18
+};
+
+static const uint16_t crc16_nibbles[16] = { // CRC-16/CCITT (polynomial 0x1021) of every 4-bit value
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+
+// Function to match a fixed token, returns the position after it or NULL
+static const char* expect_token(const char* s, const char* end, const char* token, size_t token_length)
+{
+    if ((size_t)(end - s) < token_length || memcmp(s, token, token_length) != 0)
+    {
+        return NULL;
+    }
+    return s + token_length;
+}
+
+// Function to parse an optionally negative integer, returns the position after it or NULL
+static const char* parse_int(const char* s, const char* end, int* out)
+{
+    int negative = (s < end && *s == '-');
+    s += negative;
+
+    const char* digits = s;
+    long value = 0;
+    while (s < end && (unsigned char)(*s - '0') < 10)
+    {
+        value = value * 10 + (*s - '0');
+        if (value > INT_MAX)
+        {
+            return NULL; // Out of range for a sensor id
+        }
+        s++;
+    }
+    if (s == digits)
+    {
+        return NULL;
+    }
+    *out = negative ? (int)-value : (int)value;
+    return s;
+}
+
+// Function to parse a plain decimal number such as -12.34, returns the position after it or NULL
+static const char* parse_decimal(const char* s, const char* end, double* out)
+{
+    int negative = (s < end && *s == '-');
+    s += negative;
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int scale = 0; // Digits after the decimal point
+    while (s < end && (unsigned char)(*s - '0') < 10)
+    {
+        mantissa = mantissa * 10 + (uint64_t)(*s++ - '0');
+        digits++;
+    }
+    if (s < end && *s == '.')
+    {
+        s++;
+        while (s < end && (unsigned char)(*s - '0') < 10)
+        {
+            mantissa = mantissa * 10 + (uint64_t)(*s++ - '0');
+            digits++;
+            scale++;
+        }
+    }
+    if (digits == 0 || digits > MAX_DECIMAL_DIGITS)
+    {
+        return NULL;
+    }
+
+    // Both operands are exact, so the division rounds the same way strtod does for short inputs
+    double value = (double)mantissa / powers_of_ten[scale];
+    *out = negative ? -value : value;
+    return s;
+}
+
+// Function to parse one complete SENSOR:<id>,TEMP:<t>,HUM:<h> frame
+static int parse_reading(const char* s, const char* end, SensorReading* reading)
+{
+    if ((s = expect_token(s, end, "SENSOR:", 7)) == NULL ||
+        (s = parse_int(s, end, &reading->sensor_id)) == NULL ||
+        (s = expect_token(s, end, ",TEMP:", 6)) == NULL ||
+        (s = parse_decimal(s, end, &reading->temperature)) == NULL ||
+        (s = expect_token(s, end, ",HUM:", 5)) == NULL ||
+        (s = parse_decimal(s, end, &reading->humidity)) == NULL)
+    {
+        return -1;
+    }
+    return s == end ? 0 : -1; // Reject trailing garbage
+}
+
+// Function to find the end of the current frame, NULL if it continues past the input
+static const char* find_frame_end(const char* data, size_t length, char previous)
+{
+    // Frames end at a newline; nodes that send no newline are split where a digit runs into SENSOR:
+    for (size_t i = 0; i < length; i++)
+    {
+        char c = data[i];
+        if (c == '\n' || (c == 'S' && (unsigned char)(previous - '0') < 10))
+        {
+            return data + i;
+        }
+        previous = c;
+    }
+    return NULL;
+}
+
+// Function to forget any partial frame and select the framing of a (re)opened connection
+void frame_parser_reset(FrameParser* parser, int binary_version)
+{
+    parser->length = 0;
+    parser->overflow = 0;
+    parser->binary_version = binary_version;
+    parser->skip = 0;
+}
+
+// Function to compute the CRC-16/CCITT-FALSE of a binary payload, four bits at a time
+uint16_t frame_crc16(const unsigned char* data, size_t length)
+{
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < length; i++)
+    {
+        crc = (uint16_t)((crc << 4) ^ crc16_nibbles[(crc >> 12) ^ (data[i] >> 4)]);
+        crc = (uint16_t)((crc << 4) ^ crc16_nibbles[(crc >> 12) ^ (data[i] & 0x0F)]);
+    }
+    return crc;
+}
+
+// Function to read a big-endian 16-bit field
+static uint16_t read_be16(const unsigned char* p)
+{
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+// Function to read a big-endian 32-bit field
+static uint32_t read_be32(const unsigned char* p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+// Function to write a big-endian 32-bit field
+static void write_be32(unsigned char* p, uint32_t value)
+{
+    p[0] = (unsigned char)(value >> 24);
+    p[1] = (unsigned char)(value >> 16);
+    p[2] = (unsigned char)(value >> 8);
+    p[3] = (unsigned char)value;
+}
+
+// Function to write one timestamped sample (timestamp, temperature, humidity)
+static void write_sample(unsigned char* p, const SensorReading* reading)
+{
+    float temperature = (float)reading->temperature;
+    float humidity = (float)reading->humidity;
+    uint32_t bits;
+
+    write_be32(p, (uint32_t)reading->timestamp);
+    memcpy(&bits, &temperature, sizeof(bits));
+    write_be32(p + 4, bits);
+    memcpy(&bits, &humidity, sizeof(bits));
+    write_be32(p + 8, bits);
+}
+
+// Function to read one timestamped sample written by write_sample
+static void read_sample(const unsigned char* p, int sensor_id, SensorReading* reading)
+{
+    float temperature, humidity;
+    uint32_t bits = read_be32(p + 4);
+    memcpy(&temperature, &bits, sizeof(temperature));
+    bits = read_be32(p + 8);
+    memcpy(&humidity, &bits, sizeof(humidity));
+
+    reading->sensor_id = sensor_id;
+    reading->timestamp = (long)read_be32(p);
+    reading->temperature = temperature;
+    reading->humidity = humidity;
+}
+
+// Function to add the optional CRC and the length prefix around an encoded payload
+static size_t finish_binary_frame(unsigned char* out, size_t payload_length, int with_crc)
+{
+    unsigned char* payload = out + 2;
+    if (with_crc)
+    {
+        uint16_t crc = frame_crc16(payload, payload_length);
+        payload[payload_length++] = (unsigned char)(crc >> 8);
+        payload[payload_length++] = (unsigned char)crc;
+    }
+    out[0] = (unsigned char)(payload_length >> 8);
+    out[1] = (unsigned char)payload_length;
+    return 2 + payload_length;
+}
+
+// Function to encode a reading as a version 1 frame, out must hold BINARY_FRAME_MAX bytes
+size_t encode_binary_frame(unsigned char* out, const SensorReading* reading, int with_crc)
+{
+    unsigned char* payload = out + 2;
+    payload[0] = 1;
+    payload[1] = with_crc ? BINARY_FLAG_CRC : 0;
+    write_be32(payload + 2, (uint32_t)reading->sensor_id);
+    write_sample(payload + 6, reading);
+    return finish_binary_frame(out, BINARY_PAYLOAD_SIZE, with_crc);
+}
+
+// Function to encode up to BINARY_BATCH_MAX readings of one sensor as a version 2 batch frame
+size_t encode_binary_batch(unsigned char* out, const SensorReading* readings, int count, int with_crc)
+{
+    unsigned char* payload = out + 2;
+    payload[0] = 2;
+    payload[1] = BINARY_FLAG_BATCH | (with_crc ? BINARY_FLAG_CRC : 0);
+    write_be32(payload + 2, (uint32_t)readings[0].sensor_id);
+    payload[6] = (unsigned char)(count >> 8);
+    payload[7] = (unsigned char)count;
+    for (int i = 0; i < count; i++)
+    {
+        write_sample(payload + BINARY_BATCH_HEADER + (size_t)i * BINARY_SAMPLE_SIZE, &readings[i]);
+    }
+    return finish_binary_frame(out, BINARY_BATCH_HEADER + (size_t)count * BINARY_SAMPLE_SIZE, with_crc);
+}
+
+// Function to decode the payload of one binary frame (everything after the length prefix)
+static int decode_binary(const unsigned char* payload, size_t length, int max_version, SensorReading* readings)
+{
+    if (length < 2 || payload[0] == 0 || payload[0] > max_version)
+    {
+        return PARSE_INVALID; // Not a version this connection negotiated
+    }
+
+    int batch = (payload[1] & BINARY_FLAG_BATCH) != 0;
+    if (batch && payload[0] < 2)
+    {
+        return PARSE_INVALID; // Batches were introduced with version 2
+    }
+
+    size_t crc_length = (payload[1] & BINARY_FLAG_CRC) ? 2 : 0;
+    size_t header = batch ? BINARY_BATCH_HEADER : BINARY_PAYLOAD_SIZE - BINARY_SAMPLE_SIZE;
+    if (length < header + crc_length)
+    {
+        return PARSE_INVALID;
+    }
+    int count = batch ? (payload[6] << 8) | payload[7] : 1;
+    size_t body = header + (size_t)count * BINARY_SAMPLE_SIZE;
+    if (count == 0 || count > BINARY_BATCH_MAX || length != body + crc_length)
+    {
+        return PARSE_INVALID;
+    }
+    if (crc_length && read_be16(payload + body) != frame_crc16(payload, body))
+    {
+        return PARSE_INVALID; // Corrupted on the way
+    }
+
+    int sensor_id = (int32_t)read_be32(payload + 2);
+    for (int i = 0; i < count; i++)
+    {
+        read_sample(payload + header + (size_t)i * BINARY_SAMPLE_SIZE, sensor_id, &readings[i]);
+    }
+    return count;
+}
+
+// Function to extract the next length-prefixed binary frame from the input
+static int binary_parser_next(FrameParser* parser, const unsigned char** data, size_t* length, SensorReading* readings)
+{
+    while (*length > 0)
+    {
+        if (parser->skip > 0)
+        {
+            // Drop the rest of an oversized frame, the length prefix tells where the next one starts
+            size_t n = parser->skip < *length ? parser->skip : *length;
+            *data += n;
+            *length -= n;
+            parser->skip -= n;
+            if (parser->skip == 0)
+            {
+                return PARSE_INVALID;
+            }
+            continue;
+        }
+
+        if (parser->length == 0 && *length >= 2)
+        {
+            // Decode straight from the read buffer when the whole frame is there
+            size_t frame_length = 2 + (size_t)read_be16(*data);
+            if (*length >= frame_length)
+            {
+                const unsigned char* frame = *data;
+                *data += frame_length;
+                *length -= frame_length;
+                return decode_binary(frame + 2, frame_length - 2, parser->binary_version, readings);
+            }
+        }
+
+        unsigned char* partial = (unsigned char*)parser->partial;
+        size_t frame_length = parser->length < 2 ? 2 : 2 + (size_t)read_be16(partial);
+        if (frame_length > BINARY_BATCH_FRAME_MAX)
+        {
+            parser->skip = frame_length - parser->length;
+            parser->length = 0;
+            continue;
+        }
+
+        size_t n = frame_length - parser->length < *length ? frame_length - parser->length : *length;
+        memcpy(partial + parser->length, *data, n);
+        parser->length += n;
+        *data += n;
+        *length -= n;
+        if (parser->length >= 2 && parser->length == 2 + (size_t)read_be16(partial))
+        {
+            size_t payload_length = parser->length - 2;
+            parser->length = 0;
+            return decode_binary(partial + 2, payload_length, parser->binary_version, readings);
+        }
+    }
+    return PARSE_NEED_MORE;
+}
+
+// Function to extract the next frame from the input, advancing data and length past what was used.
+// Returns the number of readings stored (readings must hold BINARY_BATCH_MAX), PARSE_NEED_MORE or PARSE_INVALID
+int frame_parser_next(FrameParser* parser, const char** data, size_t* length, SensorReading* readings)
+{
+    if (parser->binary_version)
+    {
+        return binary_parser_next(parser, (const unsigned char**)data, length, readings);
+    }
+
+    SensorReading* reading = &readings[0]; // Text frames carry a single reading
+    reading->timestamp = 0; // Text frames carry no node time
+    while (*length > 0)
+    {
+        const char* start = *data;
+        char previous = parser->length > 0 ? parser->partial[parser->length - 1] : '\0';
+        const char* end = find_frame_end(start, *length, previous);
+        if (!end)
+        {
+            // Keep the unfinished frame until the rest arrives
+            if (!parser->overflow && parser->length + *length <= TEXT_FRAME_MAX)
+            {
+                memcpy(parser->partial + parser->length, start, *length);
+                parser->length += *length;
+            }
+            else
+            {
+                parser->overflow = 1;
+                parser->length = 0;
+            }
+            *data += *length;
+            *length = 0;
+            return PARSE_NEED_MORE;
+        }
+
+        size_t frame_length = (size_t)(end - start);
+        size_t used = frame_length + (*end == '\n'); // A SENSOR: boundary belongs to the next frame
+        *data += used;
+        *length -= used;
+
+        if (parser->overflow)
+        {
+            parser->overflow = 0;
+            return PARSE_INVALID;
+        }
+
+        const char* frame = start;
+        const char* frame_end = end;
+        if (parser->length > 0)
+        {
+            // Complete the frame held from the previous read
+            if (parser->length + frame_length > TEXT_FRAME_MAX)
+            {
+                parser->length = 0;
+                return PARSE_INVALID;
+            }
+            memcpy(parser->partial + parser->length, start, frame_length);
+            frame = parser->partial;
+            frame_end = parser->partial + parser->length + frame_length;
+            parser->length = 0;
+        }
+
+        if (frame_end > frame && frame_end[-1] == '\r')
+        {
+            frame_end--;
+        }
+        if (frame_end == frame)
+        {
+            continue; // Empty line between frames
+        }
+        return parse_reading(frame, frame_end, reading) == 0 ? 1 : PARSE_INVALID;
+    }
+    return PARSE_NEED_MORE;
+}
+
+// Function to parse the ID:<id>[,BIN:<version>] handshake, consumed is set to the bytes that belong to it
+int parse_id_frame(const char* data, size_t length, int* sensor_id, int* binary_version, size_t* consumed)
+{
+    const char* end = data + length;
+    const char* s = expect_token(data, end, "ID:", 3);
+    if (!s || (s = parse_int(s, end, sensor_id)) == NULL)
+    {
+        return -1;
+    }
+
+    *binary_version = 0;
+    const char* bin = expect_token(s, end, ",BIN:", 5);
+    if (bin && ((s = parse_int(bin, end, binary_version)) == NULL || *binary_version <= 0))
+    {
+        return -1;
+    }
+
+    if (s < end && *s == '\r')
+    {
+        s++;
+    }
+    if (s < end && *s == '\n')
+    {
+        s++;
+    }
+    else if (*binary_version || (s < end && *s != 'S'))
+    {
+        return -1; // Binary frames may follow at once, so the handshake must end with a newline
+    }
+    *consumed = (size_t)(s - data);
+    return 0;
+}
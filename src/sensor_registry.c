@@ -0,0 +1,191 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "sensor_registry.h"
+
+#define REGISTRY_INITIAL_SIZE 64 // Initial number of index buckets (power of two)
+
+// Function to spread sensor ids over the index (Fibonacci hashing)
+static size_t registry_hash(int sensor_id, size_t table_size)
+{
+    uint64_t h = (uint64_t)(uint32_t)sensor_id * 0x9E3779B97F4A7C15ull;
+    return (size_t)(h >> 32) & (table_size - 1);
+}
+
+// Function to initialize an empty registry holding at most max_slots sensor ids
+int sensor_registry_init(SensorRegistry* registry, size_t max_slots)
+{
+    memset(registry, 0, sizeof(*registry));
+    registry->table = calloc(REGISTRY_INITIAL_SIZE, sizeof(SensorSlot*));
+    if (!registry->table)
+    {
+        return -1;
+    }
+    registry->table_size = REGISTRY_INITIAL_SIZE;
+    registry->max_slots = max_slots < REGISTRY_CHUNK_SLOTS * REGISTRY_MAX_CHUNKS ?
+                          max_slots : REGISTRY_CHUNK_SLOTS * REGISTRY_MAX_CHUNKS;
+    return 0;
+}
+
+// Function to release every slot and the index
+void sensor_registry_destroy(SensorRegistry* registry)
+{
+    for (size_t i = 0; i < registry->chunk_count; i++)
+    {
+        free(registry->chunks[i]);
+    }
+    free(registry->table);
+    memset(registry, 0, sizeof(*registry));
+}
+
+// Function to look up the slot of a sensor id, NULL if the id was never seen
+SensorSlot* sensor_registry_find(const SensorRegistry* registry, int sensor_id)
+{
+    size_t mask = registry->table_size - 1;
+    for (size_t i = registry_hash(sensor_id, registry->table_size);; i = (i + 1) & mask)
+    {
+        SensorSlot* slot = registry->table[i];
+        if (!slot || slot->conn.id == sensor_id)
+        {
+            return slot; // Linear probing stops at the first empty bucket
+        }
+    }
+}
+
+// Function to double the index once it becomes too full
+static int registry_grow_table(SensorRegistry* registry)
+{
+    size_t new_size = registry->table_size * 2;
+    SensorSlot** new_table = calloc(new_size, sizeof(SensorSlot*));
+    if (!new_table)
+    {
+        return -1;
+    }
+
+    for (size_t i = 0; i < registry->table_size; i++)
+    {
+        SensorSlot* slot = registry->table[i];
+        if (slot)
+        {
+            size_t j = registry_hash(slot->conn.id, new_size);
+            while (new_table[j])
+            {
+                j = (j + 1) & (new_size - 1);
+            }
+            new_table[j] = slot;
+        }
+    }
+
+    free(registry->table);
+    registry->table = new_table;
+    registry->table_size = new_size;
+    return 0;
+}
+
+// Function to return the next unused slot, adding a chunk when the current ones are full
+static SensorSlot* registry_new_slot(SensorRegistry* registry)
+{
+    size_t count = atomic_load_explicit(&registry->slot_count, memory_order_relaxed);
+    if (count == registry->chunk_count * REGISTRY_CHUNK_SLOTS)
+    {
+        // Cache-line aligned so each live reading starts on its own line
+        size_t bytes = REGISTRY_CHUNK_SLOTS * sizeof(SensorSlot);
+        SensorSlot* chunk = aligned_alloc(_Alignof(SensorSlot), bytes);
+        if (!chunk)
+        {
+            return NULL;
+        }
+        memset(chunk, 0, bytes);
+        registry->chunks[registry->chunk_count++] = chunk;
+    }
+    return sensor_registry_slot_at(registry, count);
+}
+
+// Function to return the slot of a sensor id, creating it on first use; NULL once max_slots ids are known
+SensorSlot* sensor_registry_get_or_add(SensorRegistry* registry, int sensor_id)
+{
+    SensorSlot* slot = sensor_registry_find(registry, sensor_id);
+    if (slot)
+    {
+        return slot;
+    }
+
+    if (registry->slot_count == registry->max_slots)
+    {
+        return NULL; // A node cycling through ids must not grow memory without bound
+    }
+    // Keep the load factor below 3/4 so probe sequences stay short
+    if ((registry->slot_count + 1) * 4 > registry->table_size * 3 && registry_grow_table(registry) == -1)
+    {
+        return NULL;
+    }
+
+    slot = registry_new_slot(registry);
+    if (!slot)
+    {
+        return NULL;
+    }
+    slot->conn.id = sensor_id;
+    slot->conn.socket_fd = -1;
+    // Lock-free readers only look at slots below slot_count, so publish the filled-in slot last
+    atomic_fetch_add_explicit(&registry->slot_count, 1, memory_order_release);
+
+    size_t i = registry_hash(sensor_id, registry->table_size);
+    while (registry->table[i])
+    {
+        i = (i + 1) & (registry->table_size - 1);
+    }
+    registry->table[i] = slot;
+    return slot;
+}
+
+// Function to return the slot stored at a dense index, used to iterate all sensors
+SensorSlot* sensor_registry_slot_at(const SensorRegistry* registry, size_t index)
+{
+    return &registry->chunks[index / REGISTRY_CHUNK_SLOTS][index % REGISTRY_CHUNK_SLOTS];
+}
+
+// Function to return the number of slots, safe to call without the sensor mutex
+size_t sensor_registry_count(const SensorRegistry* registry)
+{
+    return atomic_load_explicit(&registry->slot_count, memory_order_acquire);
+}
+
+// Function to publish the latest reading of a slot (seqlock writer, concurrent writers take turns)
+void sensor_slot_publish(SensorSlot* slot, double temperature, double humidity, long at)
+{
+    LiveReading* live = &slot->live;
+    unsigned sequence = atomic_load_explicit(&live->sequence, memory_order_relaxed);
+    do
+    {
+        while (sequence & 1)
+        {
+            sequence = atomic_load_explicit(&live->sequence, memory_order_relaxed); // Another writer is inside
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&live->sequence, &sequence, sequence + 1,
+                                                    memory_order_acquire, memory_order_relaxed));
+    atomic_thread_fence(memory_order_release); // The odd sequence is visible before any new value
+
+    atomic_store_explicit(&live->temperature, temperature, memory_order_relaxed);
+    atomic_store_explicit(&live->humidity, humidity, memory_order_relaxed);
+    atomic_store_explicit(&live->at, at, memory_order_relaxed);
+
+    atomic_store_explicit(&live->sequence, sequence + 2, memory_order_release);
+}
+
+// Function to read a consistent copy of the latest reading of a slot (seqlock reader, never blocks writers)
+void sensor_slot_snapshot(const SensorSlot* slot, LiveValue* value)
+{
+    LiveReading* live = (LiveReading*)&slot->live; // Loads of atomics need a non-const pointer
+    unsigned before, after;
+    do
+    {
+        before = atomic_load_explicit(&live->sequence, memory_order_acquire);
+        value->temperature = atomic_load_explicit(&live->temperature, memory_order_relaxed);
+        value->humidity = atomic_load_explicit(&live->humidity, memory_order_relaxed);
+        value->at = atomic_load_explicit(&live->at, memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire); // The values are read before the sequence is checked again
+        after = atomic_load_explicit(&live->sequence, memory_order_relaxed);
+    } while (before != after || (before & 1));
+}
@@ -1,21 +1,23 @@
+#define _GNU_SOURCE // accept4
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
 #include <arpa/inet.h>
+#include <sys/un.h>
 #include "socket_utils.h"
 #include "log.h"
 
-#define LISTEN_BACKLOG 5 // Maximum length to which the queue of pending connections may grow
-
-// Function to create a server socket
-int create_server_socket(int port)
+// Function to create a server socket that other sockets of this user may share the port with (SO_REUSEPORT),
+// the kernel spreads new connections over them; backlog is the length of its own queue of pending connections
+int create_server_socket(int port, int backlog)
 {
     int server_fd;
     struct sockaddr_in server_addr;
 
     // Create a socket
-    server_fd = socket(AF_INET, SOCK_STREAM, 0);
+    server_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     if (server_fd == -1)
     {
         write_log("Failed to create socket"); // Log if socket creation fails
@@ -23,8 +25,9 @@ int create_server_socket(int port)
     }
 
     int opt = 1;
-    // Set socket options to reuse the address
-    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) == -1)
+    // Set socket options to reuse the address, and to share the port with the other acceptors
+    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) == -1 ||
+        setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) == -1)
     {
         write_log("Failed to set socket options"); // Log if setting socket options fails
         close(server_fd); // Close the socket
@@ -46,7 +49,7 @@ int create_server_socket(int port)
     }
 
     // Listen for incoming connections
-    if (listen(server_fd, LISTEN_BACKLOG) == -1)
+    if (listen(server_fd, backlog) == -1)
     {
         write_log("Failed to listen on socket"); // Log if listening fails
         close(server_fd); // Close the socket
@@ -57,15 +60,70 @@ int create_server_socket(int port)
     return server_fd; // Return the server file descriptor
 }
 
-// Function to accept a client connection
+// Function to check whether the port is taken, binding it once without SO_REUSEPORT: sockets that set it join
+// each other's group instead of failing, so a second gateway would otherwise split the sensors with the first
+int server_port_in_use(int port)
+{
+    int probe_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (probe_fd == -1)
+    {
+        write_log("Failed to create socket"); // Log if socket creation fails
+        return -1;
+    }
+
+    int opt = 1;
+    setsockopt(probe_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)); // Connections in TIME_WAIT do not count
+
+    struct sockaddr_in server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_addr.s_addr = INADDR_ANY;
+    server_addr.sin_port = htons(port);
+    int in_use = bind(probe_fd, (struct sockaddr*)&server_addr, sizeof(server_addr)) == -1 && errno == EADDRINUSE;
+    close(probe_fd);
+    return in_use;
+}
+
+// Function to accept a client connection as a non-blocking socket, -1 once the queue is empty
 int accept_client_connection(int server_fd, struct sockaddr_in *client_addr)
 {
     socklen_t client_len = sizeof(*client_addr);
     // Accept an incoming connection
-    int client_fd = accept(server_fd, (struct sockaddr*)client_addr, &client_len);
-    if (client_fd == -1)
+    int client_fd = accept4(server_fd, (struct sockaddr*)client_addr, &client_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (client_fd == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != ECONNABORTED && errno != EINTR)
     {
         write_log("Failed to accept connection"); // Log if accepting connection fails
     }
     return client_fd; // Return the client file descriptor
+}
+
+// Function to create a local (Unix domain) server socket of the given type, replacing a stale socket file
+int create_unix_server_socket(const char* path, int type, int backlog)
+{
+    struct sockaddr_un server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(server_addr.sun_path))
+    {
+        write_log("Socket path too long: %s", path); // Log if the path does not fit
+        return -1;
+    }
+    strcpy(server_addr.sun_path, path);
+
+    int server_fd = socket(AF_UNIX, type | SOCK_CLOEXEC, 0);
+    if (server_fd == -1)
+    {
+        write_log("Failed to create socket"); // Log if socket creation fails
+        return -1;
+    }
+
+    unlink(path); // Left behind by a previous run
+    if (bind(server_fd, (struct sockaddr*)&server_addr, sizeof(server_addr)) == -1 ||
+        listen(server_fd, backlog) == -1)
+    {
+        write_log("Failed to listen on %s", path); // Log if binding or listening fails
+        close(server_fd); // Close the socket
+        return -1;
+    }
+    return server_fd; // Return the server file descriptor
 }
\ No newline at end of file
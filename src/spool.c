@@ -0,0 +1,343 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "spool.h"
+#include "log.h"
+
+#define SPOOL_MAGIC "SPOOL01" // 8 bytes with the terminator
+#define SPOOL_HEADER_SIZE 64
+#define SPOOL_SEGMENT_BYTES (SPOOL_HEADER_SIZE + (size_t)SPOOL_SEGMENT_RECORDS * sizeof(SpoolRecord))
+#define SPOOL_CHECKPOINT SPOOL_DIR "/checkpoint"
+#define SPOOL_PATH_SIZE 64
+
+typedef struct
+{
+    char magic[8];
+    uint64_t id;
+    uint32_t record_size; // Guards against reading segments written by a different layout
+} SpoolHeader;
+
+_Static_assert(sizeof(SpoolRecord) == 32, "spool records are 32 bytes on disk");
+_Static_assert(sizeof(SpoolHeader) <= SPOOL_HEADER_SIZE, "spool header must fit its reserved space");
+
+// Function to checksum a record (FNV-1a over every field but the checksum itself)
+static uint32_t record_check(const SpoolRecord* record)
+{
+    const unsigned char* bytes = (const unsigned char*)record;
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < sizeof(SpoolRecord); i++)
+    {
+        if (i < offsetof(SpoolRecord, check) || i >= offsetof(SpoolRecord, check) + sizeof(record->check))
+        {
+            h = (h ^ bytes[i]) * 16777619u;
+        }
+    }
+    return h ? h : 1;
+}
+
+// Function to return the records of a mapped segment
+static SpoolRecord* segment_records(const SpoolSegment* segment)
+{
+    return (SpoolRecord*)((char*)segment->map + SPOOL_HEADER_SIZE);
+}
+
+// Function to format the file name of a segment
+static void segment_path(uint64_t id, char* path, size_t size)
+{
+    snprintf(path, size, SPOOL_DIR "/%020llu.seg", (unsigned long long)id);
+}
+
+// Function to map a segment file, creating it or finding where its valid records end
+static int map_segment(SpoolSegment* segment, uint64_t id, int create)
+{
+    char path[SPOOL_PATH_SIZE];
+    segment_path(id, path, sizeof(path));
+
+    int fd = open(path, O_RDWR | (create ? O_CREAT | O_EXCL : 0), 0644);
+    if (fd == -1 || (create && ftruncate(fd, (off_t)SPOOL_SEGMENT_BYTES) == -1))
+    {
+        write_log("Failed to open spool segment %s: %s", path, strerror(errno)); // Log error
+        if (fd != -1)
+        {
+            close(fd);
+        }
+        return -1;
+    }
+    void* map = mmap(NULL, SPOOL_SEGMENT_BYTES, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd); // The mapping keeps the file open
+    if (map == MAP_FAILED)
+    {
+        write_log("Failed to map spool segment %s", path); // Log error
+        return -1;
+    }
+
+    SpoolHeader* header = (SpoolHeader*)map;
+    segment->id = id;
+    segment->map = map;
+    segment->count = 0;
+    if (create)
+    {
+        memcpy(header->magic, SPOOL_MAGIC, sizeof(header->magic));
+        header->id = id;
+        header->record_size = sizeof(SpoolRecord);
+        return 0;
+    }
+
+    if (memcmp(header->magic, SPOOL_MAGIC, sizeof(header->magic)) != 0 || header->id != id ||
+        header->record_size != sizeof(SpoolRecord))
+    {
+        write_log("Ignoring spool segment %s with an unknown header", path);
+        munmap(map, SPOOL_SEGMENT_BYTES);
+        return -1;
+    }
+    // Records are appended in order, the first one that does not check out is where writing stopped
+    const SpoolRecord* records = segment_records(segment);
+    while (segment->count < SPOOL_SEGMENT_RECORDS && records[segment->count].check != 0 &&
+           records[segment->count].check == record_check(&records[segment->count]))
+    {
+        segment->count++;
+    }
+    return 0;
+}
+
+// Function to unmap a segment and delete its file
+static void remove_segment(const SpoolSegment* segment)
+{
+    char path[SPOOL_PATH_SIZE];
+    segment_path(segment->id, path, sizeof(path));
+    munmap(segment->map, SPOOL_SEGMENT_BYTES);
+    unlink(path);
+}
+
+// Function to drop the oldest segment from the list, its file is deleted
+static void pop_segment(Spool* spool)
+{
+    remove_segment(&spool->segments[0]);
+    spool->segment_count--;
+    memmove(&spool->segments[0], &spool->segments[1], spool->segment_count * sizeof(SpoolSegment));
+    spool->read_index = 0;
+}
+
+// Function to persist the replay position: write a new file, sync it, then rename it over the old one
+static int write_checkpoint(const Spool* spool)
+{
+    uint64_t id = spool->segment_count ? spool->segments[0].id : spool->next_id;
+    FILE* file = fopen(SPOOL_CHECKPOINT ".tmp", "w");
+    if (!file)
+    {
+        write_log("Failed to write spool checkpoint"); // Log error
+        return -1;
+    }
+    fprintf(file, "%llu %zu\n", (unsigned long long)id, spool->read_index);
+    int failed = fflush(file) != 0 || fsync(fileno(file)) == -1;
+    failed |= fclose(file) != 0;
+    if (failed || rename(SPOOL_CHECKPOINT ".tmp", SPOOL_CHECKPOINT) == -1)
+    {
+        write_log("Failed to write spool checkpoint"); // Log error
+        return -1;
+    }
+
+    // The rename itself is only durable once the directory is synced
+    int dir_fd = open(SPOOL_DIR, O_RDONLY | O_DIRECTORY);
+    if (dir_fd != -1)
+    {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+    return 0;
+}
+
+// Function to compare segment ids for qsort
+static int compare_id(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+// Function to open the spool directory and recover the segments and replay position of a previous run
+int spool_open(Spool* spool, int max_mb)
+{
+    memset(spool, 0, sizeof(*spool));
+    spool->max_segments = (int)((size_t)max_mb * 1024 * 1024 / SPOOL_SEGMENT_BYTES);
+    spool->max_segments = spool->max_segments < 1 ? 1 : spool->max_segments;
+    spool->max_segments = spool->max_segments > SPOOL_MAX_SEGMENTS ? SPOOL_MAX_SEGMENTS : spool->max_segments;
+
+    if (mkdir(SPOOL_DIR, 0755) == -1 && errno != EEXIST)
+    {
+        write_log("Failed to create %s: %s", SPOOL_DIR, strerror(errno)); // Log error
+        return -1;
+    }
+
+    unsigned long long checkpoint_id = 0;
+    size_t checkpoint_index = 0;
+    FILE* file = fopen(SPOOL_CHECKPOINT, "r");
+    if (file)
+    {
+        if (fscanf(file, "%llu %zu", &checkpoint_id, &checkpoint_index) != 2)
+        {
+            checkpoint_id = 0;
+            checkpoint_index = 0;
+        }
+        fclose(file);
+    }
+
+    uint64_t ids[SPOOL_MAX_SEGMENTS];
+    int id_count = 0;
+    DIR* dir = opendir(SPOOL_DIR);
+    struct dirent* entry;
+    while (dir && (entry = readdir(dir)) != NULL && id_count < SPOOL_MAX_SEGMENTS)
+    {
+        unsigned long long id;
+        char suffix[8];
+        if (sscanf(entry->d_name, "%20llu.%7s", &id, suffix) == 2 && strcmp(suffix, "seg") == 0)
+        {
+            ids[id_count++] = id;
+        }
+    }
+    if (dir)
+    {
+        closedir(dir);
+    }
+    qsort(ids, id_count, sizeof(uint64_t), compare_id);
+
+    spool->next_id = checkpoint_id;
+    for (int i = 0; i < id_count; i++)
+    {
+        SpoolSegment* segment = &spool->segments[spool->segment_count];
+        if (ids[i] < checkpoint_id)
+        {
+            char path[SPOOL_PATH_SIZE];
+            segment_path(ids[i], path, sizeof(path));
+            unlink(path); // Fully replayed before the previous run stopped
+        }
+        else if (map_segment(segment, ids[i], 0) == 0)
+        {
+            spool->segment_count++;
+            spool->pending += segment->count;
+            spool->next_id = ids[i] + 1;
+        }
+    }
+
+    if (spool->segment_count && spool->segments[0].id == checkpoint_id)
+    {
+        size_t count = spool->segments[0].count;
+        spool->read_index = checkpoint_index < count ? checkpoint_index : count;
+        spool->pending -= spool->read_index;
+    }
+    if (spool->pending)
+    {
+        write_log("Spool holds %zu readings from a previous run to replay", spool->pending);
+    }
+    if (spool->segment_count > spool->max_segments)
+    {
+        write_log("Spool holds %d segments, more than the %d allowed by -S; the oldest go when the next one is needed",
+                  spool->segment_count, spool->max_segments);
+    }
+    return 0;
+}
+
+// Function to unmap every segment, the files stay on disk for the next run
+void spool_close(Spool* spool)
+{
+    for (int i = 0; i < spool->segment_count; i++)
+    {
+        munmap(spool->segments[i].map, SPOOL_SEGMENT_BYTES);
+    }
+    spool->segment_count = 0;
+}
+
+// Function to append readings after the last spooled one, the oldest segment goes when the disk bound is hit;
+// returns how many were appended, fewer than count if a new segment could not be created
+int spool_append(Spool* spool, const SensorReading* readings, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        SpoolSegment* tail = spool->segment_count ? &spool->segments[spool->segment_count - 1] : NULL;
+        if (!tail || tail->count == SPOOL_SEGMENT_RECORDS)
+        {
+            // A previous run with a larger -S may have left more segments than the bound allows
+            size_t lost = 0;
+            while (spool->segment_count >= spool->max_segments)
+            {
+                lost += spool->segments[0].count - spool->read_index;
+                pop_segment(spool);
+            }
+            if (lost)
+            {
+                spool->dropped += lost;
+                spool->pending -= lost;
+                write_checkpoint(spool); // The caller reports the loss through spool->dropped
+            }
+            tail = &spool->segments[spool->segment_count];
+            if (map_segment(tail, spool->next_id, 1) == -1)
+            {
+                return i;
+            }
+            spool->next_id++;
+            spool->segment_count++;
+        }
+
+        SpoolRecord record = {
+            .sensor_id = readings[i].sensor_id,
+            .check = 0,
+            .temperature = readings[i].temperature,
+            .humidity = readings[i].humidity,
+            .timestamp = readings[i].timestamp,
+        };
+        record.check = record_check(&record);
+        segment_records(tail)[tail->count++] = record;
+        spool->pending++;
+    }
+    return count;
+}
+
+// Function to copy the oldest unreplayed readings without consuming them
+int spool_peek(const Spool* spool, SensorReading* readings, int max)
+{
+    int n = 0;
+    size_t index = spool->read_index;
+    for (int s = 0; s < spool->segment_count && n < max; s++, index = 0)
+    {
+        const SpoolSegment* segment = &spool->segments[s];
+        const SpoolRecord* records = segment_records(segment);
+        for (; index < segment->count && n < max; index++)
+        {
+            readings[n].sensor_id = records[index].sensor_id;
+            readings[n].temperature = records[index].temperature;
+            readings[n].humidity = records[index].humidity;
+            readings[n].timestamp = (long)records[index].timestamp;
+            n++;
+        }
+    }
+    return n;
+}
+
+// Function to mark readings as stored, advancing and persisting the replay position
+int spool_consume(Spool* spool, int count)
+{
+    size_t left = (size_t)count < spool->pending ? (size_t)count : spool->pending;
+    spool->pending -= left;
+    while (left > 0 && spool->segment_count)
+    {
+        SpoolSegment* head = &spool->segments[0];
+        size_t take = head->count - spool->read_index;
+        take = take < left ? take : left;
+        spool->read_index += take;
+        left -= take;
+        if (spool->read_index == head->count && (head->count == SPOOL_SEGMENT_RECORDS || spool->segment_count > 1))
+        {
+            pop_segment(spool); // Fully replayed and no longer written to
+        }
+    }
+    while (spool->pending == 0 && spool->segment_count)
+    {
+        pop_segment(spool); // Caught up, start from a fresh segment next time
+    }
+    return write_checkpoint(spool);
+}
@@ -0,0 +1,360 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sqlite3.h>
+#include "storage_backend.h"
+#include "storage_schema.h"
+#include "log.h"
+
+#define SQLITE_DB_PATH "sensor_data.db"
+
+// Combined mean and population variance of an existing row and the incoming window (Chan et al.)
+#define MERGED_MEAN(m) "((" m "_mean * count + excluded." m "_mean * excluded.count) / (count + excluded.count))"
+#define MERGED_VAR(m) "((count * (" m "_var + (" m "_mean - " MERGED_MEAN(m) ") * (" m "_mean - " MERGED_MEAN(m) ")) + " \
+    "excluded.count * (excluded." m "_var + (excluded." m "_mean - " MERGED_MEAN(m) ") * " \
+    "(excluded." m "_mean - " MERGED_MEAN(m) "))) / (count + excluded.count))"
+#define MERGED_METRIC(m) m "_min = min(" m "_min, excluded." m "_min), " \
+    m "_max = max(" m "_max, excluded." m "_max), " \
+    m "_var = " MERGED_VAR(m) ", " \
+    m "_p95 = (" m "_p95 * count + excluded." m "_p95 * excluded.count) / (count + excluded.count), " \
+    m "_mean = " MERGED_MEAN(m) ", "
+
+typedef struct
+{
+    sqlite3 *db;
+    sqlite3_stmt *insert_stmt; // Prepared once per partition and reused for every reading
+    long insert_day; // Partition insert_stmt writes to
+    sqlite3_stmt *rollup_stmt; // Merges a finished window into sensor_rollup
+    sqlite3_stmt *begin_stmt;
+    sqlite3_stmt *commit_stmt;
+} SQLData;
+
+typedef struct
+{
+    sqlite3* db; // Read-only connection owned by one query thread
+    sqlite3_stmt* range_stmt;
+    sqlite3_stmt* rollup_stmt;
+} SQLReader;
+
+// Function to run a cached statement that returns no rows
+static int step_and_reset(sqlite3_stmt* stmt)
+{
+    int rc = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    return rc;
+}
+
+// Function to point the insert statement at the partition of a day, creating it on first use
+static int select_partition(SQLData* sql, long day)
+{
+    if (sql->insert_stmt && sql->insert_day == day)
+    {
+        return 0;
+    }
+    sqlite3_finalize(sql->insert_stmt);
+    sql->insert_stmt = NULL;
+
+    char name[PARTITION_NAME_SIZE];
+    char insert_sql[128];
+    partition_name(day, name, sizeof(name));
+    snprintf(insert_sql, sizeof(insert_sql),
+             "INSERT INTO %s (sensor_id, temperature, humidity, ts) VALUES (?1, ?2, ?3, ?4);", name);
+
+    if (schema_ensure_partition(sql->db, day) == -1 ||
+        sqlite3_prepare_v2(sql->db, insert_sql, -1, &sql->insert_stmt, NULL) != SQLITE_OK)
+    {
+        write_log("Failed to prepare insert into %s: %s", name, sqlite3_errmsg(sql->db)); // Log error
+        return -1;
+    }
+    sql->insert_day = day;
+    return 0;
+}
+
+// Function to store the finished rollup windows, within the caller's transaction
+static int write_rollups(SQLData* sql, const StorageBatch* batch)
+{
+    for (size_t i = 0; i < batch->rollup_count; i++)
+    {
+        const RollupResult* result = &batch->rollups[i];
+        const RollupWindow* window = &result->window;
+        const RollupMetric* metrics[2] = {&window->temperature, &window->humidity};
+
+        sqlite3_bind_int(sql->rollup_stmt, 1, result->sensor_id);
+        sqlite3_bind_int(sql->rollup_stmt, 2, result->resolution);
+        sqlite3_bind_int64(sql->rollup_stmt, 3, window->start);
+        sqlite3_bind_int64(sql->rollup_stmt, 4, window->count);
+        for (int m = 0; m < 2; m++)
+        {
+            int column = 5 + m * 5;
+            sqlite3_bind_double(sql->rollup_stmt, column, metrics[m]->min);
+            sqlite3_bind_double(sql->rollup_stmt, column + 1, metrics[m]->max);
+            sqlite3_bind_double(sql->rollup_stmt, column + 2, metrics[m]->mean);
+            sqlite3_bind_double(sql->rollup_stmt, column + 3, rollup_variance(metrics[m], window->count));
+            sqlite3_bind_double(sql->rollup_stmt, column + 4, rollup_quantile(&metrics[m]->p95, window->count));
+        }
+        if (step_and_reset(sql->rollup_stmt) != SQLITE_DONE)
+        {
+            write_log("Failed to store rollup: %s", sqlite3_errmsg(sql->db)); // Log error
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Function to commit a batch of readings and the finished rollup windows in a single transaction
+static int sqlite_append(StorageBackend* backend, const StorageBatch* batch)
+{
+    SQLData* sql = backend->state;
+
+    if (step_and_reset(sql->begin_stmt) != SQLITE_DONE)
+    {
+        write_log("Failed to begin transaction: %s", sqlite3_errmsg(sql->db)); // Log error
+        return -1;
+    }
+
+    int failed = 0;
+    for (int i = 0; i < batch->count && !failed; i++)
+    {
+        const SensorReading* reading = &batch->readings[i];
+
+        // Insert into the partition of the reading's day
+        if (select_partition(sql, partition_day(reading->timestamp)) == -1)
+        {
+            failed = 1;
+            break;
+        }
+        sqlite3_bind_int(sql->insert_stmt, 1, reading->sensor_id);
+        sqlite3_bind_double(sql->insert_stmt, 2, reading->temperature);
+        sqlite3_bind_double(sql->insert_stmt, 3, reading->humidity);
+        sqlite3_bind_int64(sql->insert_stmt, 4, reading->timestamp);
+        if (step_and_reset(sql->insert_stmt) != SQLITE_DONE)
+        {
+            write_log("Failed to insert data: %s", sqlite3_errmsg(sql->db)); // Log error
+            failed = 1;
+        }
+    }
+    failed = failed || write_rollups(sql, batch) == -1;
+
+    if (failed || step_and_reset(sql->commit_stmt) != SQLITE_DONE)
+    {
+        write_log("Failed to commit %d readings: %s", batch->count, sqlite3_errmsg(sql->db)); // Log error
+        sqlite3_exec(sql->db, "ROLLBACK;", NULL, NULL, NULL);
+        return -1;
+    }
+    return 0;
+}
+
+// Function to flush buffered data, every append is already a committed transaction
+static int sqlite_flush(StorageBackend* backend)
+{
+    (void)backend;
+    return 0;
+}
+
+// Function to drop the partitions that fell out of the retention window
+static int sqlite_expire(StorageBackend* backend, long oldest_day)
+{
+    SQLData* sql = backend->state;
+    int dropped = schema_drop_expired(sql->db, oldest_day);
+    if (dropped > 0)
+    {
+        sqlite3_finalize(sql->insert_stmt); // It may point at a dropped partition
+        sql->insert_stmt = NULL;
+    }
+    return dropped;
+}
+
+// Function to finalize the cached statements and close the database
+static void sqlite_close(StorageBackend* backend)
+{
+    SQLData* sql = backend->state;
+    sqlite3_finalize(sql->insert_stmt);
+    sqlite3_finalize(sql->rollup_stmt);
+    sqlite3_finalize(sql->begin_stmt);
+    sqlite3_finalize(sql->commit_stmt);
+    sqlite3_close(sql->db);
+    free(sql);
+    backend->state = NULL;
+}
+
+// Function to apply the journal settings and prepare the statements reused for every reading
+static int prepare_connection(SQLData* sql, int sync_level)
+{
+    char pragma_sql[64];
+
+    // WAL lets readers run alongside the writer and makes commits append-only
+    snprintf(pragma_sql, sizeof(pragma_sql), "PRAGMA journal_mode=WAL; PRAGMA synchronous=%d;", sync_level);
+    if (sqlite3_exec(sql->db, pragma_sql, NULL, NULL, NULL) != SQLITE_OK)
+    {
+        write_log("Failed to configure database: %s", sqlite3_errmsg(sql->db)); // Log error
+    }
+
+    // The insert statement depends on the partition and is prepared by the writer on demand
+    const char* rollup_sql =
+        "INSERT INTO sensor_rollup VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10, ?11, ?12, ?13, ?14) "
+        "ON CONFLICT (sensor_id, resolution, window_start) DO UPDATE SET " // Window reopened by a late reading
+        MERGED_METRIC("temperature") MERGED_METRIC("humidity") "count = count + excluded.count;";
+
+    if (sqlite3_prepare_v2(sql->db, rollup_sql, -1, &sql->rollup_stmt, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(sql->db, "BEGIN;", -1, &sql->begin_stmt, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(sql->db, "COMMIT;", -1, &sql->commit_stmt, NULL) != SQLITE_OK)
+    {
+        write_log("Failed to prepare statements: %s", sqlite3_errmsg(sql->db)); // Log error
+        return -1;
+    }
+    return 0;
+}
+
+// Function to open the database, migrate its schema and prepare the writer's statements
+static int sqlite_open(StorageBackend* backend)
+{
+    SQLData* sql = calloc(1, sizeof(SQLData));
+    if (!sql)
+    {
+        return -1;
+    }
+    backend->state = sql;
+
+    if (sqlite3_open(SQLITE_DB_PATH, &sql->db) != SQLITE_OK)
+    {
+        write_log("Can't open database: %s", sqlite3_errmsg(sql->db)); // Log error
+        sqlite_close(backend);
+        return -1;
+    }
+    sqlite3_busy_timeout(sql->db, 5000);  // Prevent lock issues
+
+    // Creates today's partition and migrates a version 1 table if one is found
+    if (schema_migrate(sql->db) == -1 || prepare_connection(sql, backend->config->sync_level) == -1)
+    {
+        sqlite_close(backend);
+        return -1;
+    }
+    write_log("Connection to SQL server established");
+    return 0;
+}
+
+// Function to release the connection of one query thread
+static void sqlite_close_reader(void* handle)
+{
+    SQLReader* reader = handle;
+    sqlite3_finalize(reader->range_stmt);
+    sqlite3_finalize(reader->rollup_stmt);
+    sqlite3_close(reader->db);
+    free(reader);
+}
+
+// Function to open the read-only connection and statements of one query thread
+static void* sqlite_open_reader(StorageBackend* backend)
+{
+    const char* range_sql = "SELECT ts, temperature, humidity FROM sensor_data "
+                            "WHERE sensor_id = ?1 AND ts BETWEEN ?2 AND ?3 ORDER BY ts LIMIT ?4;";
+    const char* rollup_sql = "SELECT window_start, count, temperature_min, temperature_max, temperature_mean, "
+                             "temperature_var, temperature_p95, humidity_min, humidity_max, humidity_mean, "
+                             "humidity_var, humidity_p95 FROM sensor_rollup "
+                             "WHERE sensor_id = ?1 AND resolution = ?2 AND window_start BETWEEN ?3 AND ?4 "
+                             "ORDER BY window_start LIMIT ?5;";
+    (void)backend;
+
+    SQLReader* reader = calloc(1, sizeof(SQLReader));
+    if (!reader)
+    {
+        return NULL;
+    }
+    // WAL lets these readers run while the storage writer commits
+    if (sqlite3_open_v2(SQLITE_DB_PATH, &reader->db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(reader->db, range_sql, -1, &reader->range_stmt, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(reader->db, rollup_sql, -1, &reader->rollup_stmt, NULL) != SQLITE_OK)
+    {
+        write_log("Failed to open query connection: %s", sqlite3_errmsg(reader->db)); // Log error
+        sqlite_close_reader(reader);
+        return NULL;
+    }
+    sqlite3_busy_timeout(reader->db, 1000);
+    return reader;
+}
+
+// Function to finish a query statement, returns -1 if it stopped on an error
+static int finish_query(SQLReader* reader, sqlite3_stmt* stmt, int rc)
+{
+    sqlite3_reset(stmt);
+    if (rc != SQLITE_ROW && rc != SQLITE_DONE)
+    {
+        write_log("Query failed: %s", sqlite3_errmsg(reader->db)); // Log error
+        return -1;
+    }
+    return 0;
+}
+
+// Function to stream the readings of a sensor between two timestamps, oldest first
+static int sqlite_query_range(void* handle, int sensor_id, long from, long to, int limit, StorageRangeFn fn, void* ctx)
+{
+    SQLReader* reader = handle;
+    sqlite3_stmt* stmt = reader->range_stmt;
+    sqlite3_bind_int(stmt, 1, sensor_id);
+    sqlite3_bind_int64(stmt, 2, from);
+    sqlite3_bind_int64(stmt, 3, to);
+    sqlite3_bind_int(stmt, 4, limit);
+
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+    {
+        SensorReading reading = {
+            .sensor_id = sensor_id,
+            .temperature = sqlite3_column_double(stmt, 1),
+            .humidity = sqlite3_column_double(stmt, 2),
+            .timestamp = (long)sqlite3_column_int64(stmt, 0),
+        };
+        if (fn(ctx, &reading) == -1)
+        {
+            break;
+        }
+    }
+    return finish_query(reader, stmt, rc);
+}
+
+// Function to stream the stored rollup windows of a sensor, oldest first
+static int sqlite_query_rollup(void* handle, int sensor_id, int resolution, long from, long to, int limit,
+                               StorageRollupFn fn, void* ctx)
+{
+    SQLReader* reader = handle;
+    sqlite3_stmt* stmt = reader->rollup_stmt;
+    sqlite3_bind_int(stmt, 1, sensor_id);
+    sqlite3_bind_int(stmt, 2, resolution);
+    sqlite3_bind_int64(stmt, 3, from);
+    sqlite3_bind_int64(stmt, 4, to);
+    sqlite3_bind_int(stmt, 5, limit);
+
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+    {
+        StoredRollup rollup = {.window_start = (long)sqlite3_column_int64(stmt, 0),
+                               .count = (long)sqlite3_column_int64(stmt, 1)};
+        StoredMetric* metrics[2] = {&rollup.temperature, &rollup.humidity};
+        for (int m = 0; m < 2; m++)
+        {
+            int column = 2 + m * 5;
+            metrics[m]->min = sqlite3_column_double(stmt, column);
+            metrics[m]->max = sqlite3_column_double(stmt, column + 1);
+            metrics[m]->mean = sqlite3_column_double(stmt, column + 2);
+            metrics[m]->var = sqlite3_column_double(stmt, column + 3);
+            metrics[m]->p95 = sqlite3_column_double(stmt, column + 4);
+        }
+        if (fn(ctx, &rollup) == -1)
+        {
+            break;
+        }
+    }
+    return finish_query(reader, stmt, rc);
+}
+
+const StorageBackendOps sqlite_backend_ops = {
+    .name = "sqlite",
+    .open = sqlite_open,
+    .append = sqlite_append,
+    .flush = sqlite_flush,
+    .expire = sqlite_expire,
+    .close = sqlite_close,
+    .open_reader = sqlite_open_reader,
+    .query_range = sqlite_query_range,
+    .query_rollup = sqlite_query_rollup,
+    .close_reader = sqlite_close_reader,
+};
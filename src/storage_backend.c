@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <string.h>
+#include "storage_backend.h"
+#include "log.h"
+
+static const StorageBackendOps* backends[] = {&sqlite_backend_ops, &column_backend_ops};
+
+// Function to select the backend named in the configuration
+int storage_backend_init(StorageBackend* backend, const GatewayConfig* config)
+{
+    memset(backend, 0, sizeof(*backend));
+    for (size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); i++)
+    {
+        if (strcmp(backends[i]->name, config->backend) == 0)
+        {
+            backend->ops = backends[i];
+        }
+    }
+    if (!backend->ops)
+    {
+        return -1;
+    }
+    backend->config = config;
+    pthread_mutex_init(&backend->mutex, NULL);
+    return 0;
+}
+
+// Function to release the backend lock, the backend must be closed already
+void storage_backend_destroy(StorageBackend* backend)
+{
+    pthread_mutex_destroy(&backend->mutex);
+}
+
+// Function to (re)open the backend, closing a previous connection first
+int storage_open(StorageBackend* backend)
+{
+    pthread_mutex_lock(&backend->mutex); // The writer must not use the connection meanwhile
+    if (backend->state)
+    {
+        backend->ops->close(backend);
+    }
+    int rc = backend->ops->open(backend);
+    backend->connected = rc == 0;
+    pthread_mutex_unlock(&backend->mutex);
+    return rc;
+}
+
+// Function to store a batch, returns -1 when nothing was stored so the caller can spool it
+int storage_append(StorageBackend* backend, const StorageBatch* batch)
+{
+    pthread_mutex_lock(&backend->mutex);
+    int rc = backend->connected ? backend->ops->append(backend, batch) : -1;
+    pthread_mutex_unlock(&backend->mutex);
+    return rc;
+}
+
+// Function to write out buffered data
+int storage_flush(StorageBackend* backend)
+{
+    pthread_mutex_lock(&backend->mutex);
+    int rc = backend->connected ? backend->ops->flush(backend) : -1;
+    pthread_mutex_unlock(&backend->mutex);
+    return rc;
+}
+
+// Function to drop the days that fell out of the retention window
+int storage_expire(StorageBackend* backend, long oldest_day)
+{
+    pthread_mutex_lock(&backend->mutex); // The writer must not append while data is dropped
+    int rc = backend->connected ? backend->ops->expire(backend, oldest_day) : 0;
+    pthread_mutex_unlock(&backend->mutex);
+    return rc;
+}
+
+// Function to close the backend
+void storage_close(StorageBackend* backend)
+{
+    pthread_mutex_lock(&backend->mutex);
+    if (backend->state)
+    {
+        backend->ops->close(backend);
+    }
+    backend->connected = 0;
+    pthread_mutex_unlock(&backend->mutex);
+}
@@ -1,167 +1,430 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <unistd.h>
-#include <sqlite3.h>
+#include <errno.h>
+#include <poll.h>
 #include <pthread.h>
-#include <math.h>
+#include <time.h>
+#include <limits.h>
 #include "storage_manager.h"
 #include "log.h"
+#include "ingest_queue.h"
+#include "dedup_cache.h"
+#include "storage_schema.h"
+#include "storage_backend.h"
+#include "rollup.h"
+#include "spool.h"
+#include "metrics.h"
 
-#define DUPLICATE_TIME_LIMIT "-10 seconds" // Prevent duplicate data within 10 seconds
-#define FLOAT_TOLERANCE 0.01  // Precision tolerance for temperature/humidity
+#define RETENTION_INTERVAL_S 3600 // Look for expired days once an hour
+#define SPOOL_RETRY_MS 1000 // Pause between replay attempts while the backend refuses writes
+#define REOPEN_MIN_MS 500 // First pause before reopening a lost backend, doubled after each failure
+#define REOPEN_MAX_MS 5000
+#define EXIT_FLUSH_RESERVE_MS 1000 // Part of the shutdown deadline kept for the final flush, spool replay stops before
 
-// Function to insert sensor data into the database
-void insert_sensor_data(SharedData* shared, int sensor_id, double temperature, double humidity)
+typedef struct
 {
-    if (!shared->sql_data.sql_connected)
+    DedupCache dedup; // Last stored value per sensor
+    RollupEngine rollup; // Open aggregation windows per sensor
+    Spool* spool; // Readings waiting on disk for the backend
+    SensorReading* batch; // Readings taken from the ingest queue
+    SensorReading* replay; // Readings read back from the spool
+    SensorReading* accepted; // Readings of the batch being written that are not duplicates
+} StorageWriter;
+
+// Function to queue the readings of one frame for the storage writer as one contiguous run
+void insert_sensor_batch(SharedData* shared, const SensorReading* readings, int count)
+{
+    // Queued even while the database is down, the storage writer spools what it cannot store
+    ingest_queue_push(&shared->ingest_queue, readings, count); // Counted as dropped if the ring stays full
+}
+
+// Function to move queued readings into the batch without waiting, recording how long each one was queued
+static int drain_queue(IngestQueue* queue, SensorReading* batch, int n, int limit)
+{
+    int64_t now_ns = metrics_now_ns();
+    int64_t enqueued_ns;
+    while (n < limit && ingest_queue_pop(queue, &batch[n], &enqueued_ns) == 0)
+    {
+        metrics_observe(STAGE_QUEUE_WAIT, now_ns - enqueued_ns);
+        n++;
+    }
+    return n;
+}
+
+// Function to have the storage threads store what is queued and exit, no reading may be queued anymore
+void storage_manager_stop(SharedData* shared)
+{
+    shared->storage_closing = 1;
+    storage_manager_wake(shared);
+}
+
+// Function to wake both storage threads, on shutdown or when the writer lost the backend
+void storage_manager_wake(SharedData* shared)
+{
+    uint64_t one = 1;
+    if (write(shared->storage_wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+    {
+        perror("eventfd write failed");
+    }
+    ingest_queue_wake(&shared->ingest_queue);
+}
+
+// Function to return the milliseconds left until a monotonic deadline
+static long ms_until(const struct timespec* deadline)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (deadline->tv_sec - now.tv_sec) * 1000L + (deadline->tv_nsec - now.tv_nsec) / 1000000L;
+}
+
+// Function to wait for the next batch of readings, bounded by size and time, returns 0 if none came within idle_ms
+static int take_batch(SharedData* shared, SensorReading* batch, int idle_ms)
+{
+    IngestQueue* queue = &shared->ingest_queue;
+    int limit = shared->config.batch_size;
+    struct timespec deadline;
+
+    int n = drain_queue(queue, batch, 0, limit);
+    if (n == 0 && !shared->storage_closing)
+    {
+        ingest_queue_wait(queue, 1, idle_ms);
+        n = drain_queue(queue, batch, 0, limit);
+    }
+
+    // Give the batch up to flush_ms to fill before committing it
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += shared->config.flush_ms / 1000;
+    deadline.tv_nsec += (long)(shared->config.flush_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L)
     {
-        return; // Exit if not connected to the database
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    while (n > 0 && n < limit && !shared->storage_closing)
+    {
+        long remaining = ms_until(&deadline);
+        if (remaining <= 0)
+        {
+            break;
+        }
+        ingest_queue_wait(queue, limit - n, (int)remaining);
+        n = drain_queue(queue, batch, n, limit);
     }
+    return n;
+}
 
-    pthread_mutex_lock(&shared->sql_data.mutex); // Lock the mutex to access the database
+// Function to log readings lost to a full ingest queue since the last report
+static void report_drops(IngestQueue* queue, unsigned long* reported)
+{
+    unsigned long dropped = atomic_load_explicit(&queue->dropped, memory_order_relaxed);
+    if (dropped != *reported)
+    {
+        unsigned long lost = dropped - *reported;
+        log_event(LOG_QUEUE_FULL, lost > INT_MAX ? INT_MAX : (int)lost,
+                  (double)atomic_load_explicit(&queue->full_events, memory_order_relaxed),
+                  (double)atomic_load_explicit(&queue->pushed, memory_order_relaxed));
+        *reported = dropped;
+    }
+}
 
-    // Check if the exact same data already exists (last inserted value)
-    const char *check_sql = "SELECT COUNT(*) FROM sensor_data WHERE sensor_id = ? "
-                            "AND temperature = ? AND humidity = ? "
-                            "AND timestamp >= datetime('now', ?, 'localtime');";
+// Function to store a batch of readings and the finished rollup windows through the backend,
+// returns -1 when nothing was stored so the caller can spool the batch
+static int write_batch(SharedData* shared, StorageWriter* writer, const SensorReading* batch, int count)
+{
+    StorageBatch stored = {.readings = writer->accepted, .rollups = writer->rollup.finished,
+                           .rollup_count = writer->rollup.finished_count};
 
-    sqlite3_stmt *check_stmt;
-    int rc = sqlite3_prepare_v2(shared->sql_data.db, check_sql, -1, &check_stmt, NULL);
-    if (rc == SQLITE_OK)
+    for (int i = 0; i < count; i++)
     {
-        sqlite3_bind_int(check_stmt, 1, sensor_id);
-        sqlite3_bind_double(check_stmt, 2, temperature);
-        sqlite3_bind_double(check_stmt, 3, humidity);
-        sqlite3_bind_text(check_stmt, 4, DUPLICATE_TIME_LIMIT, -1, SQLITE_STATIC);
+        const SensorReading* reading = &batch[i];
 
-        if (sqlite3_step(check_stmt) == SQLITE_ROW && sqlite3_column_int(check_stmt, 0) > 0)
+        // Check if the same data was just stored (last inserted value), without asking the backend
+        if (dedup_cache_is_duplicate(&writer->dedup, reading, reading->timestamp))
         {
-            write_log("Skipping duplicate data for sensor %d", sensor_id); // Log duplicate data
-            sqlite3_finalize(check_stmt);
-            pthread_mutex_unlock(&shared->sql_data.mutex); // Unlock the mutex
-            return; // Exit if duplicate data is found
+            log_event(LOG_DUPLICATE, reading->sensor_id, 0, 0); // Log duplicate data
+            metrics_count(METRIC_READINGS_DUPLICATE, 1);
+            continue;
         }
+        dedup_cache_remember(&writer->dedup, reading, reading->timestamp);
+        writer->accepted[stored.count++] = *reading;
     }
-    sqlite3_finalize(check_stmt);
 
-    // Insert new data if no duplicate found
-    const char *insert_sql = "INSERT INTO sensor_data (sensor_id, temperature, humidity, timestamp) "
-                             "VALUES (?, ?, ?, datetime('now', 'localtime'));";
-    sqlite3_stmt *stmt;
+    int64_t start = metrics_now_ns();
+    if (storage_append(&shared->storage, &stored) == -1)
+    {
+        dedup_cache_clear(&writer->dedup); // It remembers readings that were not stored
+        return -1;
+    }
+    metrics_observe(STAGE_DB_COMMIT, metrics_now_ns() - start);
+    metrics_count(METRIC_READINGS_STORED, (uint64_t)stored.count);
 
-    rc = sqlite3_prepare_v2(shared->sql_data.db, insert_sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK)
+    // Only stored readings are aggregated, so a batch that is spooled and replayed is counted once
+    writer->rollup.finished_count = 0;
+    for (int i = 0; i < stored.count; i++)
     {
-        write_log("Failed to prepare insert statement: %s", sqlite3_errmsg(shared->sql_data.db)); // Log error
-        pthread_mutex_unlock(&shared->sql_data.mutex); // Unlock the mutex
-        return;
+        rollup_add(&writer->rollup, &writer->accepted[i], writer->accepted[i].timestamp);
     }
+    return 0;
+}
+
+// Function to return the current monotonic time in milliseconds
+static long monotonic_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000L + now.tv_nsec / 1000000L;
+}
+
+// Function to keep readings on disk until the database takes them
+static void spool_batch(StorageWriter* writer, const SensorReading* batch, int count)
+{
+    unsigned long dropped = writer->spool->dropped;
+    int spooled = spool_append(writer->spool, batch, count);
+    metrics_count(METRIC_READINGS_SPOOLED, (uint64_t)spooled);
 
-    sqlite3_bind_int(stmt, 1, sensor_id);
-    sqlite3_bind_double(stmt, 2, temperature);
-    sqlite3_bind_double(stmt, 3, humidity);
+    // Readings evicted for the disk bound plus any that could not be written at all
+    unsigned long lost = writer->spool->dropped - dropped + (unsigned long)(count - spooled);
+    if (lost)
+    {
+        metrics_count(METRIC_READINGS_LOST, lost);
+        log_event(LOG_SPOOL_LOST, lost < INT_MAX ? (int)lost : INT_MAX, (double)writer->spool->dropped,
+                  (double)writer->spool->pending);
+    }
+}
 
-    rc = sqlite3_step(stmt);
-    if (rc != SQLITE_DONE)
+// Function to replay the oldest spooled readings in one transaction, returns -1 if the database refused them
+static int replay_spool(SharedData* shared, StorageWriter* writer)
+{
+    int n = spool_peek(writer->spool, writer->replay, shared->config.batch_size);
+    if (write_batch(shared, writer, writer->replay, n) == -1)
+    {
+        return -1;
+    }
+    spool_consume(writer->spool, n); // Checkpointed after the commit: a crash in between replays the batch again
+    if (writer->spool->pending == 0)
     {
-        write_log("Failed to insert data: %s", sqlite3_errmsg(shared->sql_data.db)); // Log error
+        write_log("Spool replayed, writing to the database directly again");
     }
+    return 0;
+}
 
-    sqlite3_finalize(stmt);
-    pthread_mutex_unlock(&shared->sql_data.mutex); // Unlock the mutex
+// Function to return how long the idle writer may sleep: until a rollup window can next end, or the next
+// replay attempt, -1 when only new readings or a wakeup can give it work
+static int idle_timeout_ms(SharedData* shared, StorageWriter* writer, long retry_at)
+{
+    long timeout = -1;
+    if (writer->rollup.count > 0)
+    {
+        // Every resolution is a multiple of the shortest, so windows only end at these instants
+        struct timespec wall;
+        clock_gettime(CLOCK_REALTIME, &wall);
+        long shortest = rollup_resolutions[0];
+        long next_end = ((wall.tv_sec - ROLLUP_GRACE_S) / shortest + 1) * shortest + ROLLUP_GRACE_S;
+        timeout = (next_end - wall.tv_sec) * 1000L - wall.tv_nsec / 1000000L;
+    }
+    if (writer->spool->pending && shared->storage.connected)
+    {
+        long until_retry = retry_at - monotonic_ms();
+        until_retry = until_retry > 0 ? until_retry : 0;
+        timeout = timeout == -1 || until_retry < timeout ? until_retry : timeout;
+    }
+    return (int)timeout;
 }
 
-// Function to manage storage of sensor data
-void* storage_manager(void* arg)
+// Function to release everything the storage writer allocated
+static void storage_writer_free(StorageWriter* writer)
+{
+    if (writer->spool)
+    {
+        spool_close(writer->spool);
+    }
+    rollup_destroy(&writer->rollup);
+    dedup_cache_destroy(&writer->dedup);
+    free(writer->spool);
+    free(writer->batch);
+    free(writer->replay);
+    free(writer->accepted);
+}
+
+// Function to drain queued readings into the database in group transactions
+void* storage_writer(void* arg)
 {
     SharedData* shared = (SharedData*)arg;
-    int retry_count = 0;
-    const int MAX_RETRIES = 3;
+    IngestQueue* queue = &shared->ingest_queue;
+    int batch_size = shared->config.batch_size;
+    StorageWriter writer = {0};
 
-    double last_temp[MAX_SENSORS] = {0.0}; // Array to store last temperature values
-    double last_humidity[MAX_SENSORS] = {0.0}; // Array to store last humidity values
+    writer.batch = malloc(batch_size * sizeof(SensorReading));
+    writer.replay = malloc(batch_size * sizeof(SensorReading));
+    writer.accepted = malloc(batch_size * sizeof(SensorReading));
+    writer.spool = malloc(sizeof(Spool));
+    if (!writer.batch || !writer.replay || !writer.accepted || !writer.spool ||
+        dedup_cache_init(&writer.dedup) == -1 || rollup_init(&writer.rollup) == -1 ||
+        spool_open(writer.spool, shared->config.spool_max_mb) == -1)
+    {
+        write_log("Failed to allocate storage writer");
+        storage_writer_free(&writer);
+        return NULL;
+    }
 
-    while (!shared->should_exit)
+    unsigned long reported_drops = 0;
+    long retry_at = 0; // Replays wait until then after the database refused a batch
+    long drain_start = 0; // When shutdown was first seen, readings stored from then on are reported as drained
+    unsigned long drained = 0;
+    while (1)
     {
-        pthread_mutex_lock(&shared->sensor_data.mutex); // Lock the mutex to access shared data
+        // Woken by new readings, by the storage manager after a reopen and on shutdown, otherwise only
+        // when a rollup window or a replay is due
+        int n = take_batch(shared, writer.batch, idle_timeout_ms(shared, &writer, retry_at));
+        report_drops(queue, &reported_drops);
+        int exiting = n == 0 && shared->storage_closing; // Queue drained and no producer left
+        if (shared->should_exit)
+        {
+            drain_start = drain_start ? drain_start : monotonic_ms();
+            drained += (unsigned long)n;
+        }
+
+        // The node's clock picks the partition, so one stuck near 1970 or years ahead must not create tables;
+        // text frames carry no time (0) and get the arrival time as well
+        long now = (long)time(NULL);
+        long skew = shared->config.clock_skew_s;
+        uint64_t replaced = 0;
+        for (int i = 0; i < n; i++)
+        {
+            long ts = writer.batch[i].timestamp;
+            if (ts == 0 || ts < now - skew || ts > now + skew)
+            {
+                replaced += ts != 0;
+                writer.batch[i].timestamp = now;
+            }
+        }
+        metrics_count(METRIC_TIMESTAMPS_REPLACED, replaced);
 
-        if (!shared->sql_data.sql_connected)
+        // Windows of quiet sensors end without a new reading, on shutdown every open window is flushed
+        rollup_expire(&writer.rollup, exiting ? LONG_MAX : now);
+
+        // Spooled readings go first to keep the order; a backed-up queue is drained to disk instead of waiting
+        int backlog = ingest_queue_length(queue) * 2 > queue->mask + 1;
+        if (n > 0 && (writer.spool->pending || backlog || write_batch(shared, &writer, writer.batch, n) == -1))
         {
-            if (retry_count < MAX_RETRIES)
+            if (writer.spool->pending == 0)
+            {
+                write_log("Storage unavailable or behind, spooling readings to %s", SPOOL_DIR);
+                retry_at = monotonic_ms() + SPOOL_RETRY_MS;
+            }
+            spool_batch(&writer, writer.batch, n);
+            if (!shared->storage.connected)
             {
-                if (shared->sql_data.db)
-                {
-                    sqlite3_close(shared->sql_data.db); // Close the database if open
-                    shared->sql_data.db = NULL;
-                }
-
-                int rc = sqlite3_open("sensor_data.db", &shared->sql_data.db);
-                if (rc == SQLITE_OK)
-                {
-                    sqlite3_busy_timeout(shared->sql_data.db, 5000);  // Prevent lock issues
-                    shared->sql_data.sql_connected = 1;
-                    retry_count = 0;
-                    write_log("Connection to SQL server established");
-
-                    const char *create_table_sql =
-                        "CREATE TABLE IF NOT EXISTS sensor_data ("
-                        "id INTEGER PRIMARY KEY AUTOINCREMENT,"
-                        "sensor_id INTEGER,"
-                        "temperature REAL,"
-                        "humidity REAL,"
-                        "timestamp TEXT UNIQUE DEFAULT (datetime('now', 'localtime')));";
-
-                    char *err_msg = NULL;
-                    rc = sqlite3_exec(shared->sql_data.db, create_table_sql, NULL, NULL, &err_msg);
-                    if (rc != SQLITE_OK)
-                    {
-                        write_log("SQL error: %s", err_msg); // Log error
-                        sqlite3_free(err_msg);
-                    }
-                    else
-                    {
-                        write_log("New table sensor_data created");
-                    }
-                }
-                else
-                {
-                    retry_count++;
-                    write_log("Unable to connect to SQL server (attempt %d of %d)",
-                              retry_count, MAX_RETRIES);
-                }
+                storage_manager_wake(shared); // Reopen the backend now rather than at the next timer
             }
         }
+        else if (n == 0 && writer.rollup.finished_count > 0)
+        {
+            write_batch(shared, &writer, writer.batch, 0); // Finished windows stay queued if this fails
+        }
+
+        if (writer.spool->pending && !backlog && monotonic_ms() >= retry_at &&
+            replay_spool(shared, &writer) == -1)
+        {
+            retry_at = monotonic_ms() + SPOOL_RETRY_MS;
+        }
 
-        if (shared->sql_data.sql_connected)
+        if (exiting)
         {
-            for (int i = 0; i < shared->sensor_data.connection_count; i++)
+            long replay_until = drain_start + shared->config.shutdown_s * 1000L - EXIT_FLUSH_RESERVE_MS;
+            while (writer.spool->pending && monotonic_ms() < replay_until && replay_spool(shared, &writer) == 0)
+            {
+            }
+            if (writer.spool->pending)
             {
-                int sensor_id = shared->sensor_data.sensor_connections[i].id;
-                if (shared->sensor_data.connected_sensors[sensor_id])
-                {
-                    double temp = shared->sensor_data.running_temps[sensor_id];
-                    double humidity = shared->sensor_data.running_humidity[sensor_id];
-                    // Only insert if there's a significant change in value
-                    if (fabs(temp - last_temp[sensor_id]) > FLOAT_TOLERANCE ||
-                        fabs(humidity - last_humidity[sensor_id]) > FLOAT_TOLERANCE)
-                    {
-                        insert_sensor_data(shared, sensor_id, temp, humidity);
-                        last_temp[sensor_id] = temp;
-                        last_humidity[sensor_id] = humidity;
-                    }
-                }
+                write_log("%zu readings stay spooled for the next start", writer.spool->pending);
             }
+            storage_flush(&shared->storage); // Backends that buffer write out what they hold
+            log_event(LOG_SHUTDOWN, (int)drained, (double)(monotonic_ms() - drain_start),
+                      (double)writer.spool->pending);
+            break;
         }
+    }
+
+    storage_writer_free(&writer);
+    return NULL;
+}
 
-        pthread_mutex_unlock(&shared->sensor_data.mutex); // Unlock the mutex
-        sleep(5); // Sleep for 5 seconds before the next iteration
+// Function to drop the days that fell out of the retention window
+static void expire_days(SharedData* shared, long now)
+{
+    int dropped = storage_expire(&shared->storage, partition_day(now) - shared->config.retention_days);
+    if (dropped > 0)
+    {
+        write_log("Retention: dropped %d expired days of readings", dropped);
     }
+}
 
-    if (shared->sql_data.db)
+// Function to sleep until the storage manager is woken or timeout_ms has passed, -1 waits indefinitely
+static void wait_for_wake(int wake_fd, int timeout_ms)
+{
+    struct pollfd pfd = {.fd = wake_fd, .events = POLLIN};
+    poll(&pfd, 1, timeout_ms);
+
+    uint64_t value;
+    if (read(wake_fd, &value, sizeof(value)) < 0 && errno != EAGAIN)
     {
-        sqlite3_close(shared->sql_data.db); // Close the database when exiting
-        shared->sql_data.db = NULL;
+        perror("eventfd read failed"); // EAGAIN only means the wait ended on timeout
     }
+}
 
-    return NULL;
+// Function to keep the backend open and expire old data, sleeping until woken or the next task is due
+void* storage_manager(void* arg)
+{
+    SharedData* shared = (SharedData*)arg;
+    long last_retention = 0; // Runs on the first connected pass
+    long reopen_at = 0; // Monotonic ms before which a lost backend is not reopened
+    long reopen_delay = REOPEN_MIN_MS;
+
+    while (!shared->storage_closing) // Keeps reopening while the writer drains, so the spool can be replayed
+    {
+        if (!shared->storage.connected && monotonic_ms() >= reopen_at)
+        {
+            // Readings are spooled meanwhile, so keep retrying instead of giving up
+            if (storage_open(&shared->storage) == 0)
+            {
+                shared->storage.retry_count = 0;
+                reopen_delay = REOPEN_MIN_MS;
+                ingest_queue_wake(&shared->ingest_queue); // The writer replays its spool right away
+            }
+            else
+            {
+                shared->storage.retry_count++;
+                write_log("Unable to open %s storage (attempt %d)", shared->storage.ops->name,
+                          shared->storage.retry_count);
+                reopen_at = monotonic_ms() + reopen_delay;
+                reopen_delay = reopen_delay * 2 < REOPEN_MAX_MS ? reopen_delay * 2 : REOPEN_MAX_MS;
+            }
+        }
+
+        long now = (long)time(NULL);
+        if (shared->storage.connected && shared->config.retention_days > 0 &&
+            now - last_retention >= RETENTION_INTERVAL_S)
+        {
+            expire_days(shared, now);
+            last_retention = now;
+        }
+
+        // Every reading reaches the writer through the ingest queue, so there is nothing to poll here
+        long timeout = -1;
+        if (!shared->storage.connected)
+        {
+            timeout = reopen_at - monotonic_ms();
+            timeout = timeout > 0 ? timeout : 0;
+        }
+        else if (shared->config.retention_days > 0)
+        {
+            timeout = (last_retention + RETENTION_INTERVAL_S - now) * 1000L;
+        }
+        wait_for_wake(shared->storage_wake_fd, (int)timeout);
+    }
+
+    return NULL; // The backend is closed by main once the writer has drained
 }
@@ -0,0 +1,308 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sqlite3.h>
+#include "storage_schema.h"
+#include "log.h"
+
+#define VIEW_TERM_SIZE 160 // Room for one SELECT term of the sensor_data view
+#define PARTITION_GLOB "sensor_data_[0-9]*"
+
+// Epoch seconds of a version 1 row, whose timestamp column holds local time as text
+#define LEGACY_TS "COALESCE(CAST(strftime('%s', timestamp, 'utc') AS INTEGER), CAST(strftime('%s', 'now') AS INTEGER))"
+
+// Function to return the partition (UTC day number) a timestamp belongs to
+long partition_day(long ts)
+{
+    return ts >= 0 ? ts / PARTITION_SECONDS : (ts - PARTITION_SECONDS + 1) / PARTITION_SECONDS;
+}
+
+// Function to format the table name of a partition, e.g. sensor_data_20240131
+void partition_name(long day, char* name, size_t size)
+{
+    time_t start = (time_t)day * PARTITION_SECONDS;
+    struct tm tm_info;
+    gmtime_r(&start, &tm_info);
+    strftime(name, size, "sensor_data_%Y%m%d", &tm_info);
+}
+
+// Function to run one or more statements that return no rows
+static int exec_sql(sqlite3* db, const char* sql)
+{
+    char* err_msg = NULL;
+    if (sqlite3_exec(db, sql, NULL, NULL, &err_msg) != SQLITE_OK)
+    {
+        write_log("SQL error: %s", err_msg); // Log error
+        sqlite3_free(err_msg);
+        return -1;
+    }
+    return 0;
+}
+
+// Function to check whether a table (not a view) of the given name exists
+static int table_exists(sqlite3* db, const char* name)
+{
+    sqlite3_stmt* stmt = NULL;
+    int exists = 0;
+    if (sqlite3_prepare_v2(db, "SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = ?1;",
+                           -1, &stmt, NULL) == SQLITE_OK)
+    {
+        sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
+        exists = sqlite3_step(stmt) == SQLITE_ROW;
+    }
+    sqlite3_finalize(stmt);
+    return exists;
+}
+
+// Function to create a partition table with its covering (sensor_id, ts) index
+static int create_partition(sqlite3* db, const char* name)
+{
+    char sql[320];
+    // The index carries the values too, so per-sensor range queries never touch the table
+    snprintf(sql, sizeof(sql),
+             "CREATE TABLE IF NOT EXISTS %s ("
+             "id INTEGER PRIMARY KEY,"
+             "sensor_id INTEGER NOT NULL,"
+             "ts INTEGER NOT NULL,"
+             "temperature REAL,"
+             "humidity REAL);"
+             "CREATE INDEX IF NOT EXISTS %s_sensor_ts ON %s (sensor_id, ts, temperature, humidity);",
+             name, name, name);
+    return exec_sql(db, sql);
+}
+
+// Function to collect partition names in order, optionally only those older than a bound
+static int list_partitions(sqlite3* db, const char* before, int newest_first,
+                           char (*names)[PARTITION_NAME_SIZE], int max)
+{
+    char sql[192];
+    snprintf(sql, sizeof(sql),
+             "SELECT name FROM sqlite_master WHERE type = 'table' AND name GLOB '" PARTITION_GLOB "' "
+             "AND name < ?1 ORDER BY name %s LIMIT %d;", newest_first ? "DESC" : "ASC", max);
+
+    sqlite3_stmt* stmt = NULL;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK)
+    {
+        write_log("Failed to list partitions: %s", sqlite3_errmsg(db)); // Log error
+        return -1;
+    }
+    sqlite3_bind_text(stmt, 1, before ? before : "sensor_data_a", -1, SQLITE_STATIC); // 'a' sorts after digits
+
+    int count = 0;
+    while (count < max && sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        snprintf(names[count++], PARTITION_NAME_SIZE, "%s", (const char*)sqlite3_column_text(stmt, 0));
+    }
+    sqlite3_finalize(stmt);
+    return count;
+}
+
+// Function to recreate the sensor_data view over the newest partitions
+static int rebuild_view(sqlite3* db)
+{
+    char (*names)[PARTITION_NAME_SIZE] = malloc(PARTITION_VIEW_MAX * sizeof(*names));
+    char* sql = malloc(64 + (size_t)PARTITION_VIEW_MAX * VIEW_TERM_SIZE);
+    if (!names || !sql)
+    {
+        free(names);
+        free(sql);
+        return -1;
+    }
+
+    int count = list_partitions(db, NULL, 1, names, PARTITION_VIEW_MAX);
+    if (count == PARTITION_VIEW_MAX)
+    {
+        write_log("sensor_data view limited to the newest %d partitions", PARTITION_VIEW_MAX);
+    }
+
+    int len = sprintf(sql, "DROP VIEW IF EXISTS sensor_data; CREATE VIEW sensor_data AS ");
+    if (count <= 0)
+    {
+        len += sprintf(sql + len, "SELECT NULL AS id, NULL AS sensor_id, NULL AS temperature, "
+                                  "NULL AS humidity, NULL AS timestamp, NULL AS ts WHERE 0");
+    }
+    for (int i = count - 1; i >= 0; i--) // Oldest first, like the single table it replaces
+    {
+        len += sprintf(sql + len, "SELECT id, sensor_id, temperature, humidity, "
+                                  "datetime(ts, 'unixepoch', 'localtime') AS timestamp, ts FROM %s%s",
+                       names[i], i > 0 ? " UNION ALL " : "");
+    }
+    sprintf(sql + len, ";");
+
+    int rc = count < 0 ? -1 : exec_sql(db, sql);
+    free(names);
+    free(sql);
+    return rc;
+}
+
+// Function to move the rows of a version 1 sensor_data table into daily partitions
+static int migrate_legacy(sqlite3* db)
+{
+    if (exec_sql(db, "ALTER TABLE sensor_data RENAME TO sensor_data_legacy;") == -1)
+    {
+        return -1;
+    }
+
+    // Collect the days first, the partitions cannot be created while the SELECT is running
+    sqlite3_stmt* stmt = NULL;
+    if (sqlite3_prepare_v2(db, "SELECT DISTINCT " LEGACY_TS " / 86400 FROM sensor_data_legacy;",
+                           -1, &stmt, NULL) != SQLITE_OK)
+    {
+        write_log("Failed to read legacy data: %s", sqlite3_errmsg(db)); // Log error
+        return -1;
+    }
+    long* days = NULL;
+    size_t day_count = 0, day_capacity = 0;
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        if (day_count == day_capacity)
+        {
+            day_capacity = day_capacity ? day_capacity * 2 : 64;
+            long* grown = realloc(days, day_capacity * sizeof(long));
+            if (!grown)
+            {
+                free(days);
+                sqlite3_finalize(stmt);
+                return -1;
+            }
+            days = grown;
+        }
+        days[day_count++] = (long)sqlite3_column_int64(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+
+    long moved = 0;
+    int rc = 0;
+    for (size_t i = 0; i < day_count && rc == 0; i++)
+    {
+        char name[PARTITION_NAME_SIZE];
+        char sql[512];
+        partition_name(days[i], name, sizeof(name));
+        snprintf(sql, sizeof(sql),
+                 "INSERT INTO %s (sensor_id, ts, temperature, humidity) "
+                 "SELECT sensor_id, ts, temperature, humidity FROM "
+                 "(SELECT sensor_id, %s AS ts, temperature, humidity FROM sensor_data_legacy) "
+                 "WHERE ts / 86400 = %ld ORDER BY ts;", name, LEGACY_TS, days[i]);
+        rc = create_partition(db, name) == 0 ? exec_sql(db, sql) : -1;
+        moved += sqlite3_changes(db);
+    }
+    free(days);
+
+    if (rc == 0 && exec_sql(db, "DROP TABLE sensor_data_legacy;") == 0)
+    {
+        write_log("Migrated %ld readings into %zu daily partitions", moved, day_count);
+        return 0;
+    }
+    return -1;
+}
+
+// Function to create the table of finished rollup windows, one row per sensor, resolution and window
+static int create_rollup_table(sqlite3* db)
+{
+    return exec_sql(db,
+                    "CREATE TABLE IF NOT EXISTS sensor_rollup ("
+                    "sensor_id INTEGER NOT NULL,"
+                    "resolution INTEGER NOT NULL,"
+                    "window_start INTEGER NOT NULL,"
+                    "count INTEGER NOT NULL,"
+                    "temperature_min REAL, temperature_max REAL, temperature_mean REAL,"
+                    "temperature_var REAL, temperature_p95 REAL,"
+                    "humidity_min REAL, humidity_max REAL, humidity_mean REAL,"
+                    "humidity_var REAL, humidity_p95 REAL,"
+                    "PRIMARY KEY (sensor_id, resolution, window_start)) WITHOUT ROWID;"
+                    "CREATE INDEX IF NOT EXISTS sensor_rollup_window ON sensor_rollup (resolution, window_start);");
+}
+
+// Function to bring the database to the current schema version and refresh the view
+int schema_migrate(sqlite3* db)
+{
+    sqlite3_stmt* stmt = NULL;
+    int version = -1;
+    if (sqlite3_prepare_v2(db, "PRAGMA user_version;", -1, &stmt, NULL) == SQLITE_OK &&
+        sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        version = sqlite3_column_int(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+
+    // A locked database already ran out the busy timeout reading the version, don't wait it out again
+    if (version == -1 || exec_sql(db, "BEGIN IMMEDIATE;") == -1)
+    {
+        return -1;
+    }
+
+    char name[PARTITION_NAME_SIZE];
+    partition_name(partition_day((long)time(NULL)), name, sizeof(name));
+
+    char version_sql[64];
+    snprintf(version_sql, sizeof(version_sql), "PRAGMA user_version = %d;", SCHEMA_VERSION);
+
+    int rc = 0;
+    if (version < SCHEMA_VERSION && table_exists(db, "sensor_data"))
+    {
+        rc = migrate_legacy(db);
+    }
+    if (rc == 0 && create_partition(db, name) == 0 && create_rollup_table(db) == 0 && rebuild_view(db) == 0 &&
+        exec_sql(db, version_sql) == 0 && exec_sql(db, "COMMIT;") == 0)
+    {
+        return 0;
+    }
+    exec_sql(db, "ROLLBACK;");
+    return -1;
+}
+
+// Function to make sure the partition of a day exists, adding it to the view when created
+int schema_ensure_partition(sqlite3* db, long day)
+{
+    char name[PARTITION_NAME_SIZE];
+    partition_name(day, name, sizeof(name));
+    if (table_exists(db, name))
+    {
+        return 0;
+    }
+    if (create_partition(db, name) == -1 || rebuild_view(db) == -1)
+    {
+        return -1;
+    }
+    write_log("New partition %s created", name);
+    return 0;
+}
+
+// Function to drop every partition older than a day, returns the number dropped
+int schema_drop_expired(sqlite3* db, long oldest_day)
+{
+    char bound[PARTITION_NAME_SIZE];
+    partition_name(oldest_day, bound, sizeof(bound));
+
+    char (*names)[PARTITION_NAME_SIZE] = malloc(PARTITION_VIEW_MAX * sizeof(*names));
+    if (!names)
+    {
+        return -1;
+    }
+    int count = list_partitions(db, bound, 0, names, PARTITION_VIEW_MAX);
+    if (count <= 0)
+    {
+        free(names);
+        return count;
+    }
+
+    // Dropping a table frees its pages at once, unlike a DELETE that rewrites every row
+    int rc = exec_sql(db, "BEGIN IMMEDIATE;");
+    for (int i = 0; i < count && rc == 0; i++)
+    {
+        char sql[64];
+        snprintf(sql, sizeof(sql), "DROP TABLE %s;", names[i]);
+        rc = exec_sql(db, sql);
+    }
+    if (rc == 0 && rebuild_view(db) == 0 && exec_sql(db, "COMMIT;") == 0)
+    {
+        write_log("Dropped %d partitions older than %s", count, bound);
+    }
+    else
+    {
+        exec_sql(db, "ROLLBACK;");
+        count = -1;
+    }
+    free(names);
+    return count;
+}
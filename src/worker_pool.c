@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "worker_pool.h"
+#include "sensor_handler.h"
+#include "log.h"
+
+#define WORKER_QUEUE_SIZE 1024 // Pending readings per worker before producers wait
+
+typedef struct
+{
+    SensorSlot* slot; // Registry handle of the reporting sensor
+    SensorReading reading;
+    int count; // Readings in the batch this item starts, 0 inside a batch
+} WorkItem;
+
+typedef struct
+{
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    WorkItem queue[WORKER_QUEUE_SIZE];
+    int head; // Next reading to process
+    int count; // Number of queued readings
+    int stopping;
+    SharedData* shared;
+} Worker;
+
+static Worker* workers = NULL; // Fixed-size pool, one queue per worker
+static int worker_total = 0;
+
+// Function run by each worker thread to process queued readings
+static void* worker_main(void* arg)
+{
+    Worker* worker = (Worker*)arg;
+    SensorReading readings[READING_BATCH_MAX];
+
+    pthread_mutex_lock(&worker->mutex);
+    while (1)
+    {
+        while (worker->count == 0 && !worker->stopping)
+        {
+            pthread_cond_wait(&worker->not_empty, &worker->mutex); // Sleep until a reading arrives
+        }
+        if (worker->count == 0)
+        {
+            break; // Stopping and fully drained
+        }
+
+        // A batch was queued in one piece, so take all of it in one piece
+        SensorSlot* slot = worker->queue[worker->head].slot;
+        int count = worker->queue[worker->head].count;
+        for (int i = 0; i < count; i++)
+        {
+            readings[i] = worker->queue[worker->head].reading;
+            worker->head = (worker->head + 1) % WORKER_QUEUE_SIZE;
+        }
+        worker->count -= count;
+        pthread_cond_broadcast(&worker->not_full); // Producers may wait for different amounts of room
+        pthread_mutex_unlock(&worker->mutex);
+
+        process_sensor_readings(worker->shared, slot, readings, count); // Process outside the queue lock
+
+        pthread_mutex_lock(&worker->mutex);
+    }
+    pthread_mutex_unlock(&worker->mutex);
+    return NULL;
+}
+
+// Function to start the fixed-size pool of reading workers
+int worker_pool_start(SharedData* shared, int worker_count)
+{
+    workers = calloc(worker_count, sizeof(Worker));
+    if (!workers)
+    {
+        write_log("Failed to allocate worker pool");
+        return -1;
+    }
+
+    for (int i = 0; i < worker_count; i++)
+    {
+        Worker* worker = &workers[i];
+        pthread_mutex_init(&worker->mutex, NULL);
+        pthread_cond_init(&worker->not_empty, NULL);
+        pthread_cond_init(&worker->not_full, NULL);
+        worker->shared = shared;
+
+        if (pthread_create(&worker->thread, NULL, worker_main, worker) != 0)
+        {
+            write_log("Failed to create worker thread %d", i);
+            worker_total = i;
+            worker_pool_stop();
+            return -1;
+        }
+    }
+    worker_total = worker_count;
+    return 0;
+}
+
+// Function to queue the readings of one frame for processing
+void worker_pool_submit(SensorSlot* slot, const SensorReading* readings, int count)
+{
+    // Readings of one sensor always go to the same worker so they stay in order
+    Worker* worker = &workers[(unsigned int)readings[0].sensor_id % (unsigned int)worker_total];
+
+    pthread_mutex_lock(&worker->mutex);
+    while (WORKER_QUEUE_SIZE - worker->count < count && !worker->stopping)
+    {
+        pthread_cond_wait(&worker->not_full, &worker->mutex); // Backpressure the event loop
+    }
+    if (!worker->stopping)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            WorkItem* item = &worker->queue[(worker->head + worker->count + i) % WORKER_QUEUE_SIZE];
+            item->slot = slot;
+            item->reading = readings[i];
+            item->count = i == 0 ? count : 0;
+        }
+        worker->count += count;
+        pthread_cond_signal(&worker->not_empty);
+    }
+    pthread_mutex_unlock(&worker->mutex);
+}
+
+// Function to stop the workers after they drain their queues
+void worker_pool_stop(void)
+{
+    for (int i = 0; i < worker_total; i++)
+    {
+        pthread_mutex_lock(&workers[i].mutex);
+        workers[i].stopping = 1;
+        pthread_cond_broadcast(&workers[i].not_empty);
+        pthread_cond_broadcast(&workers[i].not_full);
+        pthread_mutex_unlock(&workers[i].mutex);
+    }
+
+    for (int i = 0; i < worker_total; i++)
+    {
+        pthread_join(workers[i].thread, NULL);
+        pthread_mutex_destroy(&workers[i].mutex);
+        pthread_cond_destroy(&workers[i].not_empty);
+        pthread_cond_destroy(&workers[i].not_full);
+    }
+
+    free(workers);
+    workers = NULL;
+    worker_total = 0;
+}
\ No newline at end of file